@@ -184,6 +184,7 @@ static signed interference(GB_gameboy_t *gb)
 
 static void render(GB_gameboy_t *gb)
 {
+    GB_PERF_COUNT(gb, apu_renders, 1);
     GB_sample_t output = {0, 0};
 
     unrolled for (unsigned i = 0; i < GB_N_CHANNELS; i++) {
@@ -278,6 +279,7 @@ static void render(GB_gameboy_t *gb)
         filtered_output.left = MAX(MIN(filtered_output.left + interference_bias, 0x7FFF), -0x8000);
         filtered_output.right = MAX(MIN(filtered_output.right + interference_bias, 0x7FFF), -0x8000);
     }
+    if (unlikely(gb->speculating)) return;
     assert(gb->apu_output.sample_callback);
     gb->apu_output.sample_callback(gb, &filtered_output);
     if (unlikely(gb->apu_output.output_file)) {
@@ -631,6 +633,20 @@ static void step_lfsr(GB_gameboy_t *gb, unsigned cycles_offset)
     }
 }
 
+/* States that must be emulated on every M-cycle rather than lazily */
+static inline bool needs_exact_timing(GB_gameboy_t *gb)
+{
+    return (gb->apu.square_sweep_calculate_countdown || gb->apu.channel_1_restart_hold || gb->apu.square_sweep_calculate_countdown_reload_timer) ||
+           (gb->model <= GB_MODEL_CGB_E && (gb->apu.wave_channel.bugged_read_countdown || (gb->apu.wave_channel.enable && gb->apu.wave_channel.pulsed)));
+}
+
+bool GB_apu_is_lazy_for(GB_gameboy_t *gb, unsigned m_cycles)
+{
+    if (needs_exact_timing(gb)) return false;
+    if (gb->apu.apu_cycles + gb->apu_output.cycles_since_render + (m_cycles << !gb->cgb_double_speed) >= gb->apu_output.max_cycles_per_sample) return false;
+    return gb->apu_output.sample_cycles + ((gb->apu_output.sample_rate << !gb->cgb_double_speed) << 1) * m_cycles < GB_get_clock_rate(gb);
+}
+
 void GB_apu_run(GB_gameboy_t *gb, bool force)
 {
     uint32_t clock_rate = GB_get_clock_rate(gb);
@@ -642,8 +658,7 @@ restart:;
     if (force ||
         (cycles + gb->apu_output.cycles_since_render >= gb->apu_output.max_cycles_per_sample) ||
         (gb->apu_output.sample_cycles >= clock_rate) ||
-        (gb->apu.square_sweep_calculate_countdown || gb->apu.channel_1_restart_hold || gb->apu.square_sweep_calculate_countdown_reload_timer) ||
-        (gb->model <= GB_MODEL_CGB_E && (gb->apu.wave_channel.bugged_read_countdown || (gb->apu.wave_channel.enable && gb->apu.wave_channel.pulsed)))) {
+        needs_exact_timing(gb)) {
         force = true;
     }
     if (!force) {
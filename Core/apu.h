@@ -220,4 +220,6 @@ internal void GB_apu_div_event(GB_gameboy_t *gb);
 internal void GB_apu_div_secondary_event(GB_gameboy_t *gb);
 internal void GB_apu_init(GB_gameboy_t *gb);
 internal void GB_apu_run(GB_gameboy_t *gb, bool force);
+/* Whether GB_apu_run(gb, false) would return without doing anything after each of the next m_cycles M-cycles */
+internal bool GB_apu_is_lazy_for(GB_gameboy_t *gb, unsigned m_cycles);
 #endif
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "gb.h"
+
+struct GB_batch_s {
+    unsigned count;
+    GB_gameboy_t **gb;
+    uint8_t **start_states;
+    size_t *start_state_sizes;
+    GB_batch_observations_t observations;
+    
+    /* Current step */
+    const GB_key_mask_t *actions;
+    const bool *reset;
+    unsigned frames;
+    unsigned next_index;
+    unsigned completed;
+    
+    /* Thread pool */
+    unsigned n_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    unsigned generation;
+    bool quit;
+};
+
+static void step_instance(GB_batch_t *batch, unsigned index)
+{
+    GB_gameboy_t *gb = batch->gb[index];
+    if (batch->reset && batch->reset[index] && batch->start_states[index]) {
+        GB_load_state_from_buffer(gb, batch->start_states[index], batch->start_state_sizes[index]);
+    }
+    GB_set_key_mask(gb, batch->actions[index]);
+    for (unsigned i = batch->frames; i--;) {
+        GB_run_frame(gb);
+    }
+    
+    const GB_batch_observations_t *observations = &batch->observations;
+    if (observations->ram) {
+        memcpy(observations->ram + gb->ram_size * index, gb->ram, gb->ram_size);
+    }
+    if (observations->hram) {
+        memcpy(observations->hram + sizeof(gb->hram) * index, gb->hram, sizeof(gb->hram));
+    }
+    if (observations->io_registers) {
+        memcpy(observations->io_registers + sizeof(gb->io_registers) * index, gb->io_registers, sizeof(gb->io_registers));
+    }
+}
+
+static void run_steps(GB_batch_t *batch)
+{
+    while (true) {
+        unsigned index = __atomic_fetch_add(&batch->next_index, 1, __ATOMIC_ACQUIRE);
+        if (index >= batch->count) return;
+        step_instance(batch, index);
+        if (__atomic_add_fetch(&batch->completed, 1, __ATOMIC_RELEASE) == batch->count) {
+            pthread_mutex_lock(&batch->lock);
+            pthread_cond_signal(&batch->done_cond);
+            pthread_mutex_unlock(&batch->lock);
+        }
+    }
+}
+
+static void *worker(GB_batch_t *batch)
+{
+    unsigned generation = 0;
+    pthread_mutex_lock(&batch->lock);
+    while (true) {
+        while (batch->generation == generation && !batch->quit) {
+            pthread_cond_wait(&batch->work_cond, &batch->lock);
+        }
+        if (batch->quit) break;
+        generation = batch->generation;
+        pthread_mutex_unlock(&batch->lock);
+        run_steps(batch);
+        pthread_mutex_lock(&batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+GB_batch_t *GB_batch_create(unsigned count, GB_model_t model, unsigned threads)
+{
+    GB_batch_t *batch = malloc(sizeof(*batch));
+    memset(batch, 0, sizeof(*batch));
+    batch->count = count;
+    batch->gb = malloc(sizeof(batch->gb[0]) * count);
+    batch->start_states = calloc(count, sizeof(batch->start_states[0]));
+    batch->start_state_sizes = calloc(count, sizeof(batch->start_state_sizes[0]));
+    for (unsigned i = 0; i < count; i++) {
+        batch->gb[i] = GB_init(GB_alloc(), model);
+        GB_set_rendering_disabled(batch->gb[i], true);
+        /* Instances run as fast as possible, never synced to real time */
+        GB_set_turbo_mode(batch->gb[i], true, true);
+    }
+    
+    batch->lock = (pthread_mutex_t)PTHREAD_MUTEX_INITIALIZER;
+    batch->work_cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+    batch->done_cond = (pthread_cond_t)PTHREAD_COND_INITIALIZER;
+    batch->threads = malloc(sizeof(batch->threads[0]) * (threads ?: 1));
+    for (unsigned i = 0; i < threads; i++) {
+        if (pthread_create(&batch->threads[batch->n_threads], NULL, (void *)worker, batch) == 0) {
+            batch->n_threads++;
+        }
+    }
+    return batch;
+}
+
+void GB_batch_free(GB_batch_t *batch)
+{
+    pthread_mutex_lock(&batch->lock);
+    batch->quit = true;
+    pthread_cond_broadcast(&batch->work_cond);
+    pthread_mutex_unlock(&batch->lock);
+    for (unsigned i = 0; i < batch->n_threads; i++) {
+        pthread_join(batch->threads[i], NULL);
+    }
+    free(batch->threads);
+    
+    for (unsigned i = 0; i < batch->count; i++) {
+        GB_dealloc(batch->gb[i]);
+        free(batch->start_states[i]);
+    }
+    free(batch->gb);
+    free(batch->start_states);
+    free(batch->start_state_sizes);
+    free(batch);
+}
+
+unsigned GB_batch_get_count(GB_batch_t *batch)
+{
+    return batch->count;
+}
+
+GB_gameboy_t *GB_batch_get_instance(GB_batch_t *batch, unsigned index)
+{
+    if (index >= batch->count) return NULL;
+    return batch->gb[index];
+}
+
+size_t GB_batch_get_ram_size(GB_batch_t *batch)
+{
+    return batch->gb[0]->ram_size;
+}
+
+void GB_batch_load_rom_from_buffer(GB_batch_t *batch, const uint8_t *buffer, size_t size)
+{
+    for (unsigned i = 0; i < batch->count; i++) {
+        GB_load_rom_from_buffer(batch->gb[i], buffer, size);
+    }
+}
+
+void GB_batch_set_observations(GB_batch_t *batch, const GB_batch_observations_t *observations)
+{
+    batch->observations = *observations;
+    for (unsigned i = 0; i < batch->count; i++) {
+        GB_gameboy_t *gb = batch->gb[i];
+        GB_set_pixels_output(gb, observations->pixels?
+                                 observations->pixels + GB_get_screen_width(gb) * GB_get_screen_height(gb) * i :
+                                 NULL);
+        GB_set_indexed_pixels_output(gb, observations->indexed_pixels?
+                                         observations->indexed_pixels + 160 * 144 * i :
+                                         NULL, NULL);
+        GB_set_rendering_disabled(gb, !observations->pixels && !observations->indexed_pixels);
+    }
+}
+
+void GB_batch_save_start_state(GB_batch_t *batch)
+{
+    for (unsigned i = 0; i < batch->count; i++) {
+        size_t size = GB_get_save_state_size(batch->gb[i]);
+        if (size != batch->start_state_sizes[i]) {
+            batch->start_states[i] = realloc(batch->start_states[i], size);
+            batch->start_state_sizes[i] = size;
+        }
+        GB_save_state_to_buffer(batch->gb[i], batch->start_states[i]);
+    }
+}
+
+void GB_batch_step(GB_batch_t *batch, const GB_key_mask_t *actions, unsigned frames, const bool *reset)
+{
+    batch->actions = actions;
+    batch->reset = reset;
+    batch->frames = frames;
+    batch->completed = 0;
+    __atomic_store_n(&batch->next_index, 0, __ATOMIC_RELEASE);
+    
+    if (batch->n_threads) {
+        pthread_mutex_lock(&batch->lock);
+        batch->generation++;
+        pthread_cond_broadcast(&batch->work_cond);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    
+    run_steps(batch);
+    
+    pthread_mutex_lock(&batch->lock);
+    while (__atomic_load_n(&batch->completed, __ATOMIC_ACQUIRE) != batch->count) {
+        pthread_cond_wait(&batch->done_cond, &batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
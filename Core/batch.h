@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "defs.h"
+
+typedef struct GB_batch_s GB_batch_t;
+
+/* Caller-owned observation arrays, each is either NULL or holds one entry per instance back to back */
+typedef struct {
+    uint32_t *pixels; // GB_get_screen_width * GB_get_screen_height per instance, requires an RGB encode callback
+    uint8_t *indexed_pixels; // 160 * 144 per instance, see GB_set_indexed_pixels_output
+    uint8_t *ram; // GB_batch_get_ram_size per instance
+    uint8_t *hram; // 0x7F per instance
+    uint8_t *io_registers; // 0x80 per instance
+} GB_batch_observations_t;
+
+/* Creates count instances of the same model. Instances are stepped on threads worker threads, in addition to the
+   calling thread. Use GB_batch_get_instance to configure the instances (boot ROM, callbacks, etc.) */
+GB_batch_t *GB_batch_create(unsigned count, GB_model_t model, unsigned threads);
+void GB_batch_free(GB_batch_t *batch);
+unsigned GB_batch_get_count(GB_batch_t *batch);
+GB_gameboy_t *GB_batch_get_instance(GB_batch_t *batch, unsigned index);
+size_t GB_batch_get_ram_size(GB_batch_t *batch);
+void GB_batch_load_rom_from_buffer(GB_batch_t *batch, const uint8_t *buffer, size_t size);
+/* Rendering is disabled while neither pixels nor indexed_pixels are requested */
+void GB_batch_set_observations(GB_batch_t *batch, const GB_batch_observations_t *observations);
+/* Stores the current state of every instance as the state it's reset to */
+void GB_batch_save_start_state(GB_batch_t *batch);
+/* Resets every instance with a set reset flag to its start state (reset may be NULL), applies one key mask per
+   instance, and runs every instance for the given number of frames, then fills the observation arrays. */
+void GB_batch_step(GB_batch_t *batch, const GB_key_mask_t *actions, unsigned frames, const bool *reset);
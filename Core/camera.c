@@ -1,46 +1,42 @@
+#include <string.h>
 #include "gb.h"
 
-static uint32_t noise_seed = 0;
-
 /* This is not a complete emulation of the camera chip. Only the features used by the Game Boy Camera ROMs are supported.
     We also do not emulate the timing of the real cart when a webcam is used, as it might be actually faster than the webcam. */
 
-static uint8_t generate_noise(uint8_t x, uint8_t y)
-{
-    uint32_t value = (x * 151 + y * 149) ^ noise_seed;
-    uint32_t hash = 0;
+#define CAMERA_WIDTH 128
+#define CAMERA_HEIGHT 112
 
-    while (value) {
-        hash <<= 1;
-        if (hash & 0x100) {
-            hash ^= 0x101;
-        }
-        if (value & 0x80000000) {
-            hash ^= 0xA1;
+/* The noise hash is a bit-serial LFSR, stepping it is rotating its 8-bit state left and XORing in 0xA1 for every set
+   bit. It's linear and a rotation by 8 is the identity, so it can be computed a byte at a time, followed by a rotation
+   that accounts for the trailing zero bits, which the original loop did not step for. */
+static void generate_noise_table(uint8_t *table)
+{
+    for (unsigned i = 0; i < 0x100; i++) {
+        uint8_t hash = 0;
+        for (uint8_t bit = 0x80; bit; bit >>= 1) {
+            hash = (hash << 1) | (hash >> 7);
+            if (i & bit) {
+                hash ^= 0xA1;
+            }
         }
-        value <<= 1;
+        table[i] = hash;
     }
-    return hash;
 }
 
-static long get_processed_color(GB_gameboy_t *gb, uint8_t x, uint8_t y)
+static uint8_t generate_noise(GB_gameboy_t *gb, const uint8_t *table, uint8_t x, uint8_t y)
 {
-    if (x == 128) {
-        x = 127;
-    }
-    else if (x > 128) {
-        x = 0;
-    }
+    uint32_t value = (x * 151 + y * 149) ^ gb->camera_noise_seed;
+    if (!value) return 0;
     
-    if (y == 112) {
-        y = 111;
-    }
-    else if (y >= 112) {
-        y = 0;
-    }
-
-    long color = gb->camera_get_pixel_callback? gb->camera_get_pixel_callback(gb, x, y) : (generate_noise(x, y));
+    uint8_t hash = table[value >> 24] ^ table[(value >> 16) & 0xFF] ^ table[(value >> 8) & 0xFF] ^ table[value & 0xFF];
+    unsigned rotation = __builtin_ctz(value) & 7;
+    return (hash >> rotation) | (hash << ((8 - rotation) & 7));
+}
 
+/* Processes a full sensor image into gb->camera_image. This runs once per shot, on the first read of the image. */
+static void capture_image(GB_gameboy_t *gb)
+{
     static const double gain_values[] =
         {0.8809390, 0.9149149, 0.9457498, 0.9739758,
          1.0000000, 1.0241412, 1.0466537, 1.0677433,
@@ -50,62 +46,83 @@ static long get_processed_color(GB_gameboy_t *gb, uint8_t x, uint8_t y)
          1.4689574, 1.4926697, 1.5148087, 1.5355703,
          1.5551159, 1.5735801, 1.5910762, 1.6077008,
          1.6235366, 1.6386550, 1.6531183, 1.6669808};
-    /* Multiply color by gain value */
-    color *= gain_values[gb->camera_registers[GB_CAMERA_GAIN_AND_EDGE_ENHACEMENT_FLAGS] & 0x1F];
-
-
-    /* Color is multiplied by the exposure register to simulate exposure. */
-    color = color * ((gb->camera_registers[GB_CAMERA_EXPOSURE_HIGH] << 8) + gb->camera_registers[GB_CAMERA_EXPOSURE_LOW]) / 0x1000;
-
-    return color;
+    /* Edge enhancement ratios of 0.5, 0.75, 1, 1.25, 2, 3, 4 and 5, in quarters */
+    static const uint8_t edge_enhancement_ratios[] = {2, 3, 4, 5, 8, 12, 16, 20};
+    
+    /* Gain and exposure only depend on the sensor value, so they're applied via a lookup table */
+    int32_t levels[0x100];
+    double gain = gain_values[gb->camera_registers[GB_CAMERA_GAIN_AND_EDGE_ENHACEMENT_FLAGS] & 0x1F];
+    int32_t exposure = (gb->camera_registers[GB_CAMERA_EXPOSURE_HIGH] << 8) + gb->camera_registers[GB_CAMERA_EXPOSURE_LOW];
+    for (unsigned i = 0; i < 0x100; i++) {
+        levels[i] = (int32_t)(i * gain) * exposure / 0x1000;
+    }
+    
+    uint8_t noise_table[0x100];
+    if (!gb->camera_get_pixel_callback) {
+        generate_noise_table(noise_table);
+    }
+    
+    int32_t pixels[CAMERA_HEIGHT][CAMERA_WIDTH];
+    for (unsigned y = 0; y < CAMERA_HEIGHT; y++) {
+        for (unsigned x = 0; x < CAMERA_WIDTH; x++) {
+            pixels[y][x] = levels[gb->camera_get_pixel_callback? gb->camera_get_pixel_callback(gb, x, y) : generate_noise(gb, noise_table, x, y)];
+        }
+    }
+    
+    bool edge_enhancement = (gb->camera_registers[GB_CAMERA_GAIN_AND_EDGE_ENHACEMENT_FLAGS] & 0xE0) == 0xE0;
+    int32_t ratio = edge_enhancement_ratios[(gb->camera_registers[GB_CAMERA_EDGE_ENHANCEMENT_INVERT_AND_VOLTAGE] >> 4) & 0x7];
+    memset(gb->camera_image, 0, sizeof(gb->camera_image));
+    
+    for (unsigned y = 0; y < CAMERA_HEIGHT; y++) {
+        /* Neighbors past the edges are clamped */
+        const int32_t *above = pixels[y? y - 1 : 0];
+        const int32_t *below = pixels[y < CAMERA_HEIGHT - 1? y + 1 : y];
+        uint8_t *dest = gb->camera_image + (y / 8) * 0x100 + (y & 7) * 2;
+        
+        for (unsigned x = 0; x < CAMERA_WIDTH; x++) {
+            int32_t color = pixels[y][x];
+            if (edge_enhancement) {
+                /* The ratio is in quarters, every step truncates towards zero */
+                color += color * ratio;
+                color = (color * 4 - pixels[y][x? x - 1 : 0] * ratio) / 4;
+                color = (color * 4 - pixels[y][x < CAMERA_WIDTH - 1? x + 1 : x] * ratio) / 4;
+                color = (color * 4 - above[x] * ratio) / 4;
+                color = (color * 4 - below[x] * ratio) / 4;
+            }
+            
+            /* The camera's registers are used as a threshold pattern, which defines the dithering */
+            uint8_t pattern_base = ((x & 3) + (y & 3) * 4) * 3 + GB_CAMERA_DITHERING_PATTERN_START;
+            
+            uint8_t shade;
+            if (color < gb->camera_registers[pattern_base]) {
+                shade = 3;
+            }
+            else if (color < gb->camera_registers[pattern_base + 1]) {
+                shade = 2;
+            }
+            else if (color < gb->camera_registers[pattern_base + 2]) {
+                shade = 1;
+            }
+            else {
+                shade = 0;
+            }
+            
+            uint8_t mask = 0x80 >> (x & 7);
+            uint8_t *tile_row = dest + (x / 8) * 0x10;
+            if (shade & 1) tile_row[0] |= mask;
+            if (shade & 2) tile_row[1] |= mask;
+        }
+    }
+    
+    gb->camera_image_valid = true;
 }
 
 uint8_t GB_camera_read_image(GB_gameboy_t *gb, uint16_t addr)
 {
-    uint8_t tile_x = addr / 0x10 % 0x10;
-    uint8_t tile_y = addr / 0x10 / 0x10;
-
-    uint8_t y = ((addr >> 1) & 0x7) + tile_y * 8;
-    uint8_t bit = addr & 1;
-
-    uint8_t ret = 0;
-
-    for (uint8_t x = tile_x * 8; x < tile_x * 8 + 8; x++) {
-
-        long color = get_processed_color(gb, x, y);
-
-        static const double edge_enhancement_ratios[] = {0.5, 0.75, 1, 1.25, 2, 3, 4, 5};
-        double edge_enhancement_ratio = edge_enhancement_ratios[(gb->camera_registers[GB_CAMERA_EDGE_ENHANCEMENT_INVERT_AND_VOLTAGE] >> 4) & 0x7];
-        if ((gb->camera_registers[GB_CAMERA_GAIN_AND_EDGE_ENHACEMENT_FLAGS] & 0xE0) == 0xE0) {
-                color += (color * 4) * edge_enhancement_ratio;
-                color -= get_processed_color(gb, x - 1, y) * edge_enhancement_ratio;
-                color -= get_processed_color(gb, x + 1, y) * edge_enhancement_ratio;
-                color -= get_processed_color(gb, x, y - 1) * edge_enhancement_ratio;
-                color -= get_processed_color(gb, x, y + 1) * edge_enhancement_ratio;
-        }
-
-
-        /* The camera's registers are used as a threshold pattern, which defines the dithering */
-        uint8_t pattern_base = ((x & 3) + (y & 3) * 4) * 3 + GB_CAMERA_DITHERING_PATTERN_START;
-
-        if (color < gb->camera_registers[pattern_base]) {
-            color = 3;
-        }
-        else if (color < gb->camera_registers[pattern_base + 1]) {
-            color = 2;
-        }
-        else if (color < gb->camera_registers[pattern_base + 2]) {
-            color = 1;
-        }
-        else {
-            color = 0;
-        }
-
-        ret <<= 1;
-        ret |= (color >> bit) & 1;
+    if (unlikely(!gb->camera_image_valid)) {
+        capture_image(gb);
     }
-
-    return ret;
+    return gb->camera_image[addr];
 }
 
 void GB_set_camera_get_pixel_callback(GB_gameboy_t *gb, GB_camera_get_pixel_callback_t callback)
@@ -127,6 +144,7 @@ void GB_set_camera_update_request_callback(GB_gameboy_t *gb, GB_camera_update_re
 void GB_camera_updated(GB_gameboy_t *gb)
 {
     gb->camera_registers[GB_CAMERA_SHOOT_AND_1D_FLAGS] &= ~1;
+    gb->camera_image_valid = false;
 }
 
 void GB_camera_write_register(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
@@ -134,7 +152,7 @@ void GB_camera_write_register(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
     addr &= 0x7F;
     if (addr == GB_CAMERA_SHOOT_AND_1D_FLAGS) {
         value &= 0x7;
-        noise_seed = GB_random();
+        gb->camera_noise_seed = GB_random();
         if ((value & 1) && !(gb->camera_registers[GB_CAMERA_SHOOT_AND_1D_FLAGS] & 1)) {
             if (gb->camera_update_request_callback) {
                 gb->camera_update_request_callback(gb);
@@ -6,11 +6,6 @@
 #include <string.h>
 #include <stdlib.h>
 
-static inline uint8_t hash_addr(uint16_t addr)
-{
-    return addr;
-}
-
 static uint16_t bank_for_addr(GB_gameboy_t *gb, uint16_t addr)
 {
     if (addr < 0x4000) {
@@ -32,17 +27,23 @@ static uint16_t bank_for_addr(GB_gameboy_t *gb, uint16_t addr)
     return 0;
 }
 
+static void update_cheat_index(GB_gameboy_t *gb);
+
 static noinline void apply_cheat(GB_gameboy_t *gb, uint16_t address, uint8_t *value)
 {
     if (unlikely(!gb->boot_rom_finished)) return;
-    const GB_cheat_hash_t *hash = gb->cheat_hash[hash_addr(address)];
-    if (likely(!hash)) return;
+    if (unlikely(gb->cheat_index_dirty)) {
+        update_cheat_index(gb);
+        if (!(gb->cheat_bitmap[address >> 3] & (1 << (address & 7)))) return;
+    }
+    const GB_cheat_slot_t *slot = &gb->cheat_slots[gb->cheat_slot_for_addr[address]];
+    uint16_t bank = slot->banked? bank_for_addr(gb, address) : GB_CHEAT_ANY_BANK;
     
-    for (unsigned i = 0; i < hash->size; i++) {
-        GB_cheat_t *cheat = hash->cheats[i];
-        if (cheat->address == address && cheat->enabled && (!cheat->use_old_value || cheat->old_value == *value)) {
-            if (cheat->bank == GB_CHEAT_ANY_BANK || cheat->bank == bank_for_addr(gb, address)) {
-                *value = cheat->value;
+    const GB_cheat_entry_t *entry = &gb->cheat_entries[slot->first_entry];
+    for (unsigned i = slot->n_entries; i--; entry++) {
+        if (!entry->use_old_value || entry->old_value == *value) {
+            if (entry->bank == GB_CHEAT_ANY_BANK || entry->bank == bank) {
+                *value = entry->value;
                 break;
             }
         }
@@ -52,10 +53,103 @@ static noinline void apply_cheat(GB_gameboy_t *gb, uint16_t address, uint8_t *va
 void GB_apply_cheat(GB_gameboy_t *gb, uint16_t address, uint8_t *value)
 {
     if (likely(!gb->cheat_enabled)) return;
-    if (likely(gb->cheat_count == 0)) return; // Optimization
+    if (likely(!(gb->cheat_bitmap[address >> 3] & (1 << (address & 7))))) return;
     apply_cheat(gb, address, value);
 }
 
+typedef struct {
+    const GB_cheat_t *cheat;
+    size_t index; // Position in the cheat list
+} indexed_cheat_t;
+
+static int compare_cheats(const void *a_ptr, const void *b_ptr)
+{
+    const indexed_cheat_t *a = a_ptr, *b = b_ptr;
+    if (a->cheat->address != b->cheat->address) return a->cheat->address < b->cheat->address? -1 : 1;
+    /* Cheats for the same address keep their list order */
+    if (a->index != b->index) return a->index < b->index? -1 : 1;
+    return 0;
+}
+
+static void free_cheat_index(GB_gameboy_t *gb)
+{
+    memset(gb->cheat_bitmap, 0, sizeof(gb->cheat_bitmap));
+    free(gb->cheat_slots);
+    free(gb->cheat_entries);
+    gb->cheat_slots = NULL;
+    gb->cheat_entries = NULL;
+    gb->cheat_index_dirty = false;
+}
+
+/* Rebuilds the address index from the cheat list, only enabled cheats are indexed */
+static void update_cheat_index(GB_gameboy_t *gb)
+{
+    free_cheat_index(gb);
+    
+    indexed_cheat_t *enabled = malloc(gb->cheat_count * sizeof(*enabled));
+    size_t n_enabled = 0;
+    for (size_t i = 0; i < gb->cheat_count; i++) {
+        if (gb->cheats[i]->enabled) {
+            enabled[n_enabled++] = (indexed_cheat_t){gb->cheats[i], i};
+        }
+    }
+    
+    if (!n_enabled) {
+        free(enabled);
+        free(gb->cheat_slot_for_addr);
+        gb->cheat_slot_for_addr = NULL;
+        return;
+    }
+    
+    qsort(enabled, n_enabled, sizeof(*enabled), compare_cheats);
+    if (!gb->cheat_slot_for_addr) {
+        gb->cheat_slot_for_addr = malloc(0x10000 * sizeof(*gb->cheat_slot_for_addr));
+    }
+    gb->cheat_entries = malloc(n_enabled * sizeof(*gb->cheat_entries));
+    gb->cheat_slots = malloc(n_enabled * sizeof(*gb->cheat_slots));
+    
+    GB_cheat_slot_t *slot = NULL;
+    unsigned n_slots = 0;
+    for (size_t i = 0; i < n_enabled; i++) {
+        const GB_cheat_t *cheat = enabled[i].cheat;
+        if (!i || cheat->address != enabled[i - 1].cheat->address) {
+            gb->cheat_slot_for_addr[cheat->address] = n_slots;
+            slot = &gb->cheat_slots[n_slots++];
+            slot->first_entry = i;
+            slot->n_entries = 0;
+            slot->banked = false;
+            gb->cheat_bitmap[cheat->address >> 3] |= 1 << (cheat->address & 7);
+        }
+        slot->n_entries++;
+        slot->banked |= cheat->bank != GB_CHEAT_ANY_BANK;
+        gb->cheat_entries[i] = (GB_cheat_entry_t){
+            .bank = cheat->bank,
+            .value = cheat->value,
+            .old_value = cheat->old_value,
+            .use_old_value = cheat->use_old_value,
+        };
+    }
+    
+    free(enabled);
+}
+
+/* Rebuilding the index on every change is quadratic when loading a cheat database, so it is only marked as dirty
+   here. Flagging the new address makes the next read from it rebuild the index; addresses that lost their cheats stay
+   flagged until then, and are cleared by that rebuild. */
+static void invalidate_cheat_index(GB_gameboy_t *gb, const GB_cheat_t *cheat)
+{
+    if (!gb->cheat_count) {
+        free_cheat_index(gb);
+        free(gb->cheat_slot_for_addr);
+        gb->cheat_slot_for_addr = NULL;
+        return;
+    }
+    gb->cheat_index_dirty = true;
+    if (cheat && cheat->enabled) {
+        gb->cheat_bitmap[cheat->address >> 3] |= 1 << (cheat->address & 7);
+    }
+}
+
 bool GB_cheats_enabled(GB_gameboy_t *gb)
 {
     return gb->cheat_enabled;
@@ -82,17 +176,7 @@ const GB_cheat_t *GB_add_cheat(GB_gameboy_t *gb, const char *description, uint16
     gb->cheats = realloc(gb->cheats, (++gb->cheat_count) * sizeof(gb->cheats[0]));
     gb->cheats[gb->cheat_count - 1] = cheat;
     
-    GB_cheat_hash_t **hash = &gb->cheat_hash[hash_addr(address)];
-    if (!*hash) {
-        *hash = malloc(sizeof(GB_cheat_hash_t) + sizeof(cheat));
-        (*hash)->size = 1;
-        (*hash)->cheats[0] = cheat;
-    }
-    else {
-        (*hash)->size++;
-        *hash = realloc(*hash, sizeof(GB_cheat_hash_t) + sizeof(cheat) * (*hash)->size);
-        (*hash)->cheats[(*hash)->size - 1] = cheat;
-    }
+    invalidate_cheat_index(gb, cheat);
     
     return cheat;
 }
@@ -123,22 +207,8 @@ void GB_remove_cheat(GB_gameboy_t *gb, const GB_cheat_t *cheat)
         }
     }
     
-    GB_cheat_hash_t **hash = &gb->cheat_hash[hash_addr(cheat->address)];
-    for (unsigned i = 0; i < (*hash)->size; i++) {
-        if ((*hash)->cheats[i] == cheat) {
-            (*hash)->cheats[i] = (*hash)->cheats[--(*hash)->size];
-            if ((*hash)->size == 0) {
-                free(*hash);
-                *hash = NULL;
-            }
-            else {
-                *hash = realloc(*hash, sizeof(GB_cheat_hash_t) + sizeof(cheat) * (*hash)->size);
-            }
-            break;
-        }
-    }
-    
     free((void *)cheat);
+    invalidate_cheat_index(gb, NULL);
 }
 
 const GB_cheat_t *GB_import_cheat(GB_gameboy_t *gb, const char *cheat, const char *description, bool enabled)
@@ -217,37 +287,7 @@ void GB_update_cheat(GB_gameboy_t *gb, const GB_cheat_t *_cheat, const char *des
     
     assert(cheat);
     
-    if (cheat->address != address) {
-        /* Remove from old bucket */
-        GB_cheat_hash_t **hash = &gb->cheat_hash[hash_addr(cheat->address)];
-        for (unsigned i = 0; i < (*hash)->size; i++) {
-            if ((*hash)->cheats[i] == cheat) {
-                (*hash)->cheats[i] = (*hash)->cheats[--(*hash)->size];
-                if ((*hash)->size == 0) {
-                    free(*hash);
-                    *hash = NULL;
-                }
-                else {
-                    *hash = realloc(*hash, sizeof(GB_cheat_hash_t) + sizeof(cheat) * (*hash)->size);
-                }
-                break;
-            }
-        }
-        cheat->address = address;
-        
-        /* Add to new bucket */
-        hash = &gb->cheat_hash[hash_addr(address)];
-        if (!*hash) {
-            *hash = malloc(sizeof(GB_cheat_hash_t) + sizeof(cheat));
-            (*hash)->size = 1;
-            (*hash)->cheats[0] = cheat;
-        }
-        else {
-            (*hash)->size++;
-            *hash = realloc(*hash, sizeof(GB_cheat_hash_t) + sizeof(cheat) * (*hash)->size);
-            (*hash)->cheats[(*hash)->size - 1] = cheat;
-        }
-    }
+    cheat->address = address;
     cheat->bank = bank;
     cheat->value = value;
     cheat->old_value = old_value;
@@ -257,6 +297,7 @@ void GB_update_cheat(GB_gameboy_t *gb, const GB_cheat_t *_cheat, const char *des
         strncpy(cheat->description, description, sizeof(cheat->description));
         cheat->description[sizeof(cheat->description) - 1] = 0;
     }
+    invalidate_cheat_index(gb, cheat);
 }
 
 #define CHEAT_MAGIC 'SBCh'
@@ -21,9 +21,18 @@ internal void GB_apply_cheat(GB_gameboy_t *gb, uint16_t address, uint8_t *value)
 #endif
 
 typedef struct {
-    size_t size;
-    GB_cheat_t *cheats[];
-} GB_cheat_hash_t;
+    uint16_t bank;
+    uint8_t value;
+    uint8_t old_value;
+    bool use_old_value;
+} GB_cheat_entry_t;
+
+/* All enabled cheats for a single address, as a range in the dense entry table */
+typedef struct {
+    uint32_t first_entry;
+    uint32_t n_entries;
+    bool banked; // At least one of the entries is limited to a specific bank
+} GB_cheat_slot_t;
 
 struct GB_cheat_s {
     uint16_t address;
@@ -2600,7 +2600,7 @@ void GB_debugger_handle_async_commands(GB_gameboy_t *gb)
     }
 }
 
-void GB_debugger_add_symbol(GB_gameboy_t *gb, uint16_t bank, uint16_t address, const char *symbol)
+static GB_symbol_map_t *get_or_create_symbol_map(GB_gameboy_t *gb, uint16_t bank)
 {
     if (bank >= gb->n_symbol_maps) {
         gb->bank_symbols = realloc(gb->bank_symbols, (bank + 1) * sizeof(*gb->bank_symbols));
@@ -2612,12 +2612,34 @@ void GB_debugger_add_symbol(GB_gameboy_t *gb, uint16_t bank, uint16_t address, c
     if (!gb->bank_symbols[bank]) {
         gb->bank_symbols[bank] = GB_map_alloc();
     }
-    GB_bank_symbol_t *allocated_symbol = GB_map_add_symbol(gb->bank_symbols[bank], address, symbol);
+    return gb->bank_symbols[bank];
+}
+
+void GB_debugger_add_symbol(GB_gameboy_t *gb, uint16_t bank, uint16_t address, const char *symbol)
+{
+    char *name = GB_arena_strdup(&gb->symbol_arena, symbol);
+    GB_bank_symbol_t *allocated_symbol = GB_map_add_symbol(get_or_create_symbol_map(gb, bank), address, name);
     if (allocated_symbol) {
-        GB_reversed_map_add_symbol(&gb->reversed_symbol_map, bank, allocated_symbol);
+        GB_reversed_map_add_symbol(&gb->reversed_symbol_map, &gb->symbol_arena, bank, allocated_symbol);
     }
 }
 
+typedef struct {
+    GB_bank_symbol_t symbol;
+    uint16_t bank;
+    size_t index;
+} pending_symbol_t;
+
+static int compare_pending_symbols(const void *a_ptr, const void *b_ptr)
+{
+    const pending_symbol_t *a = a_ptr, *b = b_ptr;
+    if (a->bank != b->bank) return a->bank < b->bank? -1 : 1;
+    int ret = GB_map_compare_symbols(&a->symbol, &b->symbol);
+    if (ret) return ret;
+    /* Later definitions take precedence, like when adding them one by one */
+    return a->index > b->index? -1 : 1;
+}
+
 void GB_debugger_load_symbol_file(GB_gameboy_t *gb, const char *path)
 {
     FILE *f = fopen(path, "r");
@@ -2626,6 +2648,9 @@ void GB_debugger_load_symbol_file(GB_gameboy_t *gb, const char *path)
     char *line = NULL;
     size_t size = 0;
     size_t length = 0;
+    pending_symbol_t *pending = NULL;
+    size_t n_pending = 0;
+    size_t pending_size = 0;
     while ((length = getline(&line, &size, f)) != -1) {
         for (unsigned i = 0; i < length; i++) {
             if (line[i] == ';' || line[i] == '\n' || line[i] == '\r') {
@@ -2640,11 +2665,36 @@ void GB_debugger_load_symbol_file(GB_gameboy_t *gb, const char *path)
         char symbol[length];
 
         if (sscanf(line, "%x:%x %s", &bank, &address, symbol) == 3) {
-            GB_debugger_add_symbol(gb, bank, address, symbol);
+            if (n_pending == pending_size) {
+                pending_size = pending_size? pending_size * 2 : 0x400;
+                pending = realloc(pending, pending_size * sizeof(*pending));
+            }
+            pending_symbol_t *entry = &pending[n_pending];
+            entry->symbol.name = GB_arena_strdup(&gb->symbol_arena, symbol);
+            entry->symbol.addr = address;
+            entry->symbol.is_local = strchr(symbol, '.');
+            entry->bank = bank;
+            entry->index = n_pending++;
+            /* The reversed map is order sensitive, so it's populated in file order */
+            GB_reversed_map_add_symbol(&gb->reversed_symbol_map, &gb->symbol_arena, bank, &entry->symbol);
         }
     }
     free(line);
     fclose(f);
+
+    /* Sort once, then merge each bank's run into its map */
+    qsort(pending, n_pending, sizeof(*pending), compare_pending_symbols);
+    GB_bank_symbol_t *run = malloc(n_pending * sizeof(*run));
+    for (size_t i = 0; i < n_pending;) {
+        uint16_t bank = pending[i].bank;
+        size_t count = 0;
+        while (i < n_pending && pending[i].bank == bank) {
+            run[count++] = pending[i++].symbol;
+        }
+        GB_map_add_symbols(get_or_create_symbol_map(gb, bank), run, count);
+    }
+    free(run);
+    free(pending);
 }
 
 void GB_debugger_clear_symbols(GB_gameboy_t *gb)
@@ -2655,13 +2705,8 @@ void GB_debugger_clear_symbols(GB_gameboy_t *gb)
             gb->bank_symbols[i] = 0;
         }
     }
-    for (unsigned i = sizeof(gb->reversed_symbol_map.buckets) / sizeof(gb->reversed_symbol_map.buckets[0]); i--;) {
-        while (gb->reversed_symbol_map.buckets[i]) {
-            GB_symbol_t *next = gb->reversed_symbol_map.buckets[i]->next;
-            free(gb->reversed_symbol_map.buckets[i]);
-            gb->reversed_symbol_map.buckets[i] = next;
-        }
-    }
+    GB_reversed_map_clear(&gb->reversed_symbol_map);
+    GB_arena_reset(&gb->symbol_arena);
     gb->n_symbol_maps = 0;
     if (gb->bank_symbols) {
         free(gb->bank_symbols);
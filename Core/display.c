@@ -110,11 +110,20 @@ void GB_display_vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
 {
     gb->vblank_just_occured = true;
     gb->cycles_since_vblank_callback = 0;
+    if (gb->vram_directly_accessed) {
+        GB_invalidate_tile_rows(gb);
+    }
     gb->lcd_disabled_outside_of_vblank = false;
     
     /* TODO: Slow in turbo mode! */
     if (GB_is_hle_sgb(gb)) {
         GB_sgb_render(gb);
+        if (gb->indexed_screen && !gb->disable_rendering) {
+            memcpy(gb->indexed_screen, gb->sgb->screen_buffer, WIDTH * LINES);
+            if (gb->indexed_attributes) {
+                memset(gb->indexed_attributes, 0, WIDTH * LINES);
+            }
+        }
     }
     
     if (gb->turbo) {
@@ -137,7 +146,13 @@ void GB_display_vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
     
     if (!gb->disable_rendering && ((!(gb->io_registers[GB_IO_LCDC] & GB_LCDC_ENABLE) || is_ppu_stopped) || gb->frame_skip_state == GB_FRAMESKIP_LCD_TURNED_ON)) {
         /* LCD is off, set screen to white or black (if LCD is on in stop mode) */
-        if (!GB_is_sgb(gb)) {
+        if (!GB_is_sgb(gb) && gb->indexed_screen) {
+            memset(gb->indexed_screen, GB_INDEXED_LCD_OFF, WIDTH * LINES);
+            if (gb->indexed_attributes) {
+                memset(gb->indexed_attributes, 0, WIDTH * LINES);
+            }
+        }
+        if (!GB_is_sgb(gb) && gb->screen) {
             uint32_t color = 0;
             if (GB_is_cgb(gb)) {
                 color = GB_convert_rgb15(gb, 0x7FFF, false);
@@ -162,7 +177,7 @@ void GB_display_vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
         }
     }
     
-    if (!gb->disable_rendering && gb->border_mode == GB_BORDER_ALWAYS && !GB_is_sgb(gb)) {
+    if (!gb->disable_rendering && gb->screen && gb->border_mode == GB_BORDER_ALWAYS && !GB_is_sgb(gb)) {
         GB_borrow_sgb_border(gb);
         uint32_t border_colors[16 * 4];
         
@@ -267,7 +282,7 @@ static inline uint8_t scale_channel_with_curve_sgb(uint8_t x)
 }
 
 
-uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
+static uint32_t convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
 {
     uint8_t r = (color) & 0x1F;
     uint8_t g = (color >> 5) & 0x1F;
@@ -389,6 +404,34 @@ uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
     return gb->rgb_encode_callback(gb, r, g, b);
 }
 
+uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border)
+{
+    color &= 0x7FFF;
+    GB_rgb15_cache_t *cache = &gb->rgb15_cache[for_border];
+    if (unlikely(cache->callback != gb->rgb_encode_callback ||
+                 cache->mode != gb->color_correction_mode ||
+                 cache->temperature != gb->light_temperature ||
+                 cache->model != gb->model ||
+                 cache->has_sgb_border != gb->has_sgb_border)) {
+        if (!cache->colors) {
+            cache->colors = malloc(0x8000 * sizeof(cache->colors[0]) + 0x8000 / 8);
+        }
+        memset(cache->colors + 0x8000, 0, 0x8000 / 8);
+        cache->callback = gb->rgb_encode_callback;
+        cache->mode = gb->color_correction_mode;
+        cache->temperature = gb->light_temperature;
+        cache->model = gb->model;
+        cache->has_sgb_border = gb->has_sgb_border;
+    }
+    
+    uint8_t *converted = (uint8_t *)(cache->colors + 0x8000);
+    if (unlikely(!(converted[color >> 3] & (1 << (color & 7))))) {
+        cache->colors[color] = convert_rgb15(gb, color, for_border);
+        converted[color >> 3] |= 1 << (color & 7);
+    }
+    return cache->colors[color];
+}
+
 void GB_palette_changed(GB_gameboy_t *gb, bool background_palette, uint8_t index)
 {
     if (!gb->rgb_encode_callback || !GB_is_cgb(gb)) return;
@@ -645,7 +688,11 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
 
     uint8_t icd_pixel = 0;
     uint32_t *dest = NULL;
-    if (!gb->sgb) {
+    uint8_t *index_dest = NULL;
+    if (!gb->sgb && gb->indexed_screen && gb->current_line < LINES) {
+        index_dest = gb->indexed_screen + gb->lcd_x + gb->current_line * WIDTH;
+    }
+    if (!gb->sgb && gb->screen) {
         if (gb->border_mode != GB_BORDER_ALWAYS) {
             dest = gb->screen + gb->lcd_x + gb->current_line * WIDTH;
         }
@@ -672,11 +719,17 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
                 icd_pixel = pixel;
             }
         }
-        else if (gb->cgb_palettes_ppu_blocked) {
-            *dest = gb->rgb_encode_callback(gb, 0, 0, 0);
-        }
         else {
-            *dest = gb->background_palettes_rgb[fifo_item->palette * 4 + pixel];
+            if (index_dest) {
+                *index_dest = fifo_item->palette * 4 + pixel;
+                if (gb->indexed_attributes) {
+                    gb->indexed_attributes[index_dest - gb->indexed_screen] = fifo_item->bg_priority? GB_INDEXED_PRIORITY : 0;
+                }
+            }
+            if (dest) {
+                *dest = gb->cgb_palettes_ppu_blocked? gb->rgb_encode_callback(gb, 0, 0, 0) :
+                                                      gb->background_palettes_rgb[fifo_item->palette * 4 + pixel];
+            }
         }
     }
     
@@ -696,11 +749,18 @@ static void render_pixel_if_possible(GB_gameboy_t *gb)
                 icd_pixel = pixel;
             }
         }
-        else if (gb->cgb_palettes_ppu_blocked) {
-            *dest = gb->rgb_encode_callback(gb, 0, 0, 0);
-        }
         else {
-            *dest = gb->object_palettes_rgb[oam_fifo_item->palette * 4 + pixel];
+            if (index_dest) {
+                *index_dest = GB_INDEXED_OBJECT | (oam_fifo_item->palette * 4 + pixel);
+                if (gb->indexed_attributes) {
+                    gb->indexed_attributes[index_dest - gb->indexed_screen] = (oam_fifo_item->bg_priority? GB_INDEXED_PRIORITY : 0) |
+                                                                              oam_fifo_item->priority;
+                }
+            }
+            if (dest) {
+                *dest = gb->cgb_palettes_ppu_blocked? gb->rgb_encode_callback(gb, 0, 0, 0) :
+                                                      gb->object_palettes_rgb[oam_fifo_item->palette * 4 + pixel];
+            }
         }
     }
     
@@ -1047,7 +1107,59 @@ static inline uint8_t flip(uint8_t x)
     return x;
 }
 
-static inline void get_tile_data(const GB_gameboy_t *gb, uint8_t tile_x, uint8_t y, uint16_t map, uint8_t *attributes, uint8_t *data0, uint8_t *data1)
+/* Spreads the bits of a byte to the even bits of a word */
+static inline uint16_t spread_bits(uint8_t x)
+{
+    uint16_t ret = x;
+    ret = (ret | ret << 4) & 0x0F0F;
+    ret = (ret | ret << 2) & 0x3333;
+    ret = (ret | ret << 1) & 0x5555;
+    return ret;
+}
+
+static inline unsigned decoded_tile_row_index(uint16_t addr)
+{
+    return ((addr & 0x2000)? 0xC00 : 0) + ((addr & 0x1FFF) >> 1);
+}
+
+/* Returns the 8 pixels of the tile row at addr interleaved into a word, with the leftmost pixel in the top 2 bits */
+static inline uint16_t decode_tile_row(GB_gameboy_t *gb, uint16_t addr, bool flip_x)
+{
+    uint8_t data0 = gb->vram[addr];
+    uint8_t data1 = gb->vram[addr + 1];
+    if (flip_x) {
+        data0 = flip(data0);
+        data1 = flip(data1);
+    }
+    return spread_bits(data0) | spread_bits(data1) << 1;
+}
+
+/* Same as decode_tile_row (addr must be below 0x1800 in its bank), but decoded rows are cached until the VRAM they
+   were decoded from is written. Only the emulation thread may use the cache. */
+static inline uint16_t get_decoded_tile_row(GB_gameboy_t *gb, uint16_t addr, bool flip_x)
+{
+    unsigned row = decoded_tile_row_index(addr);
+    if (unlikely(!(gb->decoded_tile_rows_valid[row / 8] & (1 << (row & 7))))) {
+        gb->decoded_tile_rows[row][0] = decode_tile_row(gb, addr, false);
+        gb->decoded_tile_rows[row][1] = decode_tile_row(gb, addr, true);
+        gb->decoded_tile_rows_valid[row / 8] |= 1 << (row & 7);
+    }
+    return gb->decoded_tile_rows[row][flip_x];
+}
+
+void GB_invalidate_tile_row(GB_gameboy_t *gb, uint16_t addr)
+{
+    if ((addr & 0x1FFF) >= 0x1800) return;
+    unsigned row = decoded_tile_row_index(addr);
+    gb->decoded_tile_rows_valid[row / 8] &= ~(1 << (row & 7));
+}
+
+void GB_invalidate_tile_rows(GB_gameboy_t *gb)
+{
+    memset(gb->decoded_tile_rows_valid, 0, sizeof(gb->decoded_tile_rows_valid));
+}
+
+static inline uint16_t get_tile_row_address(const GB_gameboy_t *gb, uint8_t tile_x, uint8_t y, uint16_t map, uint8_t *attributes)
 {
     uint8_t current_tile = gb->vram[map + (tile_x & 0x1F) + y / 8 * 32];
     *attributes = GB_is_cgb(gb)? gb->vram[0x2000 + map + (tile_x & 0x1F) + y / 8 * 32] : 0;
@@ -1068,8 +1180,20 @@ static inline void get_tile_data(const GB_gameboy_t *gb, uint8_t tile_x, uint8_t
         y_flip = 0x7;
     }
     
-    *data0 = gb->vram[tile_address +  ((y & 7) ^ y_flip) * 2];
-    *data1 = gb->vram[tile_address +  ((y & 7) ^ y_flip) * 2 + 1];
+    return tile_address + ((y & 7) ^ y_flip) * 2;
+}
+
+static inline uint16_t get_tile_row(GB_gameboy_t *gb, uint8_t tile_x, uint8_t y, uint16_t map, uint8_t *attributes)
+{
+    uint16_t address = get_tile_row_address(gb, tile_x, y, map, attributes);
+    return get_decoded_tile_row(gb, address, *attributes & 0x20);
+}
+
+static inline void get_tile_data(const GB_gameboy_t *gb, uint8_t tile_x, uint8_t y, uint16_t map, uint8_t *attributes, uint8_t *data0, uint8_t *data1)
+{
+    uint16_t address = get_tile_row_address(gb, tile_x, y, map, attributes);
+    *data0 = gb->vram[address];
+    *data1 = gb->vram[address + 1];
     
     if (*attributes & 0x20) {
         *data0 = flip(*data0);
@@ -1081,7 +1205,7 @@ static inline void get_tile_data(const GB_gameboy_t *gb, uint8_t tile_x, uint8_t
 static void render_line(GB_gameboy_t *gb)
 {
     if (gb->disable_rendering) return;
-    if (!gb->screen) return;
+    if (!gb->screen && !gb->indexed_screen) return;
     if (gb->current_line > 144) return; // Corrupt save state
     
     struct {
@@ -1105,24 +1229,18 @@ static void render_line(GB_gameboy_t *gb)
             gb->n_visible_objs--;
             
             uint16_t line_address = get_object_line_address(gb, object->y, object->tile, object->flags);
-            uint8_t data0 = gb->vram[line_address];
-            uint8_t data1 = gb->vram[line_address + 1];
             if (gb->n_visible_objs == 0) {
-                gb->data_for_sel_glitch = data1;
-            }
-            if (object->flags & 0x20) {
-                data0 = flip(data0);
-                data1 = flip(data1);
+                gb->data_for_sel_glitch = gb->vram[line_address + 1];
             }
+            uint16_t row = get_decoded_tile_row(gb, line_address, object->flags & 0x20);
 
             typeof(_object_buffer[0]) *p = _object_buffer + object->x;
             if (object->x >= 168) {
                 continue;
             }
             unrolled for (unsigned x = 0; x < 8; x++) {
-                unsigned pixel = (data0 >> 7) | ((data1 >> 7) << 1);
-                data0 <<= 1;
-                data1 <<= 1;
+                unsigned pixel = row >> 14;
+                row <<= 2;
                 if (pixel && (!p->pixel || priority < p->priority)) {
                     p->pixel = pixel;
                     p->priority = priority;
@@ -1146,26 +1264,45 @@ static void render_line(GB_gameboy_t *gb)
     
     uint32_t *restrict p = gb->screen;
     typeof(object_buffer[0]) *object_buffer_pointer = object_buffer + 8;
-    if (gb->border_mode == GB_BORDER_ALWAYS) {
+    if (p && gb->border_mode == GB_BORDER_ALWAYS) {
         p += (BORDERED_WIDTH - (WIDTH)) / 2 + BORDERED_WIDTH * (BORDERED_HEIGHT - LINES) / 2;
         p += BORDERED_WIDTH * gb->current_line;
     }
-    else {
+    else if (p) {
         p += WIDTH * gb->current_line;
     }
+    uint8_t *restrict index_p = NULL;
+    uint8_t *restrict attribute_p = NULL;
+    if (gb->indexed_screen && gb->current_line < LINES) {
+        index_p = gb->indexed_screen + WIDTH * gb->current_line;
+        if (gb->indexed_attributes) {
+            attribute_p = gb->indexed_attributes + WIDTH * gb->current_line;
+        }
+    }
+    
+#define OUTPUT_PIXEL(rgb_palettes, index, attribute) \
+if (p) *(p++) = (rgb_palettes)[(index) & 0x1F];\
+if (index_p) {\
+    *(index_p++) = (index);\
+    if (attribute_p) *(attribute_p++) = (attribute);\
+}\
+    
+#define OUTPUT_OBJECT_PIXEL(pixel) \
+OUTPUT_PIXEL(gb->object_palettes_rgb, GB_INDEXED_OBJECT | ((pixel) + (object_buffer_pointer->palette & 7) * 4),\
+             (object_buffer_pointer->bg_priority? GB_INDEXED_PRIORITY : 0) | object_buffer_pointer->priority)
     
     if (unlikely(gb->background_disabled) || (!gb->cgb_mode && !(gb->io_registers[GB_IO_LCDC] & GB_LCDC_BG_EN))) {
-        uint32_t bg = gb->background_palettes_rgb[gb->cgb_mode? 0 : (gb->io_registers[GB_IO_BGP] & 3)];
+        uint8_t bg = gb->cgb_mode? 0 : (gb->io_registers[GB_IO_BGP] & 3);
         for (unsigned i = 160; i--;) {
             if (unlikely(object_buffer_pointer->pixel)) {
                 uint8_t pixel = object_buffer_pointer->pixel;
                 if (!gb->cgb_mode) {
                     pixel = ((gb->io_registers[GB_IO_OBP0 + object_buffer_pointer->palette] >> (pixel << 1)) & 3);
                 }
-                *(p++) = gb->object_palettes_rgb[pixel + (object_buffer_pointer->palette & 7) * 4];
+                OUTPUT_OBJECT_PIXEL(pixel);
             }
             else {
-                *(p++) = bg;
+                OUTPUT_PIXEL(gb->background_palettes_rgb, bg, 0);
             }
             object_buffer_pointer++;
         }
@@ -1181,33 +1318,30 @@ static void render_line(GB_gameboy_t *gb)
     }
     uint8_t y = gb->current_line + gb->io_registers[GB_IO_SCY];
     uint8_t attributes;
-    uint8_t data0, data1;
-    get_tile_data(gb, tile_x, y, map, &attributes, &data0, &data1);
+    uint16_t row = get_tile_row(gb, tile_x, y, map, &attributes);
     
 #define DO_PIXEL() \
-uint8_t pixel = (data0 >> 7) | ((data1 >> 7) << 1);\
-data0 <<= 1;\
-data1 <<= 1;\
+uint8_t pixel = row >> 14;\
+row <<= 2;\
 \
 if (unlikely(object_buffer_pointer->pixel) && (pixel == 0 || !(object_buffer_pointer->bg_priority || (attributes & 0x80)) || !(gb->io_registers[GB_IO_LCDC] & GB_LCDC_BG_EN))) {\
     pixel = object_buffer_pointer->pixel;\
     if (!gb->cgb_mode) {\
         pixel = ((gb->io_registers[GB_IO_OBP0 + object_buffer_pointer->palette] >> (pixel << 1)) & 3);\
     }\
-    *(p++) = gb->object_palettes_rgb[pixel + (object_buffer_pointer->palette & 7) * 4];\
+    OUTPUT_OBJECT_PIXEL(pixel);\
 }\
 else {\
     if (!gb->cgb_mode) {\
         pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);\
     }\
-    *(p++) = gb->background_palettes_rgb[pixel + (attributes & 7) * 4];\
+    OUTPUT_PIXEL(gb->background_palettes_rgb, pixel + (attributes & 7) * 4, attributes & 0x80);\
 }\
 pixels++;\
 object_buffer_pointer++\
     
     // First 1-8 pixels
-    data0 <<= fractional_scroll;
-    data1 <<= fractional_scroll;
+    row <<= fractional_scroll * 2;
     bool check_window = gb->wy_triggered && (gb->io_registers[GB_IO_LCDC] & GB_LCDC_WIN_ENABLE);
     nounroll for (unsigned i = fractional_scroll; i < 8; i++) {
         if (check_window && gb->io_registers[GB_IO_WX] == pixels + 7) {
@@ -1223,7 +1357,7 @@ activate_window:
     tile_x++;
     
     while (pixels < 160 - 8) {
-        get_tile_data(gb, tile_x, y, map, &attributes, &data0, &data1);
+        row = get_tile_row(gb, tile_x, y, map, &attributes);
         nounroll for (unsigned i = 0; i < 8; i++) {
             if (check_window && gb->io_registers[GB_IO_WX] == pixels + 7) {
                 goto activate_window;
@@ -1234,7 +1368,7 @@ activate_window:
     }
     
     gb->fetcher_state = (160 - pixels) & 7;
-    get_tile_data(gb, tile_x, y, map, &attributes, &data0, &data1);
+    row = get_tile_row(gb, tile_x, y, map, &attributes);
     while (pixels < 160) {
         if (check_window && gb->io_registers[GB_IO_WX] == pixels + 7) {
             goto activate_window;
@@ -1245,6 +1379,8 @@ activate_window:
 
     get_tile_data(gb, tile_x, y, map, &attributes, gb->current_tile_data, gb->current_tile_data + 1);
 #undef DO_PIXEL
+#undef OUTPUT_OBJECT_PIXEL
+#undef OUTPUT_PIXEL
 }
 
 static void render_line_sgb(GB_gameboy_t *gb)
@@ -1269,21 +1405,15 @@ static void render_line_sgb(GB_gameboy_t *gb)
             gb->n_visible_objs--;
             
             uint16_t line_address = get_object_line_address(gb, object->y, object->tile, object->flags);
-            uint8_t data0 = gb->vram[line_address];
-            uint8_t data1 = gb->vram[line_address + 1];
-            if (object->flags & 0x20) {
-                data0 = flip(data0);
-                data1 = flip(data1);
-            }
+            uint16_t row = get_decoded_tile_row(gb, line_address, object->flags & 0x20);
             
             typeof(_object_buffer[0]) *p = _object_buffer + object->x;
             if (object->x >= 168) {
                 continue;
             }
             unrolled for (unsigned x = 0; x < 8; x++) {
-                unsigned pixel = (data0 >> 7) | ((data1 >> 7) << 1);
-                data0 <<= 1;
-                data1 <<= 1;
+                unsigned pixel = row >> 14;
+                row <<= 2;
                 if (!p->pixel) {
                     p->pixel = pixel;
                     p->palette = (object->flags & 0x10) >> 4;
@@ -1326,13 +1456,11 @@ static void render_line_sgb(GB_gameboy_t *gb)
     }
     uint8_t y = gb->current_line + gb->io_registers[GB_IO_SCY];
     uint8_t attributes;
-    uint8_t data0, data1;
-    get_tile_data(gb, tile_x, y, map, &attributes, &data0, &data1);
+    uint16_t row = get_tile_row(gb, tile_x, y, map, &attributes);
     
 #define DO_PIXEL() \
-uint8_t pixel = (data0 >> 7) | ((data1 >> 7) << 1);\
-data0 <<= 1;\
-data1 <<= 1;\
+uint8_t pixel = row >> 14;\
+row <<= 2;\
 \
 if (unlikely(object_buffer_pointer->pixel) && (pixel == 0 || !object_buffer_pointer->bg_priority || !(gb->io_registers[GB_IO_LCDC] & GB_LCDC_BG_EN))) {\
     pixel = object_buffer_pointer->pixel;\
@@ -1347,8 +1475,7 @@ pixels++;\
 object_buffer_pointer++\
 
     // First 1-8 pixels
-    data0 <<= fractional_scroll;
-    data1 <<= fractional_scroll;
+    row <<= fractional_scroll * 2;
     bool check_window = gb->wy_triggered && (gb->io_registers[GB_IO_LCDC] & GB_LCDC_WIN_ENABLE);
     nounroll for (unsigned i = fractional_scroll; i < 8; i++) {
         if (check_window && gb->io_registers[GB_IO_WX] == pixels + 7) {
@@ -1364,7 +1491,7 @@ object_buffer_pointer++\
     tile_x++;
     
     while (pixels < 160 - 8) {
-        get_tile_data(gb, tile_x, y, map, &attributes, &data0, &data1);
+        row = get_tile_row(gb, tile_x, y, map, &attributes);
         nounroll for (unsigned i = 0; i < 8; i++) {
             if (check_window && gb->io_registers[GB_IO_WX] == pixels + 7) {
                 goto activate_window;
@@ -1374,7 +1501,7 @@ object_buffer_pointer++\
         tile_x++;
     }
     
-    get_tile_data(gb, tile_x, y, map, &attributes, &data0, &data1);
+    row = get_tile_row(gb, tile_x, y, map, &attributes);
     while (pixels < 160) {
         if (check_window && gb->io_registers[GB_IO_WX] == pixels + 7) {
             goto activate_window;
@@ -1386,6 +1513,7 @@ object_buffer_pointer++\
 static inline uint16_t mode3_batching_length(GB_gameboy_t *gb)
 {
     if (gb->position_in_line != (uint8_t)-16) return 0;
+    if (unlikely(gb->debug_flags & GB_DEBUG_NO_MODE3_BATCHING)) return 0;
     if (gb->model & GB_MODEL_NO_SFC_BIT) return 0;
     if (gb->hdma_on) return 0;
     if (gb->stopped) return 0;
@@ -1416,8 +1544,43 @@ static inline uint16_t mode3_batching_length(GB_gameboy_t *gb)
     // No STAT interrupt requested
     if (!(gb->interrupt_enable & 2)) return 300;
     
+    /* The HBlank interrupt is observable, so calculate the exact length. The window restarts the fetcher (6 cycles),
+       and every object fetch takes 6 cycles, plus a wait for the background fetcher if it's the first object within
+       a background (or window) tile. */
+    uint16_t length = 167 + (gb->io_registers[GB_IO_SCX] & 7);
+    uint8_t wx = gb->io_registers[GB_IO_WX];
+    bool window = gb->wy_triggered && (gb->io_registers[GB_IO_LCDC] & GB_LCDC_WIN_ENABLE) && wx < 166;
+    if (window) {
+        length += 6;
+    }
+    
+    if (!(gb->io_registers[GB_IO_LCDC] & GB_LCDC_OBJ_EN) && !GB_is_cgb(gb)) return length;
+    
+    signed last_tile = -1;
+    // Objects are reverse sorted by X
+    for (unsigned i = gb->n_visible_objs; i--;) {
+        uint8_t x = gb->objects_x[i];
+        if (x >= 168) break;
+        
+        signed tile;
+        uint8_t fine_x;
+        if (window && x > wx) {
+            tile = 0x100 + (x - wx - 1) / 8;
+            fine_x = (x - wx - 1) & 7;
+        }
+        else {
+            tile = (x + (gb->io_registers[GB_IO_SCX] & 7)) / 8;
+            fine_x = (x + gb->io_registers[GB_IO_SCX]) & 7;
+        }
+        
+        length += 6;
+        if (tile != last_tile) {
+            last_tile = tile;
+            length += x == 0? 5 : fine_x < 5? 5 - fine_x : 0;
+        }
+    }
     
-    return 0;
+    return length;
 }
 
 static inline uint8_t x_for_object_match(GB_gameboy_t *gb)
@@ -1633,18 +1796,27 @@ void GB_display_run(GB_gameboy_t *gb, unsigned cycles, bool force)
         // TODO: Timing of things in this scenario is almost completely untested
         if (gb->current_line < LINES && !GB_is_sgb(gb) && !gb->disable_rendering) {
             GB_log(gb, "The ROM is preventing line %d from fully rendering, this could damage a real device's LCD display.\n", gb->current_line);
-            uint32_t *dest = NULL;
-            if (gb->border_mode != GB_BORDER_ALWAYS) {
-                dest = gb->screen + gb->lcd_x + gb->current_line * WIDTH;
-            }
-            else {
-                dest = gb->screen + gb->lcd_x + gb->current_line * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH;
+            if (gb->indexed_screen) {
+                memset(gb->indexed_screen + gb->lcd_x + gb->current_line * WIDTH, GB_INDEXED_LCD_OFF, 160 - gb->lcd_x);
+                if (gb->indexed_attributes) {
+                    memset(gb->indexed_attributes + gb->lcd_x + gb->current_line * WIDTH, 0, 160 - gb->lcd_x);
+                }
             }
-            uint32_t color = GB_is_cgb(gb)? GB_convert_rgb15(gb, 0x7FFF, false) : gb->background_palettes_rgb[4];
-            while (gb->lcd_x < 160) {
-                *(dest++) = color;
-                gb->lcd_x++;
+            if (gb->screen) {
+                uint32_t *dest = NULL;
+                if (gb->border_mode != GB_BORDER_ALWAYS) {
+                    dest = gb->screen + gb->lcd_x + gb->current_line * WIDTH;
+                }
+                else {
+                    dest = gb->screen + gb->lcd_x + gb->current_line * BORDERED_WIDTH + (BORDERED_WIDTH - WIDTH) / 2 + (BORDERED_HEIGHT - LINES) / 2 * BORDERED_WIDTH;
+                }
+                uint32_t color = GB_is_cgb(gb)? GB_convert_rgb15(gb, 0x7FFF, false) : gb->background_palettes_rgb[4];
+                while (gb->lcd_x < 160) {
+                    *(dest++) = color;
+                    gb->lcd_x++;
+                }
             }
+            gb->lcd_x = 160;
         }
         gb->n_visible_objs = gb->orig_n_visible_objs;
         gb->current_line++;
@@ -1772,6 +1944,7 @@ void GB_display_run(GB_gameboy_t *gb, unsigned cycles, bool force)
                 GB_BATCHPOINT(gb, display, 3, gb->mode3_batching_length);
                 if (GB_BATCHED_CYCLES(gb, display) >= gb->mode3_batching_length) {
                     // Successfully batched!
+                    GB_PERF_COUNT(gb, mode3_batched, 1);
                     gb->lcd_x = gb->position_in_line = 160;
                     gb->cycles_for_line += gb->mode3_batching_length;
                     if (gb->sgb) {
@@ -1784,6 +1957,7 @@ void GB_display_run(GB_gameboy_t *gb, unsigned cycles, bool force)
                     goto skip_slow_mode_3;
                 }
             }
+            GB_PERF_COUNT(gb, mode3_unbatched, 1);
             while (true) {
                 /* Handle window */
                 /* TODO: It appears that WX checks if the window begins *next* pixel, not *this* pixel. For this reason,
@@ -1971,6 +2145,16 @@ skip_slow_mode_3:
                 gb->data_for_sel_glitch = gb->current_tile_data[1];
             }
             */
+            if (gb->lcd_x != 160 && !gb->disable_rendering && gb->indexed_screen && !gb->sgb && gb->current_line < LINES) {
+                /* The PPU and LCD desynced, the RGB output is handled below */
+                for (unsigned x = gb->lcd_x; x < 160; x++) {
+                    unsigned offset = x + gb->current_line * WIDTH;
+                    gb->indexed_screen[offset] = x? gb->indexed_screen[offset - 1] : 0;
+                    if (gb->indexed_attributes) {
+                        gb->indexed_attributes[offset] = x? gb->indexed_attributes[offset - 1] : 0;
+                    }
+                }
+            }
             while (gb->lcd_x != 160 && !gb->disable_rendering && gb->screen && !gb->sgb) {
                 /* Oh no! The PPU and LCD desynced! Fill the rest of the line with the last color. */
                 uint32_t *dest = NULL;
@@ -2185,29 +2369,35 @@ void GB_draw_tileset(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
     }
     
     for (unsigned y = 0; y < 192; y++) {
-        for (unsigned x = 0; x < 256; x++) {
+        for (unsigned x = 0; x < 256; x += 8) {
             if (x >= 128 && !GB_is_cgb(gb)) {
-                *(dest++) = gb->background_palettes_rgb[0];
+                for (unsigned i = 8; i--;) {
+                    *(dest++) = gb->background_palettes_rgb[0];
+                }
                 continue;
             }
             uint16_t tile = (x % 128) / 8 + y / 8 * 16;
             uint16_t tile_address = tile * 0x10 + (x >= 128? 0x2000 : 0);
-            uint8_t pixel = (((gb->vram[tile_address + (y & 7) * 2    ] >> ((~x)&7)) & 1 ) |
-                             ((gb->vram[tile_address + (y & 7) * 2 + 1] >> ((~x)&7)) & 1) << 1);
+            /* Debugger views may run on another thread, so they must not touch the decoded tile cache */
+            uint16_t row = decode_tile_row(gb, tile_address + (y & 7) * 2, false);
             
-            if (!gb->cgb_mode) {
-                if (palette_type == GB_PALETTE_BACKGROUND) {
-                    pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);
-                }
-                else if (!gb->cgb_mode) {
-                    if (palette_type == GB_PALETTE_OAM) {
-                        pixel = ((gb->io_registers[palette_index == 0? GB_IO_OBP0 : GB_IO_OBP1] >> (pixel << 1)) & 3);
+            for (unsigned i = 8; i--;) {
+                uint8_t pixel = row >> 14;
+                row <<= 2;
+                
+                if (!gb->cgb_mode) {
+                    if (palette_type == GB_PALETTE_BACKGROUND) {
+                        pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);
+                    }
+                    else if (!gb->cgb_mode) {
+                        if (palette_type == GB_PALETTE_OAM) {
+                            pixel = ((gb->io_registers[palette_index == 0? GB_IO_OBP0 : GB_IO_OBP1] >> (pixel << 1)) & 3);
+                        }
                     }
                 }
+                
+                *(dest++) = palette[pixel];
             }
-            
-            
-            *(dest++) = palette[pixel];
         }
     }
 }
@@ -2245,7 +2435,7 @@ void GB_draw_tilemap(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
     }
     
     for (unsigned y = 0; y < 256; y++) {
-        for (unsigned x = 0; x < 256; x++) {
+        for (unsigned x = 0; x < 256; x += 8) {
             uint8_t tile = gb->vram[map + x/8 + y/8 * 32];
             uint16_t tile_address;
             uint8_t attributes = 0;
@@ -2265,18 +2455,22 @@ void GB_draw_tilemap(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
                 tile_address += 0x2000;
             }
             
-            uint8_t pixel = (((gb->vram[tile_address + (((attributes & 0x40)? ~y : y) & 7) * 2    ] >> (((attributes & 0x20)? x : ~x)&7)) & 1 ) |
-                             ((gb->vram[tile_address + (((attributes & 0x40)? ~y : y) & 7) * 2 + 1] >> (((attributes & 0x20)? x : ~x)&7)) & 1) << 1);
-            
-            if (!gb->cgb_mode && (palette_type == GB_PALETTE_BACKGROUND || palette_type == GB_PALETTE_AUTO)) {
-                pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);
-            }
+            uint16_t row = decode_tile_row(gb, tile_address + (((attributes & 0x40)? ~y : y) & 7) * 2, attributes & 0x20);
             
-            if (palette) {
-                *(dest++) = palette[pixel];
-            }
-            else {
-                *(dest++) = gb->background_palettes_rgb[(attributes & 7) * 4 + pixel];
+            for (unsigned i = 8; i--;) {
+                uint8_t pixel = row >> 14;
+                row <<= 2;
+                
+                if (!gb->cgb_mode && (palette_type == GB_PALETTE_BACKGROUND || palette_type == GB_PALETTE_AUTO)) {
+                    pixel = ((gb->io_registers[GB_IO_BGP] >> (pixel << 1)) & 3);
+                }
+                
+                if (palette) {
+                    *(dest++) = palette[pixel];
+                }
+                else {
+                    *(dest++) = gb->background_palettes_rgb[(attributes & 7) * 4 + pixel];
+                }
             }
         }
     }
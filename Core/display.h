@@ -18,7 +18,9 @@ internal void GB_STAT_update(GB_gameboy_t *gb);
 internal void GB_lcd_off(GB_gameboy_t *gb);
 internal void GB_display_vblank(GB_gameboy_t *gb, GB_vblank_type_t type);
 internal void GB_update_wx_glitch(GB_gameboy_t *gb);
-#define GB_display_sync(gb) GB_display_run(gb, 0, true)
+internal void GB_invalidate_tile_row(GB_gameboy_t *gb, uint16_t addr);
+internal void GB_invalidate_tile_rows(GB_gameboy_t *gb);
+#define GB_display_sync(gb) (GB_PERF_COUNT(gb, display_syncs, 1), GB_display_run(gb, 0, true))
 
 enum {
   GB_OBJECT_PRIORITY_X,
@@ -53,6 +55,10 @@ typedef struct {
     bool obscured_by_line_limit;
 } GB_oam_info_t;
 
+#define GB_INDEXED_OBJECT   0x20
+#define GB_INDEXED_LCD_OFF  0x40
+#define GB_INDEXED_PRIORITY 0x80
+
 typedef enum {
     GB_COLOR_CORRECTION_DISABLED,
     GB_COLOR_CORRECTION_CORRECT_CURVES,
@@ -70,6 +76,13 @@ void GB_draw_tileset(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette
 void GB_draw_tilemap(GB_gameboy_t *gb, uint32_t *dest, GB_palette_type_t palette_type, uint8_t palette_index, GB_map_type_t map_type, GB_tileset_type_t tileset_type);
 uint8_t GB_get_oam_info(GB_gameboy_t *gb, GB_oam_info_t *dest, uint8_t *object_height);
 uint32_t GB_convert_rgb15(GB_gameboy_t *gb, uint16_t color, bool for_border);
+/* Writes a 160x144 byte per pixel frame of palette indices instead of (or in addition to) the RGB output. Each byte is
+   GB_INDEXED_OBJECT | palette << 2 | color for objects and palette << 2 | color for the background and window, matching
+   the layout of the background and object palettes (palette is 0-7 on CGB, the OBP register on DMG for objects, and 0
+   for the DMG background; color is after BGP/OBP mapping on DMG). Pixels drawn while the LCD is off are GB_INDEXED_LCD_OFF.
+   attributes is optional, and receives GB_INDEXED_PRIORITY if the pixel's CGB attributes or OAM flags had their priority
+   bit set, ORed with the object's OAM index for objects when objects are prioritized by index (CGB). */
+void GB_set_indexed_pixels_output(GB_gameboy_t *gb, uint8_t *output, uint8_t *attributes);
 void GB_set_color_correction_mode(GB_gameboy_t *gb, GB_color_correction_mode_t mode);
 void GB_set_light_temperature(GB_gameboy_t *gb, double temperature);
 bool GB_is_odd_frame(GB_gameboy_t *gb);
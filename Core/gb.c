@@ -7,7 +7,11 @@
 #include <stdarg.h>
 #ifndef _WIN32
 #include <sys/select.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 #endif
 #include "random.h"
 #include "gb.h"
@@ -152,6 +156,31 @@ GB_gameboy_t *GB_alloc(void)
     return ret;
 }
 
+static void GB_reset_internal(GB_gameboy_t *gb, bool quick, bool skip_boot);
+
+/* Everything GB_init sets up besides memory allocation */
+static void init_defaults(GB_gameboy_t *gb, bool skip_boot)
+{
+#ifndef GB_DISABLE_DEBUGGER
+    gb->input_callback = default_input_callback;
+    gb->async_input_callback = default_async_input_callback;
+#endif
+    gb->cartridge_type = &GB_cart_defs[0]; // Default cartridge type
+    gb->clock_multiplier = 1.0;
+    gb->apu_output.max_cycles_per_sample = 0x400;
+    
+    if (gb->model & GB_MODEL_NO_SFC_BIT) {
+        /* Disable time syncing. Timing should be done by the SFC emulator. */
+        gb->turbo = true;
+    }
+    
+    gb->data_bus_decay = 12;
+    gb->battery_sync_interval = 60;
+    
+    GB_reset_internal(gb, false, skip_boot);
+    load_default_border(gb);
+}
+
 GB_gameboy_t *GB_init(GB_gameboy_t *gb, GB_model_t model)
 {
     memset(gb, 0, sizeof(*gb));
@@ -164,25 +193,93 @@ GB_gameboy_t *GB_init(GB_gameboy_t *gb, GB_model_t model)
         gb->ram = malloc(gb->ram_size = 0x2000);
         gb->vram = malloc(gb->vram_size = 0x2000);
     }
+    
+    init_defaults(gb, false);
+    return gb;
+}
 
+void GB_reinit(GB_gameboy_t *gb, GB_model_t model, bool skip_boot)
+{
+    GB_ASSERT_NOT_RUNNING(gb)
+    GB_unmap_battery(gb);
+    GB_stop_audio_recording(gb);
+#ifndef GB_DISABLE_CHEATS
+    while (gb->cheats) {
+        GB_remove_cheat(gb, gb->cheats[0]);
+    }
+#endif
 #ifndef GB_DISABLE_DEBUGGER
-    gb->input_callback = default_input_callback;
-    gb->async_input_callback = default_async_input_callback;
+    GB_debugger_clear_symbols(gb);
+    if (gb->breakpoints) {
+        free(gb->breakpoints);
+    }
+    if (gb->watchpoints) {
+        free(gb->watchpoints);
+    }
+    if (gb->nontrivial_jump_state) {
+        free(gb->nontrivial_jump_state);
+    }
+    if (gb->undo_state) {
+        free(gb->undo_state);
+    }
+    GB_symbol_arena_t symbol_arena = gb->symbol_arena;
+#endif
+#ifndef GB_DISABLE_REWIND
+    GB_rewind_clear(gb);
+    typeof(gb->rewind_sequences) rewind_sequences = gb->rewind_sequences;
+    size_t rewind_buffer_length = gb->rewind_buffer_length;
+    size_t rewind_state_size = gb->rewind_state_size;
 #endif
-    gb->cartridge_type = &GB_cart_defs[0]; // Default cartridge type
-    gb->clock_multiplier = 1.0;
-    gb->apu_output.max_cycles_per_sample = 0x400;
     
-    if (model & GB_MODEL_NO_SFC_BIT) {
-        /* Disable time syncing. Timing should be done by the SFC emulator. */
-        gb->turbo = true;
+    /* Keep every allocation the next instance can use */
+    uint8_t *ram = gb->ram, *vram = gb->vram, *mbc_ram = gb->mbc_ram, *rom = gb->rom;
+    uint32_t ram_size = gb->ram_size, vram_size = gb->vram_size, mbc_ram_size = gb->mbc_ram_size, rom_size = gb->rom_size;
+    GB_sgb_t *sgb = gb->sgb;
+    struct GB_translated_block_s *translated_blocks = gb->translated_blocks;
+    GB_rgb15_cache_t rgb15_cache[2];
+    memcpy(rgb15_cache, gb->rgb15_cache, sizeof(rgb15_cache));
+    
+    memset(gb, 0, sizeof(*gb));
+    gb->model = model;
+    gb->ram = ram;
+    gb->vram = vram;
+    gb->rom = rom;
+    gb->rom_size = rom_size;
+    gb->sgb = sgb;
+    gb->translated_blocks = translated_blocks;
+    memcpy(gb->rgb15_cache, rgb15_cache, sizeof(rgb15_cache));
+#ifndef GB_DISABLE_DEBUGGER
+    gb->symbol_arena = symbol_arena;
+#endif
+#ifndef GB_DISABLE_REWIND
+    gb->rewind_sequences = rewind_sequences;
+    gb->rewind_buffer_length = rewind_buffer_length;
+    gb->rewind_state_size = rewind_state_size;
+#endif
+    
+    /* Cartridge RAM is reused by the next cartridge if it has the same size, it must look freshly allocated */
+    gb->mbc_ram = mbc_ram;
+    gb->mbc_ram_size = mbc_ram_size;
+    if (mbc_ram) {
+        memset(mbc_ram, 0xFF, mbc_ram_size);
     }
     
-    gb->data_bus_decay = 12;
+    if (GB_is_cgb(gb)) {
+        gb->ram_size = 0x1000 * 8;
+        gb->vram_size = 0x2000 * 2;
+    }
+    else {
+        gb->ram_size = 0x2000;
+        gb->vram_size = 0x2000;
+    }
+    if (gb->ram_size != ram_size) {
+        gb->ram = realloc(gb->ram, gb->ram_size);
+    }
+    if (gb->vram_size != vram_size) {
+        gb->vram = realloc(gb->vram, gb->vram_size);
+    }
     
-    GB_reset(gb);
-    load_default_border(gb);
-    return gb;
+    init_defaults(gb, skip_boot);
 }
 
 GB_model_t GB_get_model(GB_gameboy_t *gb)
@@ -194,6 +291,7 @@ void GB_free(GB_gameboy_t *gb)
 {
     GB_ASSERT_NOT_RUNNING(gb)
     gb->magic = 0;
+    GB_unmap_battery(gb);
     if (gb->ram) {
         free(gb->ram);
     }
@@ -209,8 +307,17 @@ void GB_free(GB_gameboy_t *gb)
     if (gb->sgb) {
         free(gb->sgb);
     }
+    if (gb->translated_blocks) {
+        free(gb->translated_blocks);
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        if (gb->rgb15_cache[i].colors) {
+            free(gb->rgb15_cache[i].colors);
+        }
+    }
 #ifndef GB_DISABLE_DEBUGGER
     GB_debugger_clear_symbols(gb);
+    GB_arena_free(&gb->symbol_arena);
     if (gb->breakpoints) {
         free(gb->breakpoints);
     }
@@ -318,6 +425,19 @@ static size_t rounded_rom_size(size_t size)
     return size;
 }
 
+/* Keeps the current buffer if it already has the right size, such as when loading into a reused instance */
+static void allocate_rom(GB_gameboy_t *gb, uint32_t size)
+{
+    if (gb->rom && gb->rom_size != size) {
+        free(gb->rom);
+        gb->rom = NULL;
+    }
+    gb->rom_size = size;
+    if (!gb->rom) {
+        gb->rom = malloc(size);
+    }
+}
+
 int GB_load_rom(GB_gameboy_t *gb, const char *path)
 {
     GB_ASSERT_NOT_RUNNING_OTHER_THREAD(gb)
@@ -328,12 +448,8 @@ int GB_load_rom(GB_gameboy_t *gb, const char *path)
         return errno;
     }
     fseek(f, 0, SEEK_END);
-    gb->rom_size = rounded_rom_size(ftell(f));
+    allocate_rom(gb, rounded_rom_size(ftell(f)));
     fseek(f, 0, SEEK_SET);
-    if (gb->rom) {
-        free(gb->rom);
-    }
-    gb->rom = malloc(gb->rom_size);
     memset(gb->rom, 0xFF, gb->rom_size); /* Pad with 0xFFs */
     fread(gb->rom, 1, gb->rom_size, f);
     fclose(f);
@@ -445,6 +561,7 @@ int GB_load_gbs_from_buffer(GB_gameboy_t *gb, const uint8_t *buffer, size_t size
     memset(gb->rom, 0xFF, gb->rom_size); /* Pad with 0xFFs */
     memcpy(gb->rom + LE16(gb->gbs_header.load_address), buffer + sizeof(gb->gbs_header), data_size);
     
+    GB_unmap_battery(gb);
     gb->cartridge_type = &GB_cart_defs[0x11];
     if (gb->mbc_ram) {
         free(gb->mbc_ram);
@@ -732,11 +849,7 @@ void GB_load_rom_from_buffer(GB_gameboy_t *gb, const uint8_t *buffer, size_t siz
 {
     GB_ASSERT_NOT_RUNNING_OTHER_THREAD(gb)
     
-    gb->rom_size = rounded_rom_size(size);
-    if (gb->rom) {
-        free(gb->rom);
-    }
-    gb->rom = malloc(gb->rom_size);
+    allocate_rom(gb, rounded_rom_size(size));
     memset(gb->rom, 0xFF, gb->rom_size);
     memcpy(gb->rom, buffer, size);
     GB_configure_cart(gb);
@@ -796,44 +909,15 @@ static void fill_tpp1_save_data(GB_gameboy_t *gb, tpp1_rtc_save_t *data)
     }
 }
 
-int GB_save_battery_size(GB_gameboy_t *gb)
+/* Writes the RTC data that follows the cartridge RAM in a battery save, if any */
+static void fill_battery_footer(GB_gameboy_t *gb, uint8_t *buffer)
 {
-    if (!gb->cartridge_type->has_battery) return 0; // Nothing to save.
-    if (gb->cartridge_type->mbc_type == GB_TPP1 && !(gb->rom[0x153] & 8)) return 0; // Nothing to save.
-
-    if (gb->mbc_ram_size == 0 && !gb->cartridge_type->has_rtc) return 0; /* Claims to have battery, but has no RAM or RTC */
-
-    if (gb->cartridge_type->mbc_type == GB_HUC3) {
-        return gb->mbc_ram_size + sizeof(GB_huc3_rtc_time_t);
-    }
-    
     if (gb->cartridge_type->mbc_type == GB_TPP1) {
-        return gb->mbc_ram_size + sizeof(tpp1_rtc_save_t);
-    }
-    
-    rtc_save_t rtc_save_size;
-    return gb->mbc_ram_size + (gb->cartridge_type->has_rtc ? sizeof(rtc_save_size.vba64) : 0);
-}
-
-int GB_save_battery_to_buffer(GB_gameboy_t *gb, uint8_t *buffer, size_t size)
-{
-    if (!gb->cartridge_type->has_battery) return 0; // Nothing to save.
-    if (gb->cartridge_type->mbc_type == GB_TPP1 && !(gb->rom[0x153] & 8)) return 0; // Nothing to save.
-    if (gb->mbc_ram_size == 0 && !gb->cartridge_type->has_rtc) return 0; /* Claims to have battery, but has no RAM or RTC */
-
-    if (size < GB_save_battery_size(gb)) return EIO;
-
-    memcpy(buffer, gb->mbc_ram, gb->mbc_ram_size);
-
-    if (gb->cartridge_type->mbc_type == GB_TPP1) {
-        buffer += gb->mbc_ram_size;
         tpp1_rtc_save_t rtc_save;
         fill_tpp1_save_data(gb, &rtc_save);
         memcpy(buffer, &rtc_save, sizeof(rtc_save));
     }
     else if (gb->cartridge_type->mbc_type == GB_HUC3) {
-        buffer += gb->mbc_ram_size;
-
         GB_huc3_rtc_time_t rtc_save = {
             LE64(gb->last_rtc_second),
             LE16(gb->huc3.minutes),
@@ -857,8 +941,39 @@ int GB_save_battery_to_buffer(GB_gameboy_t *gb, uint8_t *buffer, size_t size)
         rtc_save.vba64.rtc_latched.days = gb->rtc_latched.days;
         rtc_save.vba64.rtc_latched.high = gb->rtc_latched.high;
         rtc_save.vba64.last_rtc_second = LE64(time(NULL));
-        memcpy(buffer + gb->mbc_ram_size, &rtc_save.vba64, sizeof(rtc_save.vba64));
+        memcpy(buffer, &rtc_save.vba64, sizeof(rtc_save.vba64));
     }
+}
+
+int GB_save_battery_size(GB_gameboy_t *gb)
+{
+    if (!gb->cartridge_type->has_battery) return 0; // Nothing to save.
+    if (gb->cartridge_type->mbc_type == GB_TPP1 && !(gb->rom[0x153] & 8)) return 0; // Nothing to save.
+
+    if (gb->mbc_ram_size == 0 && !gb->cartridge_type->has_rtc) return 0; /* Claims to have battery, but has no RAM or RTC */
+
+    if (gb->cartridge_type->mbc_type == GB_HUC3) {
+        return gb->mbc_ram_size + sizeof(GB_huc3_rtc_time_t);
+    }
+    
+    if (gb->cartridge_type->mbc_type == GB_TPP1) {
+        return gb->mbc_ram_size + sizeof(tpp1_rtc_save_t);
+    }
+    
+    rtc_save_t rtc_save_size;
+    return gb->mbc_ram_size + (gb->cartridge_type->has_rtc ? sizeof(rtc_save_size.vba64) : 0);
+}
+
+int GB_save_battery_to_buffer(GB_gameboy_t *gb, uint8_t *buffer, size_t size)
+{
+    if (!gb->cartridge_type->has_battery) return 0; // Nothing to save.
+    if (gb->cartridge_type->mbc_type == GB_TPP1 && !(gb->rom[0x153] & 8)) return 0; // Nothing to save.
+    if (gb->mbc_ram_size == 0 && !gb->cartridge_type->has_rtc) return 0; /* Claims to have battery, but has no RAM or RTC */
+
+    if (size < GB_save_battery_size(gb)) return EIO;
+
+    memcpy(buffer, gb->mbc_ram, gb->mbc_ram_size);
+    fill_battery_footer(gb, buffer + gb->mbc_ram_size);
 
     errno = 0;
     return errno;
@@ -1160,6 +1275,194 @@ exit:
     return;
 }
 
+#define BATTERY_PAGE_SIZE 0x1000
+
+#ifndef _WIN32
+/* Copies cartridge RAM and the RTC data into the mapped file off the emulation thread. Each sync hands the writer a
+   snapshot; a snapshot it hasn't started on yet is simply replaced, and a sync only waits if the writer is still
+   copying the previous one. */
+struct GB_battery_writer_s {
+    uint8_t *map;
+    uint8_t *snapshot;
+    size_t size;
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    bool pending;
+    bool writing;
+    bool quit;
+    int error;
+};
+
+static int write_battery_snapshot(struct GB_battery_writer_s *writer)
+{
+    /* Only touch pages that actually changed, so the kernel only writes those back */
+    for (size_t offset = 0; offset < writer->size; offset += BATTERY_PAGE_SIZE) {
+        size_t length = MIN(BATTERY_PAGE_SIZE, writer->size - offset);
+        if (memcmp(writer->map + offset, writer->snapshot + offset, length)) {
+            memcpy(writer->map + offset, writer->snapshot + offset, length);
+        }
+    }
+    
+    if (msync(writer->map, writer->size, MS_ASYNC)) {
+        return errno;
+    }
+    return 0;
+}
+
+static void *battery_writer(struct GB_battery_writer_s *writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    while (true) {
+        while (!writer->pending && !writer->quit) {
+            pthread_cond_wait(&writer->wake, &writer->lock);
+        }
+        if (!writer->pending) break;
+        writer->pending = false;
+        writer->writing = true;
+        pthread_mutex_unlock(&writer->lock);
+        int error = write_battery_snapshot(writer);
+        pthread_mutex_lock(&writer->lock);
+        writer->writing = false;
+        if (error) {
+            writer->error = error;
+        }
+        pthread_cond_signal(&writer->done);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+int GB_map_battery(GB_gameboy_t *gb, const char *path)
+{
+    GB_ASSERT_NOT_RUNNING_OTHER_THREAD(gb)
+    GB_unmap_battery(gb);
+    
+    size_t size = GB_save_battery_size(gb);
+    if (!size) return 0; // Nothing to save.
+    
+    int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) {
+        GB_log(gb, "Could not open battery save: %s.\n", strerror(errno));
+        return errno;
+    }
+    
+    /* Load the existing save first, it might use a different RTC format */
+    struct stat stat;
+    if (fstat(fd, &stat) == 0 && stat.st_size) {
+        uint8_t *existing = mmap(NULL, stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (existing != MAP_FAILED) {
+            GB_load_battery_from_buffer(gb, existing, stat.st_size);
+            munmap(existing, stat.st_size);
+        }
+    }
+    
+    if (ftruncate(fd, size)) {
+        GB_log(gb, "Could not resize battery save: %s.\n", strerror(errno));
+        close(fd);
+        return errno;
+    }
+    
+    uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        GB_log(gb, "Could not map battery save: %s.\n", strerror(errno));
+        return errno;
+    }
+    
+    struct GB_battery_writer_s *writer = malloc(sizeof(*writer));
+    memset(writer, 0, sizeof(*writer));
+    writer->map = map;
+    writer->snapshot = malloc(size);
+    writer->size = size;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->wake, NULL);
+    pthread_cond_init(&writer->done, NULL);
+    /* Without a thread, syncs write the snapshot themselves */
+    writer->threaded = pthread_create(&writer->thread, NULL, (void *)battery_writer, writer) == 0;
+    
+    gb->battery_writer = writer;
+    gb->frames_since_battery_sync = 0;
+    GB_save_battery_to_buffer(gb, map, size);
+    msync(map, size, MS_ASYNC);
+    return 0;
+}
+
+int GB_sync_battery(GB_gameboy_t *gb)
+{
+    GB_ASSERT_NOT_RUNNING_OTHER_THREAD(gb)
+    
+    struct GB_battery_writer_s *writer = gb->battery_writer;
+    if (!writer) return 0;
+    gb->frames_since_battery_sync = 0;
+    
+    pthread_mutex_lock(&writer->lock);
+    while (writer->writing) {
+        pthread_cond_wait(&writer->done, &writer->lock);
+    }
+    memcpy(writer->snapshot, gb->mbc_ram, gb->mbc_ram_size);
+    fill_battery_footer(gb, writer->snapshot + gb->mbc_ram_size);
+    if (writer->threaded) {
+        writer->pending = true;
+        pthread_cond_signal(&writer->wake);
+    }
+    else {
+        int error = write_battery_snapshot(writer);
+        if (error) {
+            writer->error = error;
+        }
+    }
+    int error = writer->error;
+    writer->error = 0;
+    pthread_mutex_unlock(&writer->lock);
+    return error;
+}
+
+void GB_unmap_battery(GB_gameboy_t *gb)
+{
+    struct GB_battery_writer_s *writer = gb->battery_writer;
+    if (!writer) return;
+    GB_sync_battery(gb);
+    if (writer->threaded) {
+        pthread_mutex_lock(&writer->lock);
+        writer->quit = true;
+        pthread_cond_signal(&writer->wake);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+    }
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->wake);
+    pthread_cond_destroy(&writer->done);
+    msync(writer->map, writer->size, MS_SYNC);
+    munmap(writer->map, writer->size);
+    free(writer->snapshot);
+    free(writer);
+    gb->battery_writer = NULL;
+}
+#else
+int GB_map_battery(GB_gameboy_t *gb, const char *path)
+{
+    GB_log(gb, "Memory-mapped battery saves are not supported on this platform.\n");
+    return ENOSYS;
+}
+
+int GB_sync_battery(GB_gameboy_t *gb)
+{
+    return 0;
+}
+
+void GB_unmap_battery(GB_gameboy_t *gb)
+{
+}
+#endif
+
+void GB_set_battery_sync_interval(GB_gameboy_t *gb, unsigned frames)
+{
+    gb->battery_sync_interval = frames;
+}
+
 unsigned GB_run(GB_gameboy_t *gb)
 {
     GB_ASSERT_NOT_RUNNING(gb)
@@ -1186,10 +1489,17 @@ unsigned GB_run(GB_gameboy_t *gb)
     GB_cpu_run(gb);
     GB_clear_running_thread(gb);
     if (unlikely(gb->vblank_just_occured)) {
+        GB_PERF_COUNT(gb, frames, 1);
         GB_debugger_handle_async_commands(gb);
-        GB_set_running_thread(gb);
-        GB_rewind_push(gb);
-        GB_clear_running_thread(gb);
+        if (likely(!gb->speculating)) {
+            GB_set_running_thread(gb);
+            GB_rewind_push(gb);
+            GB_clear_running_thread(gb);
+            if (gb->battery_writer && gb->battery_sync_interval &&
+                ++gb->frames_since_battery_sync >= gb->battery_sync_interval) {
+                GB_sync_battery(gb);
+            }
+        }
     }
     if (!(gb->io_registers[GB_IO_IF] & 0x10) && (gb->io_registers[GB_IO_JOYP] & 0x30) != 0x30) {
         gb->joyp_accessed = true;
@@ -1217,6 +1527,42 @@ uint64_t GB_run_frame(GB_gameboy_t *gb)
     return gb->cycles_since_last_sync * 1000000000LL / 2 / GB_get_clock_rate(gb); /* / 2 because we use 8MHz units */
 }
 
+size_t GB_run_input_playback(GB_gameboy_t *gb, const GB_key_mask_t *masks, const uint64_t *timestamps, size_t count,
+                             GB_input_playback_stop_callback_t should_stop, void *context)
+{
+    bool old_turbo = gb->turbo;
+    bool old_dont_skip = gb->turbo_dont_skip;
+    gb->turbo = true;
+    gb->turbo_dont_skip = true;
+    
+    uint64_t cycles = 0;
+    size_t i = 0;
+    while (i < count) {
+        if (timestamps) {
+            while (cycles < timestamps[i]) {
+                cycles += GB_run(gb);
+            }
+        }
+        GB_set_key_mask(gb, masks[i]);
+        if (timestamps && i + 1 < count) {
+            while (cycles < timestamps[i + 1]) {
+                cycles += GB_run(gb);
+            }
+        }
+        else {
+            do {
+                cycles += GB_run(gb);
+            } while (!gb->vblank_just_occured);
+        }
+        i++;
+        if (should_stop && should_stop(gb, i - 1, context)) break;
+    }
+    
+    gb->turbo = old_turbo;
+    gb->turbo_dont_skip = old_dont_skip;
+    return i;
+}
+
 void GB_set_pixels_output(GB_gameboy_t *gb, uint32_t *output)
 {
     GB_ASSERT_NOT_RUNNING_OTHER_THREAD(gb)
@@ -1228,6 +1574,13 @@ uint32_t *GB_get_pixels_output(GB_gameboy_t *gb)
     return gb->screen;
 }
 
+void GB_set_indexed_pixels_output(GB_gameboy_t *gb, uint8_t *output, uint8_t *attributes)
+{
+    GB_ASSERT_NOT_RUNNING_OTHER_THREAD(gb)
+    gb->indexed_screen = output;
+    gb->indexed_attributes = output? attributes : NULL;
+}
+
 void GB_set_vblank_callback(GB_gameboy_t *gb, GB_vblank_callback_t callback)
 {
     gb->vblank_callback = callback;
@@ -1314,6 +1667,8 @@ void GB_set_rgb_encode_callback(GB_gameboy_t *gb, GB_rgb_encode_callback_t callb
 {
 
     gb->rgb_encode_callback = callback;
+    /* The same callback may encode differently now (e.g. for a new pixel format), so cached colors can't be trusted */
+    gb->rgb15_cache[0].callback = gb->rgb15_cache[1].callback = NULL;
     update_dmg_palette(gb);
     
     for (unsigned i = 0; i < 32; i++) {
@@ -1633,7 +1988,7 @@ static void reset_ram(GB_gameboy_t *gb)
         }
     }
     
-    if (!gb->cartridge_type->has_battery) {
+    if (!gb->cartridge_type->has_battery && gb->mbc_ram_size) {
         memset(gb->mbc_ram, 0xFF, gb->mbc_ram_size);
     }
 }
@@ -1680,7 +2035,8 @@ static void request_boot_rom(GB_gameboy_t *gb)
     }
 }
 
-static void GB_reset_internal(GB_gameboy_t *gb, bool quick)
+/* With skip_boot, the caller installs a post-boot state afterwards, so RAM isn't randomized and no boot ROM is needed */
+static void GB_reset_internal(GB_gameboy_t *gb, bool quick, bool skip_boot)
 {
     struct {
         uint8_t hram[sizeof(gb->hram)];
@@ -1714,6 +2070,7 @@ static void GB_reset_internal(GB_gameboy_t *gb, bool quick)
     gb->version = GB_STRUCT_VERSION;
     
     GB_reset_mbc(gb);
+    GB_invalidate_translated_blocks(gb);
     
     gb->last_rtc_second = time(NULL);
     gb->cgb_ram_bank = 1;
@@ -1739,6 +2096,8 @@ static void GB_reset_internal(GB_gameboy_t *gb, bool quick)
     gb->io_registers[GB_IO_SC] = 0x7E;
     gb->accessed_oam_row = -1;
     gb->dma_current_dest = 0xA1;
+    gb->camera_image_valid = false;
+    GB_invalidate_tile_rows(gb);
 
     if (GB_is_hle_sgb(gb)) {
         if (!gb->sgb) {
@@ -1772,7 +2131,12 @@ static void GB_reset_internal(GB_gameboy_t *gb, bool quick)
     }
 #endif
     
-    if (!quick) {
+    if (skip_boot) {
+        if (!gb->cartridge_type->has_battery && gb->mbc_ram_size) {
+            memset(gb->mbc_ram, 0xFF, gb->mbc_ram_size);
+        }
+    }
+    else if (!quick) {
         reset_ram(gb);
         /* These are not deterministic, but 00 (CGB) and FF (DMG) are the most common initial values by far.
          The retain their previous values on quick resets */
@@ -1791,6 +2155,7 @@ static void GB_reset_internal(GB_gameboy_t *gb, bool quick)
     gb->apu.apu_cycles_in_2mhz = true;
     
     gb->magic = GB_state_magic();
+    if (skip_boot) return;
     request_boot_rom(gb);
     GB_rewind_push(gb);
 }
@@ -1798,13 +2163,148 @@ static void GB_reset_internal(GB_gameboy_t *gb, bool quick)
 void GB_reset(GB_gameboy_t *gb)
 {
     GB_ASSERT_NOT_RUNNING(gb)
-    GB_reset_internal(gb, false);
+    GB_reset_internal(gb, false, false);
 }
 
 void GB_quick_reset(GB_gameboy_t *gb)
 {
     GB_ASSERT_NOT_RUNNING(gb)
-    GB_reset_internal(gb, true);
+    GB_reset_internal(gb, true, false);
+}
+
+/* Entries are keyed by the model, the boot ROM, the cartridge type and RAM size, and the cartridge ROM bytes the boot ROM
+   read while filling them, such as the logo, and for some boot ROMs the title or header checksum. Any cartridge with the
+   same bytes there boots into the same state. */
+typedef struct {
+    GB_model_t model;
+    uint64_t boot_rom_hash;
+    const GB_cartridge_t *cartridge_type;
+    uint32_t mbc_ram_size; // Also the size of the cartridge RAM stored in the snapshot
+
+    unsigned read_count;
+    uint16_t *read_addresses;
+    uint8_t *read_values;
+    uint8_t *state;
+} boot_cache_entry_t;
+
+struct GB_boot_cache_s {
+    boot_cache_entry_t *entries;
+    unsigned count;
+};
+
+GB_boot_cache_t *GB_boot_cache_create(void)
+{
+    return calloc(1, sizeof(GB_boot_cache_t));
+}
+
+void GB_boot_cache_free(GB_boot_cache_t *cache)
+{
+    for (unsigned i = 0; i < cache->count; i++) {
+        free(cache->entries[i].read_addresses);
+        free(cache->entries[i].read_values);
+        free(cache->entries[i].state);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+static uint64_t boot_rom_hash(GB_gameboy_t *gb)
+{
+    uint64_t hash = 0;
+    for (unsigned i = 0; i < sizeof(gb->boot_rom); i++) {
+        hash = (((hash << 5) | (hash >> 59)) ^ gb->boot_rom[i]) * 0x517CC1B727220A95;
+    }
+    return hash;
+}
+
+/* The cartridge ROM byte the boot ROM sees at addr, with the MBC as it is after a reset */
+static uint8_t boot_visible_byte(GB_gameboy_t *gb, uint16_t addr)
+{
+    if (gb->cartridge_type->mbc_type == GB_MMM01) {
+        return gb->rom[gb->rom_size - 0x8000 + addr];
+    }
+    return gb->rom[addr];
+}
+
+static uint8_t boot_cache_read_callback(GB_gameboy_t *gb, uint16_t addr, uint8_t data)
+{
+    bool boot_rom_mapped = addr < 0x100 || (GB_is_cgb(gb) && addr >= 0x200 && addr < 0x900);
+    if (addr < 0x8000 && !boot_rom_mapped && !gb->boot_rom_finished) {
+        gb->boot_cache_reads[addr / 8] |= 1 << (addr % 8);
+    }
+    return data;
+}
+
+bool GB_reset_skipping_boot(GB_gameboy_t *gb, GB_boot_cache_t *cache)
+{
+    GB_ASSERT_NOT_RUNNING(gb)
+    if (!gb->rom || gb->rom_size < 0x8000) {
+        GB_reset(gb);
+        return false;
+    }
+    
+    uint64_t hash = boot_rom_hash(gb);
+    for (unsigned i = 0; i < cache->count; i++) {
+        boot_cache_entry_t *entry = &cache->entries[i];
+        if (entry->model != gb->model || entry->boot_rom_hash != hash) continue;
+        if (entry->cartridge_type != gb->cartridge_type || entry->mbc_ram_size != gb->mbc_ram_size) continue;
+        unsigned j = 0;
+        while (j < entry->read_count && boot_visible_byte(gb, entry->read_addresses[j]) == entry->read_values[j]) {
+            j++;
+        }
+        if (j == entry->read_count) {
+            GB_reset_internal(gb, false, true);
+            GB_restore_foreign_snapshot(gb, entry->state, entry->mbc_ram_size);
+            GB_rewind_push(gb);
+            return true;
+        }
+    }
+    
+    /* Run the boot ROM for real, without presenting frames or audio, and note which cartridge bytes it reads.
+       Rendering stays enabled, as disabling it leaves some PPU state (such as lcd_x) different from a normal boot. */
+    GB_reset(gb);
+    GB_vblank_callback_t vblank_callback = gb->vblank_callback;
+    GB_read_memory_callback_t read_memory_callback = gb->read_memory_callback;
+    gb->vblank_callback = NULL;
+    gb->read_memory_callback = boot_cache_read_callback;
+    gb->boot_cache_reads = calloc(0x8000 / 8, 1);
+    gb->speculating = true;
+    uint64_t cycles = 0;
+    while (!gb->boot_rom_finished && cycles < CPU_FREQUENCY * 2 * 60ULL) {
+        cycles += GB_run(gb);
+    }
+    gb->vblank_callback = vblank_callback;
+    gb->read_memory_callback = read_memory_callback;
+    gb->speculating = false;
+    uint8_t *reads = gb->boot_cache_reads;
+    gb->boot_cache_reads = NULL;
+    if (!gb->boot_rom_finished) {
+        free(reads);
+        GB_reset(gb);
+        return false;
+    }
+    
+    boot_cache_entry_t entry = {
+        .model = gb->model,
+        .boot_rom_hash = hash,
+        .cartridge_type = gb->cartridge_type,
+        .mbc_ram_size = gb->mbc_ram_size,
+        .state = malloc(GB_get_snapshot_size(gb)),
+    };
+    for (unsigned addr = 0; addr < 0x8000; addr++) {
+        if (!(reads[addr / 8] & (1 << (addr % 8)))) continue;
+        if ((entry.read_count & 0xFF) == 0) {
+            entry.read_addresses = realloc(entry.read_addresses, (entry.read_count + 0x100) * sizeof(entry.read_addresses[0]));
+            entry.read_values = realloc(entry.read_values, entry.read_count + 0x100);
+        }
+        entry.read_addresses[entry.read_count] = addr;
+        entry.read_values[entry.read_count++] = boot_visible_byte(gb, addr);
+    }
+    free(reads);
+    GB_take_snapshot(gb, entry.state);
+    cache->entries = realloc(cache->entries, sizeof(cache->entries[0]) * (cache->count + 1));
+    cache->entries[cache->count++] = entry;
+    return false;
 }
 
 void GB_switch_model_and_reset(GB_gameboy_t *gb, GB_model_t model)
@@ -1846,10 +2346,13 @@ void *GB_get_direct_access(GB_gameboy_t *gb, GB_direct_access_t access, size_t *
     
     switch (access) {
         case GB_DIRECT_ACCESS_ROM:
+            /* Translated blocks are decoded from the ROM, so they can't be trusted after this */
+            GB_invalidate_translated_blocks(gb);
             *size = gb->rom_size;
             *bank = gb->mbc_rom_bank & (gb->rom_size / 0x4000 - 1);
             return gb->rom;
         case GB_DIRECT_ACCESS_ROM0:
+            GB_invalidate_translated_blocks(gb);
             *size = gb->rom_size;
             *bank = gb->mbc_rom0_bank & (gb->rom_size / 0x4000 - 1);
             return gb->rom;
@@ -1862,6 +2365,8 @@ void *GB_get_direct_access(GB_gameboy_t *gb, GB_direct_access_t access, size_t *
             *bank = gb->mbc_ram_bank & (gb->mbc_ram_size / 0x2000 - 1);
             return gb->mbc_ram;
         case GB_DIRECT_ACCESS_VRAM:
+            /* Writes through this pointer bypass the decoded tile cache, so it's flushed every frame from now on */
+            gb->vram_directly_accessed = true;
             *size = gb->vram_size;
             *bank = gb->cgb_vram_bank;
             return gb->vram;
@@ -30,6 +30,9 @@ extern "C" {
 #include "rumble.h"
 #include "workboy.h"
 #include "random.h"
+#include "link.h"
+#include "batch.h"
+#include "perf.h"
 
 #define GB_STRUCT_VERSION 15
 
@@ -257,6 +260,12 @@ typedef enum {
 #define SGB_PAL_FREQUENCY (21281370 / 5)
 #define DIV_CYCLES (0x100)
 
+/* For debug_flags, letting the tester check fast paths against the paths they replace */
+typedef enum {
+    GB_DEBUG_NO_MODE3_BATCHING = 1,
+    GB_DEBUG_NO_DMA_BLOCK_COPIES = 2,
+} GB_debug_flags_t;
+
 #ifdef GB_DISABLE_REWIND
 #define GB_rewind_reset(...)
 #define GB_rewind_push(...)
@@ -285,8 +294,22 @@ typedef void (*GB_execution_callback_t)(GB_gameboy_t *gb, uint16_t address, uint
 typedef void (*GB_lcd_line_callback_t)(GB_gameboy_t *gb, uint8_t line);
 typedef void (*GB_lcd_status_callback_t)(GB_gameboy_t *gb, bool on);
 
+#include "pool.h"
+
 struct GB_breakpoint_s;
 struct GB_watchpoint_s;
+struct GB_translated_block_s;
+
+/* Lazily filled GB_convert_rgb15 results, valid as long as the settings they were converted with are unchanged and
+   the encode callback isn't set again */
+typedef struct {
+    uint32_t *colors; // 0x8000 entries, followed by a bitmap of the entries already converted
+    GB_rgb_encode_callback_t callback;
+    GB_color_correction_mode_t mode;
+    double temperature;
+    GB_model_t model;
+    bool has_sgb_border;
+} GB_rgb15_cache_t;
 
 typedef struct {
     uint8_t pixel; // Color, 0-3
@@ -686,13 +709,22 @@ struct GB_gameboy_internal_s {
 
         /* I/O */
         uint32_t *screen;
+        uint8_t *indexed_screen;
+        uint8_t *indexed_attributes;
         uint32_t background_palettes_rgb[0x20];
         uint32_t object_palettes_rgb[0x20];
         const GB_palette_t *dmg_palette;
         GB_color_correction_mode_t color_correction_mode;
         double light_temperature;
+        GB_rgb15_cache_t rgb15_cache[2]; // Indexed by for_border
+        uint16_t decoded_tile_rows[0x1800][2]; // Tile data rows of both banks, indexed by horizontal flip
+        uint8_t decoded_tile_rows_valid[0x1800 / 8];
+        bool vram_directly_accessed;
         bool keys[4][GB_KEY_MAX];
         double accelerometer_x, accelerometer_y;
+        uint32_t camera_noise_seed;
+        bool camera_image_valid;
+        uint8_t camera_image[0xE00]; // The sensor's output, in the 2bpp tile format it's read in
         GB_border_mode_t border_mode;
         GB_sgb_border_t borrowed_border;
         bool tried_loading_sgb_border;
@@ -713,6 +745,11 @@ struct GB_gameboy_internal_s {
         uint32_t unmultiplied_clock_rate;
         uint32_t data_bus_decay;
 
+        /* Battery */
+        struct GB_battery_writer_s *battery_writer;
+        unsigned battery_sync_interval;
+        unsigned frames_since_battery_sync;
+
         /* Audio */
         GB_apu_output_t apu_output;
 
@@ -781,6 +818,7 @@ struct GB_gameboy_internal_s {
         GB_symbol_map_t **bank_symbols;
         size_t n_symbol_maps;
         GB_reversed_symbol_map_t reversed_symbol_map;
+        GB_symbol_arena_t symbol_arena;
 
         /* Ticks command */
         uint64_t debugger_ticks;
@@ -817,13 +855,28 @@ struct GB_gameboy_internal_s {
         bool cheat_enabled;
         size_t cheat_count;
         GB_cheat_t **cheats;
-        GB_cheat_hash_t *cheat_hash[256];
+        uint8_t cheat_bitmap[0x10000 / 8]; // Set for every address with an enabled cheat, and possibly stale ones while dirty
+        bool cheat_index_dirty; // The slot table is rebuilt on the next read from a flagged address
+        uint16_t *cheat_slot_for_addr; // Only valid for addresses set in the bitmap
+        GB_cheat_slot_t *cheat_slots;
+        GB_cheat_entry_t *cheat_entries;
+#endif
+
+#ifdef GB_ENABLE_PERF_COUNTERS
+        GB_perf_counters_t perf_counters;
 #endif
 
         /* Misc */
+        GB_link_t *link;
         bool turbo;
         bool turbo_dont_skip;
+        bool speculating; // See GB_set_speculating
         bool disable_rendering;
+        uint8_t debug_flags; // GB_debug_flags_t
+        bool idle_loop_detection;
+        bool block_translation;
+        struct GB_translated_block_s *translated_blocks;
+        uint8_t *boot_cache_reads; // Marks the cartridge ROM bytes the boot ROM read while filling a boot cache entry
         uint8_t boot_rom[0x900];
         bool vblank_just_occured; // For slow operations involving syscalls; these should only run once per vblank
         unsigned cycles_since_run; // How many cycles have passed since the last call to GB_run(), in 8MHz units
@@ -841,6 +894,10 @@ struct GB_gameboy_internal_s {
         bool returned_open_bus;
         uint16_t addr_for_hdma_conflict;
         bool during_div_write;
+        const struct GB_translated_block_s *deferring_block; // The translated block running while time is deferred
+        unsigned deferred_cycles;
+        unsigned deferred_bus_access; // When the data bus was last driven, in deferred cycles
+        uint32_t deferred_data_bus_decay_countdown;
                
         /* Thread safety (debug only) */
         void *running_thread_id;
@@ -897,10 +954,33 @@ void GB_reset(GB_gameboy_t *gb);
 void GB_quick_reset(GB_gameboy_t *gb); // Similar to the cart reset line
 void GB_switch_model_and_reset(GB_gameboy_t *gb, GB_model_t model);
 
+/* A boot cache lets resets skip running the boot ROM by installing the state it finishes in. A reset that misses runs
+   the boot ROM as usual, without outputting frames or audio, and caches the result along with the cartridge type, its
+   RAM size and the cartridge ROM bytes the boot ROM read, typically the logo, and for some boot ROMs and models the
+   title, licensee or header checksum. Later resets of the same model with the same boot ROM, of any cartridge that
+   matches all of these, install it
+   directly, without randomizing RAM first. The installed RAM contents are those of the run that filled the cache, and
+   the RTC doesn't advance for the skipped time. A cache can be shared between instances, but not between threads
+   without locking. */
+typedef struct GB_boot_cache_s GB_boot_cache_t;
+GB_boot_cache_t *GB_boot_cache_create(void);
+void GB_boot_cache_free(GB_boot_cache_t *cache);
+/* Requires a ROM to be loaded. If the boot ROM doesn't finish within a minute, such as when none is loaded, this is
+   just a regular reset. Returns whether the boot was skipped, rather than run to fill the cache. */
+bool GB_reset_skipping_boot(GB_gameboy_t *gb, GB_boot_cache_t *cache);
+
 /* Returns the time passed, in 8MHz ticks. */
 unsigned GB_run(GB_gameboy_t *gb);
 /* Returns the time passed since the last frame, in nanoseconds */
 uint64_t GB_run_frame(GB_gameboy_t *gb);
+/* Plays back count key masks, one per frame. Each mask is applied right after the previous frame's vblank (the first
+   one immediately), the same point a frontend's vblank handling would apply it. If timestamps is not NULL, mask i is
+   instead applied as soon as timestamps[i] 8MHz ticks have passed since the call, and the last one is followed by one
+   more frame. should_stop is optional, and is called after every entry ran; returning true stops the playback. Returns the
+   number of entries that ran to completion. */
+typedef bool (*GB_input_playback_stop_callback_t)(GB_gameboy_t *gb, size_t entry, void *context);
+size_t GB_run_input_playback(GB_gameboy_t *gb, const GB_key_mask_t *masks, const uint64_t *timestamps, size_t count,
+                             GB_input_playback_stop_callback_t should_stop, void *context);
 
 typedef enum {
     GB_DIRECT_ACCESS_ROM,
@@ -941,6 +1021,15 @@ int GB_save_battery(GB_gameboy_t *gb, const char *path);
 void GB_load_battery_from_buffer(GB_gameboy_t *gb, const uint8_t *buffer, size_t size);
 void GB_load_battery(GB_gameboy_t *gb, const char *path);
 
+/* Loads a battery save and keeps it mapped in memory. Changed pages of cartridge RAM and the RTC data
+   are written back to the file every sync interval, and when unmapped. Not supported on Windows. */
+int GB_map_battery(GB_gameboy_t *gb, const char *path);
+/* Hands a copy of cartridge RAM and the RTC data to a background writer and returns without waiting for it.
+   Returns the error of a previous write-back, if any. The file is only complete once unmapped. */
+int GB_sync_battery(GB_gameboy_t *gb);
+void GB_unmap_battery(GB_gameboy_t *gb);
+void GB_set_battery_sync_interval(GB_gameboy_t *gb, unsigned frames); // 0 to only sync manually, defaults to 60
+
 void GB_set_turbo_mode(GB_gameboy_t *gb, bool on, bool no_frame_skip);
 void GB_set_rendering_disabled(GB_gameboy_t *gb, bool disabled);
     
@@ -1018,6 +1107,11 @@ uint32_t GB_get_rom_crc32(GB_gameboy_t *gb);
 
 #ifdef GB_INTERNAL
 internal void GB_borrow_sgb_border(GB_gameboy_t *gb);
+/* Equivalent to GB_free followed by GB_init, but keeps the memory, ROM, SGB, rewind and cache allocations for the new
+   instance. The ROM stays mapped until a new one is loaded, and the boot ROM isn't kept. With skip_boot, RAM keeps its
+   previous contents rather than being randomized and the boot ROM isn't started, so the instance must be reset (for
+   example by GB_reset_skipping_boot) before it runs. */
+internal void GB_reinit(GB_gameboy_t *gb, GB_model_t model, bool skip_boot);
 internal void GB_update_clock_rate(GB_gameboy_t *gb);
 #endif
     
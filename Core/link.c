@@ -0,0 +1,398 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+#include "gb.h"
+
+typedef struct {
+    /* The partner's infrared input is only updated while it senses, as it ignores it otherwise, and is caught up when
+       it starts sensing. A side's parallel quantum stops at the instruction that changes its LED or starts sensing, so
+       each quantum has at most one change per side, and the partner can be given the LED's state at any point of it.
+       A change the partner hasn't caught up with yet is pending. */
+    bool ir_state;
+    bool ir_previous_state;
+    bool ir_pending;
+    uint64_t ir_position;
+    bool sensing;
+    bool started_sensing;
+    uint64_t sensing_position;
+
+    bool bit_to_send;
+    /* Set when a parallel quantum stopped right after this side armed the serial port, while the partner might
+       still be behind that point. Until the partner passes the instruction that armed it, it must see this side as
+       not yet armed. */
+    bool armed_ahead;
+    uint64_t arm_position;
+
+    int64_t budget;
+    uint64_t position; // Cycles run since the link was created, at the start of the current instruction
+    unsigned elapsed;
+    bool vblank;
+} GB_link_side_t;
+
+struct GB_link_s {
+    GB_gameboy_t *gb[2];
+    GB_link_side_t side[2];
+    unsigned quantum;
+    bool parallel;
+    bool interleaved_only;
+
+    /* Worker thread handshake. An idle worker sleeps on wake once it spun for a while. */
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool sleeping;
+    unsigned generation;
+    unsigned done_generation;
+    bool quit;
+};
+
+#define WORKER_SPINS 0x800
+
+static void relax(unsigned *spins)
+{
+    if (++*spins < 0x400) return;
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+static GB_link_side_t *side_for(GB_gameboy_t *gb)
+{
+    return &gb->link->side[gb == gb->link->gb[1]];
+}
+
+static GB_gameboy_t *partner_for(GB_gameboy_t *gb)
+{
+    return gb->link->gb[gb == gb->link->gb[0]];
+}
+
+static void serial_start(GB_gameboy_t *gb, bool bit_to_send)
+{
+    side_for(gb)->bit_to_send = bit_to_send;
+}
+
+/* Interleaving runs the instructions of both sides in the order they start in, the first side first on ties */
+static bool partner_armed(GB_gameboy_t *gb)
+{
+    GB_link_side_t *partner = side_for(partner_for(gb));
+    if (!partner->armed_ahead) return true;
+    uint64_t position = side_for(gb)->position;
+    return partner->arm_position < position || (partner->arm_position == position && partner == &gb->link->side[0]);
+}
+
+static bool serial_end(GB_gameboy_t *gb)
+{
+    GB_link_side_t *side = side_for(gb);
+    GB_gameboy_t *partner = partner_for(gb);
+    /* Parallel quanta only run while neither side is armed, and a side stops as soon as it arms, so during one this
+       is only reached if the instruction that armed the port also clocked it; the partner was idle when the quantum
+       began. A partner that armed ahead of this side wasn't armed yet at this point either. An idle port reads as 0
+       and ignores incoming bits. */
+    if (gb->link->parallel || !partner_armed(gb)) return false;
+    bool ret = GB_serial_get_data_bit(partner);
+    GB_serial_set_data_bit(partner, side->bit_to_send);
+    return ret;
+}
+
+static void infrared_changed(GB_gameboy_t *gb, bool on)
+{
+    GB_link_side_t *side = side_for(gb);
+    if (gb->link->parallel) {
+        side->ir_pending = true;
+        side->ir_previous_state = side->ir_state;
+        side->ir_position = side->position;
+    }
+    else if (side_for(partner_for(gb))->sensing) {
+        GB_set_infrared_input(partner_for(gb), on);
+    }
+    side->ir_state = on;
+}
+
+/* Whether the pending LED change of link->gb[index] happened before an instruction of its partner starting at
+   position, in the same order as partner_armed */
+static bool ir_change_seen_at(GB_link_t *link, unsigned index, uint64_t position)
+{
+    GB_link_side_t *side = &link->side[index];
+    return side->ir_position < position || (side->ir_position == position && index == 0);
+}
+
+static bool visible_ir_state(GB_link_t *link, unsigned index, uint64_t position)
+{
+    GB_link_side_t *side = &link->side[index];
+    if (side->ir_pending && !ir_change_seen_at(link, index, position)) return side->ir_previous_state;
+    return side->ir_state;
+}
+
+/* Called before an interleaved instruction of link->gb[index]. Pending changes are delivered once the partner is about
+   to run past them, or when the side that made them runs again, as the partner is then past them too. */
+static void deliver_pending_ir(GB_link_t *link, unsigned index)
+{
+    for (unsigned i = 0; i < 2; i++) {
+        GB_link_side_t *side = &link->side[i];
+        if (!side->ir_pending) continue;
+        if (i != index && !ir_change_seen_at(link, i, link->side[index].position)) continue;
+        side->ir_pending = false;
+        if (link->side[!i].sensing) {
+            GB_set_infrared_input(link->gb[!i], side->ir_state);
+        }
+    }
+}
+
+/* Called after each instruction, with the side's position still at its start. Returns whether the side started
+   sensing, in which case its input is caught up with the partner's LED. */
+static bool update_sensing(GB_link_t *link, unsigned index)
+{
+    GB_link_side_t *side = &link->side[index];
+    bool sensing = GB_is_sensing_infrared(link->gb[index]);
+    bool started = sensing && !side->sensing;
+    side->sensing = sensing;
+    if (started) {
+        if (link->parallel) {
+            /* The partner may not have reached this point yet, catch up once it's done */
+            side->started_sensing = true;
+            side->sensing_position = side->position;
+        }
+        else {
+            GB_set_infrared_input(link->gb[index], visible_ir_state(link, !index, side->position));
+        }
+    }
+    return started;
+}
+
+static bool serial_armed(GB_gameboy_t *gb)
+{
+    return gb->io_registers[GB_IO_SC] & 0x80;
+}
+
+static void run_budget(GB_link_t *link, unsigned index)
+{
+    GB_gameboy_t *gb = link->gb[index];
+    GB_link_side_t *side = &link->side[index];
+    side->budget += link->quantum;
+    while (side->budget > 0) {
+        unsigned cycles = GB_run(gb);
+        side->budget -= cycles;
+        side->elapsed += cycles;
+        /* From here on, transfers need both sides at the same point in time */
+        if (serial_armed(gb)) {
+            side->armed_ahead = true;
+            side->arm_position = side->position;
+        }
+        /* Likewise for infrared, while a side senses */
+        bool stop = update_sensing(link, index) || side->ir_pending || side->armed_ahead;
+        side->position += cycles;
+        if (gb->vblank_just_occured) {
+            side->vblank = true;
+        }
+        if (stop) break;
+    }
+}
+
+static void *worker(GB_link_t *link)
+{
+    unsigned generation = 0;
+    while (true) {
+        unsigned spins = 0;
+        while (__atomic_load_n(&link->generation, __ATOMIC_ACQUIRE) == generation) {
+            if (spins < WORKER_SPINS) {
+                relax(&spins);
+                continue;
+            }
+            /* Idle, between frames or while the sides are interleaved. The sleeping flag and the generation are
+               sequentially consistent, so either the wakeup sees the flag, or this sees the new generation. */
+            pthread_mutex_lock(&link->lock);
+            __atomic_store_n(&link->sleeping, true, __ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&link->generation, __ATOMIC_SEQ_CST) == generation) {
+                pthread_cond_wait(&link->wake, &link->lock);
+            }
+            link->sleeping = false;
+            pthread_mutex_unlock(&link->lock);
+        }
+        generation++;
+        if (link->quit) break;
+        run_budget(link, 1);
+        __atomic_store_n(&link->done_generation, generation, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void start_worker(GB_link_t *link, unsigned generation)
+{
+    __atomic_store_n(&link->generation, generation, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&link->sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&link->lock);
+        pthread_cond_signal(&link->wake);
+        pthread_mutex_unlock(&link->lock);
+    }
+}
+
+static void run_parallel(GB_link_t *link)
+{
+    /* Neither side senses, so pending LED changes no longer matter */
+    for (unsigned i = 0; i < 2; i++) {
+        link->side[i].ir_pending = false;
+        link->side[i].started_sensing = false;
+        link->side[i].armed_ahead = false;
+    }
+
+    link->parallel = true;
+    if (link->threaded) {
+        unsigned generation = link->generation + 1;
+        start_worker(link, generation);
+        run_budget(link, 0);
+        unsigned spins = 0;
+        while (__atomic_load_n(&link->done_generation, __ATOMIC_ACQUIRE) != generation) {
+            relax(&spins);
+        }
+    }
+    else {
+        run_budget(link, 0);
+        run_budget(link, 1);
+    }
+    link->parallel = false;
+
+    for (unsigned i = 0; i < 2; i++) {
+        GB_link_side_t *side = &link->side[i];
+        if (!side->started_sensing) continue;
+        GB_set_infrared_input(link->gb[i], visible_ir_state(link, !i, side->sensing_position));
+        if (link->side[!i].ir_pending && ir_change_seen_at(link, !i, side->sensing_position)) {
+            link->side[!i].ir_pending = false;
+        }
+    }
+}
+
+static void run_interleaved(GB_link_t *link)
+{
+    link->side[0].budget += link->quantum;
+    link->side[1].budget += link->quantum;
+    while (link->side[0].budget > 0 || link->side[1].budget > 0) {
+        /* Always advance the instance that is behind */
+        unsigned index = link->side[0].budget >= link->side[1].budget? 0 : 1;
+        GB_gameboy_t *gb = link->gb[index];
+        GB_link_side_t *side = &link->side[index];
+        /* Running this side means the partner caught up with it */
+        side->armed_ahead = false;
+        deliver_pending_ir(link, index);
+        unsigned cycles = GB_run(gb);
+        side->budget -= cycles;
+        side->elapsed += cycles;
+        update_sensing(link, index);
+        side->position += cycles;
+        if (gb->vblank_just_occured) {
+            side->vblank = true;
+        }
+    }
+}
+
+static unsigned processor_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0? count : 1;
+#endif
+}
+
+GB_link_t *GB_link_create(GB_gameboy_t *first, GB_gameboy_t *second, bool threaded)
+{
+    GB_link_t *link = malloc(sizeof(*link));
+    memset(link, 0, sizeof(*link));
+    link->gb[0] = first;
+    link->gb[1] = second;
+    link->quantum = LCDC_PERIOD / 154 * 2;
+
+    for (unsigned i = 0; i < 2; i++) {
+        GB_gameboy_t *gb = link->gb[i];
+        gb->link = link;
+        GB_set_serial_transfer_bit_start_callback(gb, serial_start);
+        GB_set_serial_transfer_bit_end_callback(gb, serial_end);
+        GB_set_infrared_callback(gb, infrared_changed);
+        link->side[i].ir_state = gb->cart_ir || (gb->io_registers[GB_IO_RP] & 1);
+        link->side[i].sensing = GB_is_sensing_infrared(gb);
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        GB_set_infrared_input(link->gb[i], link->side[!i].ir_state);
+    }
+
+    /* With a single processor, the sides would only take turns through the worker, so they take turns directly */
+    if (threaded && processor_count() > 1) {
+        pthread_mutex_init(&link->lock, NULL);
+        pthread_cond_init(&link->wake, NULL);
+        link->threaded = pthread_create(&link->thread, NULL, (void *)worker, link) == 0;
+        if (!link->threaded) {
+            pthread_mutex_destroy(&link->lock);
+            pthread_cond_destroy(&link->wake);
+        }
+    }
+    return link;
+}
+
+void GB_link_destroy(GB_link_t *link)
+{
+    if (link->threaded) {
+        link->quit = true;
+        start_worker(link, link->generation + 1);
+        pthread_join(link->thread, NULL);
+        pthread_mutex_destroy(&link->lock);
+        pthread_cond_destroy(&link->wake);
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        GB_set_serial_transfer_bit_start_callback(link->gb[i], NULL);
+        GB_set_serial_transfer_bit_end_callback(link->gb[i], NULL);
+        GB_set_infrared_callback(link->gb[i], NULL);
+        link->gb[i]->link = NULL;
+    }
+    free(link);
+}
+
+void GB_link_set_quantum(GB_link_t *link, unsigned cycles)
+{
+    link->quantum = MAX(MIN(cycles, 0x1000), 16);
+}
+
+void GB_link_set_interleaved(GB_link_t *link, bool interleaved)
+{
+    link->interleaved_only = interleaved;
+}
+
+unsigned GB_link_run_frame(GB_link_t *link)
+{
+    bool old_turbo[2], old_dont_skip[2];
+    for (unsigned i = 0; i < 2; i++) {
+        GB_gameboy_t *gb = link->gb[i];
+        old_turbo[i] = gb->turbo;
+        old_dont_skip[i] = gb->turbo_dont_skip;
+        gb->turbo = true;
+        gb->turbo_dont_skip = true;
+        link->side[i].vblank = false;
+        link->side[i].elapsed = 0;
+    }
+
+    while (!link->side[0].vblank || !link->side[1].vblank) {
+        if (link->interleaved_only || serial_armed(link->gb[0]) || serial_armed(link->gb[1]) ||
+            link->side[0].sensing || link->side[1].sensing) {
+            run_interleaved(link);
+        }
+        else {
+            run_parallel(link);
+        }
+    }
+
+    for (unsigned i = 0; i < 2; i++) {
+        link->gb[i]->turbo = old_turbo[i];
+        link->gb[i]->turbo_dont_skip = old_dont_skip[i];
+    }
+    return link->side[0].elapsed;
+}
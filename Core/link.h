@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "defs.h"
+
+typedef struct GB_link_s GB_link_t;
+
+/* Connects two instances with a link cable (serial and infrared) and runs them in lockstep. Links are pairs only, like
+   the cable; there's no way to connect more than two instances, as with a four player adapter.
+   While neither side has its serial port armed or senses infrared, the instances run independently for a quantum at a
+   time, on two threads if threaded is set and there's more than one processor; a side's quantum ends early at the
+   instruction that arms its port, starts sensing, or changes its infrared LED. Otherwise, the instances are
+   interleaved instruction by instruction on the calling thread, always advancing the one that is behind. An instance
+   only receives infrared changes while it senses, as it ignores them otherwise, and catches up when it starts to.
+   Serial and infrared give the same results as always interleaving, with or without threading. */
+GB_link_t *GB_link_create(GB_gameboy_t *first, GB_gameboy_t *second, bool threaded);
+void GB_link_destroy(GB_link_t *link);
+void GB_link_set_quantum(GB_link_t *link, unsigned cycles); // In 8MHz units, defaults to one scanline
+/* Always interleaves the instances, the reference behavior parallel quanta are checked against */
+void GB_link_set_interleaved(GB_link_t *link, bool interleaved);
+/* Runs both instances until each of them completed a frame. Returns the time passed on the first instance, in 8MHz units */
+unsigned GB_link_run_frame(GB_link_t *link);
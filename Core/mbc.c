@@ -156,7 +156,11 @@ void GB_update_mbc_mappings(GB_gameboy_t *gb)
 
 void GB_configure_cart(GB_gameboy_t *gb)
 {
+    /* A mapped battery save belongs to the previous cartridge */
+    GB_unmap_battery(gb);
+    
     memset(GB_GET_SECTION(gb, mbc), 0, GB_SECTION_SIZE(mbc));
+    GB_invalidate_translated_blocks(gb);
     gb->cartridge_type = &GB_cart_defs[gb->rom[0x147]];
     if (gb->cartridge_type->mbc_type == GB_MMM01) {
         uint8_t *temp = malloc(0x8000);
@@ -1008,6 +1008,7 @@ static void write_vram(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
         return;
     }
     gb->vram[(addr & 0x1FFF) + (gb->cgb_vram_bank? 0x2000 : 0)] = value;
+    GB_invalidate_tile_row(gb, (addr & 0x1FFF) + (gb->cgb_vram_bank? 0x2000 : 0));
 }
 
 static bool huc3_write(GB_gameboy_t *gb, uint8_t value)
@@ -1840,6 +1841,48 @@ bool GB_is_dma_active(GB_gameboy_t *gb)
     return gb->dma_current_dest != 0xA1;
 }
 
+/* Returns where addr is stored if reading it from DMA has no side effects other than on the data bus, or NULL. The
+   memory after it is contiguous up to the end of its 256-byte page. */
+static const uint8_t *dma_direct_source(GB_gameboy_t *gb, uint16_t addr)
+{
+    if (unlikely(gb->debug_flags & GB_DEBUG_NO_DMA_BLOCK_COPIES)) return NULL;
+#ifndef GB_DISABLE_DEBUGGER
+    if (unlikely(gb->n_watchpoints)) return NULL;
+#endif
+#ifndef GB_DISABLE_CHEATS
+    if (unlikely(gb->cheat_enabled)) return NULL;
+#endif
+    if (unlikely(gb->read_memory_callback)) return NULL;
+    if (bus_for_addr(gb, addr) == GB_BUS_MAIN && unlikely(gb->returned_open_bus)) return NULL;
+    
+    if (addr < 0x8000) {
+        if (unlikely(!gb->boot_rom_finished || !gb->rom_size)) return NULL;
+        unsigned bank = addr < 0x4000? gb->mbc_rom0_bank : gb->mbc_rom_bank;
+        return gb->rom + (((addr & 0x3FFF) + bank * 0x4000) & (gb->rom_size - 1));
+    }
+    if ((addr & 0xE000) == 0xC000) {
+        return gb->ram + (addr & 0x0FFF) + (addr >= 0xD000? gb->cgb_ram_bank * 0x1000 : 0);
+    }
+    return NULL;
+}
+
+/* Leaves the data bus as GB_read_memory would have, if data was read from the main bus elapsed cycles ago */
+static void dma_settle_data_bus(GB_gameboy_t *gb, uint16_t addr, uint8_t data, unsigned elapsed)
+{
+    if (bus_for_addr(gb, addr) != GB_BUS_MAIN) return;
+    gb->data_bus = data;
+    gb->data_bus_decay_countdown = gb->data_bus_decay;
+    if (gb->data_bus_decay_countdown && elapsed) {
+        if (gb->data_bus_decay_countdown <= elapsed) {
+            gb->data_bus_decay_countdown = 0;
+            gb->data_bus = 0xFF;
+        }
+        else {
+            gb->data_bus_decay_countdown -= elapsed;
+        }
+    }
+}
+
 void GB_dma_run(GB_gameboy_t *gb)
 {
     if (gb->dma_current_dest == 0xA1) return;
@@ -1848,6 +1891,7 @@ void GB_dma_run(GB_gameboy_t *gb)
     gb->in_dma_read = true;
     while (unlikely(cycles >= 4)) {
         cycles -= 4;
+        GB_PERF_COUNT(gb, dma_cycles, 4);
         if (gb->dma_current_dest >= 0xA0) {
             gb->dma_current_dest++;
             if (gb->display_state == 8) {
@@ -1894,7 +1938,35 @@ void GB_hdma_run(GB_gameboy_t *gb)
     uint16_t vram_base = gb->cgb_vram_bank? 0x2000 : 0;
     gb->hdma_in_progress = true;
     GB_advance_cycles(gb, cycles);
+    GB_PERF_COUNT(gb, hdma_cycles, cycles);
     while (gb->hdma_on) {
+        /* Each byte takes 4 8MHz ticks in either speed. While the PPU sleeps through the rest of the block it can't
+           conflict with the VRAM writes, so the block can be copied at once, with time advanced in bulk. Source and
+           destination advance in lockstep, so the block stays within one source page. */
+        unsigned count = 0x10 - (gb->hdma_current_dest & 0xF);
+        if (!GB_is_dma_active(gb) &&
+            gb->display_cycles + (signed)count * 4 <= 0 &&
+            GB_can_coalesce_cycles(gb, (count * cycles + 3) / 4)) {
+            const uint8_t *source = dma_direct_source(gb, gb->hdma_current_src);
+            if (source) {
+                uint16_t src = gb->hdma_current_src;
+                gb->hdma_current_src += count;
+                GB_advance_cycles_coalesced(gb, count * cycles);
+                GB_PERF_COUNT(gb, hdma_cycles, count * cycles);
+                dma_settle_data_bus(gb, src, source[count - 1], 4);
+                for (unsigned i = 0; i < count; i++) {
+                    uint16_t addr = (gb->hdma_current_dest++ & 0x1FFF);
+                    gb->vram[vram_base + addr] = source[i];
+                    GB_invalidate_tile_row(gb, vram_base + addr);
+                    if (gb->vram_write_blocked) {
+                        gb->vram[(vram_base ^ 0x2000) + addr] = source[i];
+                        GB_invalidate_tile_row(gb, (vram_base ^ 0x2000) + addr);
+                    }
+                }
+                goto block_end;
+            }
+        }
+        
         uint8_t byte = gb->data_bus;
         gb->addr_for_hdma_conflict = 0xFFFF;
         
@@ -1908,12 +1980,15 @@ void GB_hdma_run(GB_gameboy_t *gb)
         }
         gb->hdma_current_src++;
         GB_advance_cycles(gb, cycles);
+        GB_PERF_COUNT(gb, hdma_cycles, cycles);
         if (gb->addr_for_hdma_conflict == 0xFFFF /* || ((gb->model & ~GB_MODEL_GBP_BIT) >= GB_MODEL_AGB_B && gb->cgb_double_speed) */) {
             uint16_t addr = (gb->hdma_current_dest++ & 0x1FFF);
             gb->vram[vram_base + addr] = byte;
+            GB_invalidate_tile_row(gb, vram_base + addr);
             // TODO: vram_write_blocked might not be the correct timing
             if (gb->vram_write_blocked /* && (gb->model & ~GB_MODEL_GBP_BIT) < GB_MODEL_AGB_B */) {
                 gb->vram[(vram_base ^ 0x2000) + addr] = byte;
+                GB_invalidate_tile_row(gb, (vram_base ^ 0x2000) + addr);
             }
         }
         else {
@@ -1925,14 +2000,17 @@ void GB_hdma_run(GB_gameboy_t *gb)
                 // TODO: there are *some* scenarions in single speed mode where this write doesn't happen. What's the logic?
                 uint16_t addr = (gb->hdma_current_dest & gb->addr_for_hdma_conflict & 0x1FFF);
                 gb->vram[vram_base + addr] = byte;
+                GB_invalidate_tile_row(gb, vram_base + addr);
                 // TODO: vram_write_blocked might not be the correct timing
                 if (gb->vram_write_blocked /* && (gb->model & ~GB_MODEL_GBP_BIT) < GB_MODEL_AGB_B */) {
                     gb->vram[(vram_base ^ 0x2000) + addr] = byte;
+                    GB_invalidate_tile_row(gb, (vram_base ^ 0x2000) + addr);
                 }
             }
             gb->hdma_current_dest++;
         }
         
+block_end:
         if ((gb->hdma_current_dest & 0xF) == 0) {
             if (--gb->hdma_steps_left == 0 || gb->hdma_current_dest == 0) {
                 gb->hdma_on = false;
@@ -0,0 +1,30 @@
+#include "gb.h"
+#ifdef GB_ENABLE_PERF_COUNTERS
+#include <string.h>
+#include <time.h>
+
+uint64_t GB_perf_timestamp(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ret;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ret));
+    return ret;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+const GB_perf_counters_t *GB_get_perf_counters(GB_gameboy_t *gb)
+{
+    return &gb->perf_counters;
+}
+
+void GB_reset_perf_counters(GB_gameboy_t *gb)
+{
+    memset(&gb->perf_counters, 0, sizeof(gb->perf_counters));
+}
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+#ifdef GB_ENABLE_PERF_COUNTERS
+#include <stdint.h>
+#include "defs.h"
+
+typedef enum {
+    GB_PERF_TIMERS, // Timers, camera and joypad
+    GB_PERF_APU,
+    GB_PERF_DISPLAY,
+    GB_PERF_DMA,
+    GB_PERF_MISC, // IR and RTC
+    GB_PERF_SUBSYSTEM_COUNT,
+} GB_perf_subsystem_t;
+
+typedef struct {
+    uint64_t frames;
+    uint64_t display_syncs; // Catch-ups forced by register and memory accesses
+    uint64_t apu_renders; // Samples rendered
+    uint64_t mode3_batched; // Lines rendered in one go
+    uint64_t mode3_unbatched; // Lines rendered pixel by pixel
+    uint64_t dma_cycles;
+    uint64_t hdma_cycles;
+    uint64_t timing_sleeps;
+    uint64_t rewind_pushes;
+    uint64_t idle_loop_cycles; // Spent in fast-forwarded polling loops, in 8MHz units
+    uint64_t translated_cycles; // Spent in translated blocks, in 8MHz units
+    uint64_t subsystem_ticks[GB_PERF_SUBSYSTEM_COUNT]; // In timestamp counter ticks, spent inside GB_advance_cycles
+} GB_perf_counters_t;
+
+/* Counters accumulate from GB_init or the last call to GB_reset_perf_counters */
+const GB_perf_counters_t *GB_get_perf_counters(GB_gameboy_t *gb);
+void GB_reset_perf_counters(GB_gameboy_t *gb);
+
+#ifdef GB_INTERNAL
+internal uint64_t GB_perf_timestamp(void);
+
+#define GB_PERF_COUNT(gb, counter, amount) ((void)((gb)->perf_counters.counter += (amount)))
+#define GB_PERF_TIME(gb, subsystem, ...) do { \
+    uint64_t _start = GB_perf_timestamp(); \
+    __VA_ARGS__; \
+    (gb)->perf_counters.subsystem_ticks[subsystem] += GB_perf_timestamp() - _start; \
+} while (0)
+#endif
+
+#else
+#ifdef GB_INTERNAL
+#define GB_PERF_COUNT(gb, counter, amount) ((void)0)
+#define GB_PERF_TIME(gb, subsystem, ...) do { __VA_ARGS__; } while (0)
+#endif
+#endif
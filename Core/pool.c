@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include "gb.h"
+
+struct GB_pool_s {
+    GB_profile_t profile;
+    GB_boot_cache_t *boot_cache;
+    GB_gameboy_t **idle;
+    unsigned idle_count;
+    unsigned idle_capacity;
+};
+
+GB_pool_t *GB_pool_create(const GB_profile_t *profile)
+{
+    GB_pool_t *pool = calloc(1, sizeof(*pool));
+    if (profile) {
+        pool->profile = *profile;
+    }
+    pool->boot_cache = GB_boot_cache_create();
+    return pool;
+}
+
+void GB_pool_free(GB_pool_t *pool)
+{
+    for (unsigned i = 0; i < pool->idle_count; i++) {
+        GB_dealloc(pool->idle[i]);
+    }
+    free(pool->idle);
+    GB_boot_cache_free(pool->boot_cache);
+    free(pool);
+}
+
+void GB_pool_set_profile(GB_pool_t *pool, const GB_profile_t *profile)
+{
+    pool->profile = *profile;
+}
+
+void GB_apply_profile(GB_gameboy_t *gb, const GB_profile_t *profile)
+{
+    GB_set_user_data(gb, profile->user_data);
+    GB_set_pixels_output(gb, profile->pixels);
+    GB_set_vblank_callback(gb, profile->vblank_callback);
+    GB_set_log_callback(gb, profile->log_callback);
+    GB_set_async_input_callback(gb, profile->async_input_callback);
+    GB_set_rgb_encode_callback(gb, profile->rgb_encode_callback);
+    GB_set_boot_rom_load_callback(gb, profile->boot_rom_load_callback);
+    GB_set_color_correction_mode(gb, profile->color_correction_mode);
+    GB_set_rtc_mode(gb, profile->rtc_mode);
+#ifndef GB_DISABLE_REWIND
+    GB_update_rewind_length(gb, profile->rewind_length);
+#endif
+    /* Models without an SFC are always in turbo mode, their timing is done by the SFC emulator */
+    GB_set_turbo_mode(gb, profile->turbo || (GB_get_model(gb) & GB_MODEL_NO_SFC_BIT), profile->turbo_dont_skip);
+    GB_set_rendering_disabled(gb, profile->rendering_disabled);
+    GB_set_emulate_joypad_bouncing(gb, !profile->joypad_bouncing_disabled);
+    GB_set_idle_loop_detection(gb, profile->idle_loop_detection);
+    GB_set_block_translation(gb, profile->block_translation);
+}
+
+static GB_gameboy_t *acquire(GB_pool_t *pool, GB_model_t model, bool skip_boot)
+{
+    GB_gameboy_t *gb;
+    if (pool->idle_count) {
+        /* Prefer the most recently released instance of the same model, its memory is the most likely to be cached */
+        unsigned index = pool->idle_count - 1;
+        for (unsigned i = pool->idle_count; i--;) {
+            if (GB_get_model(pool->idle[i]) == model) {
+                index = i;
+                break;
+            }
+        }
+        gb = pool->idle[index];
+        pool->idle[index] = pool->idle[--pool->idle_count];
+        GB_reinit(gb, model, skip_boot);
+    }
+    else {
+        gb = GB_init(GB_alloc(), model);
+    }
+    GB_apply_profile(gb, &pool->profile);
+    return gb;
+}
+
+GB_gameboy_t *GB_pool_acquire(GB_pool_t *pool, GB_model_t model)
+{
+    return acquire(pool, model, false);
+}
+
+GB_gameboy_t *GB_pool_acquire_booted(GB_pool_t *pool, GB_model_t model, const uint8_t *boot_rom, size_t boot_rom_size,
+                                     const uint8_t *rom, size_t rom_size)
+{
+    /* The reset below either installs a cached state over all of RAM or randomizes it, so acquiring doesn't */
+    GB_gameboy_t *gb = acquire(pool, model, true);
+    GB_load_boot_rom_from_buffer(gb, boot_rom, boot_rom_size);
+    GB_load_rom_from_buffer(gb, rom, rom_size);
+    GB_pool_reset(pool, gb);
+    return gb;
+}
+
+void GB_pool_release(GB_pool_t *pool, GB_gameboy_t *gb)
+{
+    GB_ASSERT_NOT_RUNNING(gb)
+    GB_unmap_battery(gb);
+    GB_stop_audio_recording(gb);
+    if (pool->idle_count == pool->idle_capacity) {
+        pool->idle_capacity = pool->idle_capacity? pool->idle_capacity * 2 : 4;
+        pool->idle = realloc(pool->idle, sizeof(pool->idle[0]) * pool->idle_capacity);
+    }
+    pool->idle[pool->idle_count++] = gb;
+}
+
+bool GB_pool_reset(GB_pool_t *pool, GB_gameboy_t *gb)
+{
+    return GB_reset_skipping_boot(gb, pool->boot_cache);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "defs.h"
+
+typedef struct GB_pool_s GB_pool_t;
+
+/* The callbacks and settings every instance is handed out with. Zeroed fields keep GB_init's defaults. */
+typedef struct {
+    void *user_data;
+    uint32_t *pixels;
+    GB_vblank_callback_t vblank_callback;
+    GB_log_callback_t log_callback;
+    GB_input_callback_t async_input_callback;
+    GB_rgb_encode_callback_t rgb_encode_callback;
+    GB_boot_rom_load_callback_t boot_rom_load_callback;
+    GB_color_correction_mode_t color_correction_mode;
+    GB_rtc_mode_t rtc_mode;
+    double rewind_length; // In seconds
+    bool turbo, turbo_dont_skip;
+    bool rendering_disabled;
+    bool joypad_bouncing_disabled;
+    bool idle_loop_detection;
+    bool block_translation;
+} GB_profile_t;
+
+/* Pools keep released instances and their allocations (RAM, VRAM, ROM and cartridge RAM buffers, SGB state, rewind
+   buffers and color caches), and hand them out again with only their state reset, so running many short jobs doesn't
+   allocate. A pool isn't thread safe; use one per thread. profile may be NULL. */
+GB_pool_t *GB_pool_create(const GB_profile_t *profile);
+/* Frees the released instances. Instances that weren't released stay valid, and must be freed with GB_dealloc. */
+void GB_pool_free(GB_pool_t *pool);
+/* Applies to the instances acquired from now on */
+void GB_pool_set_profile(GB_pool_t *pool, const GB_profile_t *profile);
+/* Returns a freshly initialized instance of the model with the profile applied, as if by GB_init. Released instances of
+   the same model are preferred, as switching models may reallocate memory. No boot ROM is loaded, and the previous
+   ROM stays mapped until a new one is loaded. */
+GB_gameboy_t *GB_pool_acquire(GB_pool_t *pool, GB_model_t model);
+/* Like GB_pool_acquire, but also loads the boot ROM and ROM, and runs the boot ROM through GB_pool_reset. When the
+   pool's boot cache has the boot, RAM isn't randomized at all, making this the cheapest way to start short jobs. */
+GB_gameboy_t *GB_pool_acquire_booted(GB_pool_t *pool, GB_model_t model, const uint8_t *boot_rom, size_t boot_rom_size,
+                                     const uint8_t *rom, size_t rom_size);
+/* Returns an instance from GB_pool_acquire to the pool. A mapped battery save is synced and unmapped, and an audio
+   recording is stopped, right away. */
+void GB_pool_release(GB_pool_t *pool, GB_gameboy_t *gb);
+/* Resets an instance once its boot ROM and ROM are loaded, installing the state the boot ROM finishes in from a boot
+   cache kept by the pool when it can (see GB_reset_skipping_boot). Returns whether the boot was skipped. */
+bool GB_pool_reset(GB_pool_t *pool, GB_gameboy_t *gb);
+/* Applies a profile to any instance in one call */
+void GB_apply_profile(GB_gameboy_t *gb, const GB_profile_t *profile);
@@ -110,6 +110,7 @@ static void state_decompress(const uint8_t *prev, uint8_t *data, uint8_t *dest,
 
 void GB_rewind_push(GB_gameboy_t *gb)
 {
+    GB_PERF_COUNT(gb, rewind_pushes, 1);
     const size_t save_size = GB_get_save_state_size_no_bess(gb);
     if (gb->rewind_state_size != save_size) {
         GB_rewind_reset(gb);
@@ -213,15 +214,39 @@ void GB_rewind_reset(GB_gameboy_t *gb)
     gb->rewind_sequences = NULL;
 }
 
+void GB_rewind_clear(GB_gameboy_t *gb)
+{
+    if (!gb->rewind_sequences) return;
+    for (unsigned i = 0; i < gb->rewind_buffer_length; i++) {
+        if (gb->rewind_sequences[i].key_state) {
+            free(gb->rewind_sequences[i].key_state);
+        }
+        for (unsigned j = 0; j < GB_REWIND_FRAMES_PER_KEY; j++) {
+            if (gb->rewind_sequences[i].compressed_states[j]) {
+                free(gb->rewind_sequences[i].compressed_states[j]);
+            }
+        }
+    }
+    memset(gb->rewind_sequences, 0, sizeof(*gb->rewind_sequences) * gb->rewind_buffer_length);
+    gb->rewind_pos = 0;
+}
+
+static size_t rewind_buffer_length(double seconds)
+{
+    if (seconds == 0) return 0;
+    return (size_t) ceil(seconds * CPU_FREQUENCY / LCDC_PERIOD / GB_REWIND_FRAMES_PER_KEY);
+}
+
 void GB_set_rewind_length(GB_gameboy_t *gb, double seconds)
 {
     GB_rewind_reset(gb);
-    if (seconds == 0) {
-        gb->rewind_buffer_length = 0;
-    }
-    else {
-        gb->rewind_buffer_length = (size_t) ceil(seconds * CPU_FREQUENCY / LCDC_PERIOD / GB_REWIND_FRAMES_PER_KEY);
-    }
+    gb->rewind_buffer_length = rewind_buffer_length(seconds);
+}
+
+void GB_update_rewind_length(GB_gameboy_t *gb, double seconds)
+{
+    if (gb->rewind_buffer_length == rewind_buffer_length(seconds)) return;
+    GB_set_rewind_length(gb, seconds);
 }
 
 void GB_rewind_invalidate_for_backstepping(GB_gameboy_t *gb)
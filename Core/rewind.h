@@ -7,6 +7,10 @@
 #ifdef GB_INTERNAL
 internal void GB_rewind_push(GB_gameboy_t *gb);
 internal void GB_rewind_invalidate_for_backstepping(GB_gameboy_t *gb);
+/* Like GB_rewind_reset, but keeps the sequence buffer for reuse */
+internal void GB_rewind_clear(GB_gameboy_t *gb);
+/* Like GB_set_rewind_length, but keeps the sequence buffer and its history if the length doesn't change */
+internal void GB_update_rewind_length(GB_gameboy_t *gb, double seconds);
 #endif
 bool GB_rewind_pop(GB_gameboy_t *gb);
 void GB_set_rewind_length(GB_gameboy_t *gb, double seconds);
@@ -477,6 +477,8 @@ static void sanitize_state(GB_gameboy_t *gb)
     }
     GB_update_clock_rate(gb);
     
+    gb->camera_image_valid = false;
+    GB_invalidate_tile_rows(gb);
     if (gb->camera_update_request_callback) {
         GB_camera_updated(gb);
     }
@@ -1420,6 +1422,7 @@ static int load_state_internal(GB_gameboy_t *gb, virtual_file_t *file)
     /* Fix for 0.11 save states that allocate twice the amount of RAM in CGB instances */
     file->seek(file, save.ram_size - gb->ram_size, SEEK_CUR);
     
+    GB_invalidate_tile_rows(gb);
     if (file->read(file, gb->vram, gb->vram_size) != gb->vram_size) {
         return errno ?: EIO;
     }
@@ -1604,3 +1607,296 @@ exit:
     fclose(f);
     return ret;
 }
+
+/* Unsaved fields that still change while emulating, and must roll back with a snapshot. Caches derived from saved
+   data are included as well, as copying them is cheaper than recreating them. */
+#define SNAPSHOT_FIELD(field) {offsetof(GB_gameboy_t, field), sizeof(((GB_gameboy_t *)NULL)->field)}
+static const struct {
+    size_t offset;
+    size_t size;
+} snapshot_fields[] = {
+    SNAPSHOT_FIELD(pending_cycles),
+    SNAPSHOT_FIELD(background_palettes_rgb),
+    SNAPSHOT_FIELD(object_palettes_rgb),
+    SNAPSHOT_FIELD(decoded_tile_rows),
+    SNAPSHOT_FIELD(decoded_tile_rows_valid),
+    SNAPSHOT_FIELD(vram_directly_accessed),
+    SNAPSHOT_FIELD(keys),
+    SNAPSHOT_FIELD(camera_noise_seed),
+    SNAPSHOT_FIELD(camera_image_valid),
+    SNAPSHOT_FIELD(camera_image),
+    SNAPSHOT_FIELD(joyp_accessed),
+    SNAPSHOT_FIELD(joypad_is_stable),
+    SNAPSHOT_FIELD(cycles_since_last_sync),
+    SNAPSHOT_FIELD(clock_rate),
+    SNAPSHOT_FIELD(unmultiplied_clock_rate),
+    SNAPSHOT_FIELD(apu_output.sample_cycles),
+    SNAPSHOT_FIELD(apu_output.cycles_since_render),
+    SNAPSHOT_FIELD(apu_output.last_update),
+    SNAPSHOT_FIELD(apu_output.current_sample),
+    SNAPSHOT_FIELD(apu_output.summed_samples),
+    SNAPSHOT_FIELD(apu_output.dac_discharge),
+    SNAPSHOT_FIELD(apu_output.edge_triggered),
+    SNAPSHOT_FIELD(apu_output.highpass_diff),
+    SNAPSHOT_FIELD(apu_output.interference_highpass),
+    SNAPSHOT_FIELD(apu_output.square_sweep_disable_stepping),
+    SNAPSHOT_FIELD(sgb_intro_jingle_phases),
+    SNAPSHOT_FIELD(sgb_intro_sweep_phase),
+    SNAPSHOT_FIELD(sgb_intro_sweep_previous_sample),
+    SNAPSHOT_FIELD(rumble_on_cycles),
+    SNAPSHOT_FIELD(rumble_off_cycles),
+    SNAPSHOT_FIELD(wx_just_changed),
+    SNAPSHOT_FIELD(tile_sel_glitch),
+};
+#undef SNAPSHOT_FIELD
+
+size_t GB_get_snapshot_size(GB_gameboy_t *gb)
+{
+    size_t ret = GB_SECTION_OFFSET(unsaved);
+    for (unsigned i = 0; i < sizeof(snapshot_fields) / sizeof(snapshot_fields[0]); i++) {
+        ret += snapshot_fields[i].size;
+    }
+    return ret
+    + (gb->sgb? sizeof(*gb->sgb) : 0)
+    + gb->mbc_ram_size
+    + gb->ram_size
+    + gb->vram_size;
+}
+
+void GB_take_snapshot(GB_gameboy_t *gb, void *buffer)
+{
+    GB_ASSERT_NOT_RUNNING(gb)
+    uint8_t *out = buffer;
+    
+    memcpy(out, gb, GB_SECTION_OFFSET(unsaved));
+    out += GB_SECTION_OFFSET(unsaved);
+    for (unsigned i = 0; i < sizeof(snapshot_fields) / sizeof(snapshot_fields[0]); i++) {
+        memcpy(out, (uint8_t *)gb + snapshot_fields[i].offset, snapshot_fields[i].size);
+        out += snapshot_fields[i].size;
+    }
+    if (gb->sgb) {
+        memcpy(out, gb->sgb, sizeof(*gb->sgb));
+        out += sizeof(*gb->sgb);
+    }
+    if (gb->mbc_ram_size) {
+        memcpy(out, gb->mbc_ram, gb->mbc_ram_size);
+        out += gb->mbc_ram_size;
+    }
+    memcpy(out, gb->ram, gb->ram_size);
+    out += gb->ram_size;
+    memcpy(out, gb->vram, gb->vram_size);
+}
+
+void GB_restore_snapshot(GB_gameboy_t *gb, const void *buffer)
+{
+    GB_ASSERT_NOT_RUNNING(gb)
+    const uint8_t *in = buffer;
+    
+    memcpy(gb, in, GB_SECTION_OFFSET(unsaved));
+    in += GB_SECTION_OFFSET(unsaved);
+    for (unsigned i = 0; i < sizeof(snapshot_fields) / sizeof(snapshot_fields[0]); i++) {
+        memcpy((uint8_t *)gb + snapshot_fields[i].offset, in, snapshot_fields[i].size);
+        in += snapshot_fields[i].size;
+    }
+    if (gb->sgb) {
+        memcpy(gb->sgb, in, sizeof(*gb->sgb));
+        in += sizeof(*gb->sgb);
+    }
+    if (gb->mbc_ram_size) {
+        memcpy(gb->mbc_ram, in, gb->mbc_ram_size);
+        in += gb->mbc_ram_size;
+    }
+    memcpy(gb->ram, in, gb->ram_size);
+    in += gb->ram_size;
+    memcpy(gb->vram, in, gb->vram_size);
+}
+
+void GB_set_speculating(GB_gameboy_t *gb, bool speculating)
+{
+    gb->speculating = speculating;
+}
+
+void GB_restore_foreign_snapshot(GB_gameboy_t *gb, const void *buffer, uint32_t mbc_ram_size)
+{
+    GB_ASSERT_NOT_RUNNING(gb)
+    const uint8_t *in = buffer;
+    
+    /* Everything up to the unsaved section, except for the cartridge's MBC and RTC */
+    size_t mbc_end = GB_SECTION_OFFSET(mbc) + GB_SECTION_SIZE(mbc);
+    size_t rtc_end = GB_SECTION_OFFSET(rtc) + GB_SECTION_SIZE(rtc);
+    memcpy(gb, in, GB_SECTION_OFFSET(mbc));
+    memcpy((uint8_t *)gb + mbc_end, in + mbc_end, GB_SECTION_OFFSET(rtc) - mbc_end);
+    memcpy((uint8_t *)gb + rtc_end, in + rtc_end, GB_SECTION_OFFSET(unsaved) - rtc_end);
+    in += GB_SECTION_OFFSET(unsaved);
+    
+    /* The RGB palettes depend on the instance's own settings, and the keys on its own input */
+    bool keys[sizeof(gb->keys) / sizeof(gb->keys[0][0])];
+    memcpy(keys, gb->keys, sizeof(keys));
+    uint32_t background_palettes_rgb[sizeof(gb->background_palettes_rgb) / sizeof(gb->background_palettes_rgb[0])];
+    uint32_t object_palettes_rgb[sizeof(gb->object_palettes_rgb) / sizeof(gb->object_palettes_rgb[0])];
+    memcpy(background_palettes_rgb, gb->background_palettes_rgb, sizeof(background_palettes_rgb));
+    memcpy(object_palettes_rgb, gb->object_palettes_rgb, sizeof(object_palettes_rgb));
+    for (unsigned i = 0; i < sizeof(snapshot_fields) / sizeof(snapshot_fields[0]); i++) {
+        memcpy((uint8_t *)gb + snapshot_fields[i].offset, in, snapshot_fields[i].size);
+        in += snapshot_fields[i].size;
+    }
+    memcpy(gb->background_palettes_rgb, background_palettes_rgb, sizeof(background_palettes_rgb));
+    memcpy(gb->object_palettes_rgb, object_palettes_rgb, sizeof(object_palettes_rgb));
+    memcpy(gb->keys, keys, sizeof(keys));
+    
+    if (gb->sgb) {
+        memcpy(gb->sgb, in, sizeof(*gb->sgb));
+        in += sizeof(*gb->sgb);
+    }
+    in += mbc_ram_size;
+    memcpy(gb->ram, in, gb->ram_size);
+    in += gb->ram_size;
+    memcpy(gb->vram, in, gb->vram_size);
+    
+    GB_update_clock_rate(gb);
+    for (unsigned i = 0; i < 32; i++) {
+        GB_palette_changed(gb, false, i * 2);
+        GB_palette_changed(gb, true, i * 2);
+    }
+}
+
+#define STATE_HASH_SECTION(section) {#section, GB_SECTION_OFFSET(section), GB_SECTION_SIZE(section)}
+static const struct {
+    const char *name;
+    size_t offset;
+    size_t size;
+} state_hash_sections[] = {
+    STATE_HASH_SECTION(core_state),
+    STATE_HASH_SECTION(dma),
+    STATE_HASH_SECTION(mbc),
+    STATE_HASH_SECTION(hram),
+    STATE_HASH_SECTION(timing),
+    STATE_HASH_SECTION(apu),
+    STATE_HASH_SECTION(rtc),
+    STATE_HASH_SECTION(video),
+    STATE_HASH_SECTION(accessory),
+};
+#undef STATE_HASH_SECTION
+
+#define STATE_HASH_SECTION_COUNT (sizeof(state_hash_sections) / sizeof(state_hash_sections[0]))
+
+static unsigned state_hash_pages(size_t size)
+{
+    return (size + GB_STATE_HASH_PAGE_SIZE - 1) / GB_STATE_HASH_PAGE_SIZE;
+}
+
+/* Hash regions are the saved sections, the SGB state if any, then the pages of cartridge RAM, RAM and VRAM */
+static const uint8_t *state_hash_region(GB_gameboy_t *gb, unsigned index, size_t *size, const char **name, unsigned *page)
+{
+    *page = 0;
+    if (index < STATE_HASH_SECTION_COUNT) {
+        *size = state_hash_sections[index].size;
+        *name = state_hash_sections[index].name;
+        return (uint8_t *)gb + state_hash_sections[index].offset;
+    }
+    index -= STATE_HASH_SECTION_COUNT;
+    
+    if (gb->sgb) {
+        if (index == 0) {
+            *size = sizeof(*gb->sgb);
+            *name = "sgb";
+            return (uint8_t *)gb->sgb;
+        }
+        index--;
+    }
+    
+    const struct {
+        const char *name;
+        uint8_t *data;
+        size_t size;
+    } memories[] = {
+        {"mbc_ram", gb->mbc_ram, gb->mbc_ram_size},
+        {"ram", gb->ram, gb->ram_size},
+        {"vram", gb->vram, gb->vram_size},
+    };
+    
+    for (unsigned i = 0; i < sizeof(memories) / sizeof(memories[0]); i++) {
+        if (index < state_hash_pages(memories[i].size)) {
+            size_t offset = index * GB_STATE_HASH_PAGE_SIZE;
+            *size = memories[i].size - offset;
+            if (*size > GB_STATE_HASH_PAGE_SIZE) {
+                *size = GB_STATE_HASH_PAGE_SIZE;
+            }
+            *name = memories[i].name;
+            *page = index;
+            return memories[i].data + offset;
+        }
+        index -= state_hash_pages(memories[i].size);
+    }
+    
+    *size = 0;
+    *name = NULL;
+    return NULL;
+}
+
+unsigned GB_get_state_hash_count(GB_gameboy_t *gb)
+{
+    return STATE_HASH_SECTION_COUNT
+    + (gb->sgb? 1 : 0)
+    + state_hash_pages(gb->mbc_ram_size)
+    + state_hash_pages(gb->ram_size)
+    + state_hash_pages(gb->vram_size);
+}
+
+void GB_get_state_hashes(GB_gameboy_t *gb, uint32_t *hashes)
+{
+    unsigned count = GB_get_state_hash_count(gb);
+    for (unsigned i = 0; i < count; i++) {
+        size_t size;
+        const char *name;
+        unsigned page;
+        const uint8_t *data = state_hash_region(gb, i, &size, &name, &page);
+        hashes[i] = calc_crc32(size, data);
+    }
+}
+
+/* FxHash-style, which changes with any single differing word */
+static uint64_t hash_state_region(uint64_t hash, const uint8_t *data, size_t size)
+{
+    while (size >= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        hash = (((hash << 5) | (hash >> 59)) ^ word) * 0x517CC1B727220A95;
+        data += sizeof(word);
+        size -= sizeof(word);
+    }
+    while (size--) {
+        hash = (((hash << 5) | (hash >> 59)) ^ *(data++)) * 0x517CC1B727220A95;
+    }
+    return hash;
+}
+
+uint64_t GB_get_state_hash(GB_gameboy_t *gb)
+{
+    uint64_t hash = 0;
+    unsigned count = GB_get_state_hash_count(gb);
+    for (unsigned i = 0; i < count; i++) {
+        size_t size;
+        const char *name;
+        unsigned page;
+        const uint8_t *data = state_hash_region(gb, i, &size, &name, &page);
+        hash = hash_state_region(hash, data, size);
+    }
+    return hash;
+}
+
+void GB_get_state_hash_name(GB_gameboy_t *gb, unsigned index, char *name, size_t size)
+{
+    size_t region_size;
+    const char *region_name;
+    unsigned page;
+    if (!state_hash_region(gb, index, &region_size, &region_name, &page)) {
+        snprintf(name, size, "unknown");
+    }
+    else if (index < STATE_HASH_SECTION_COUNT || strcmp(region_name, "sgb") == 0) {
+        snprintf(name, size, "%s", region_name);
+    }
+    else {
+        snprintf(name, size, "%s page $%x", region_name, page * GB_STATE_HASH_PAGE_SIZE);
+    }
+}
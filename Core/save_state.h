@@ -43,6 +43,32 @@ bool GB_is_save_state(const char *path);
 int GB_get_state_model(const char *path, GB_model_t *model);
 int GB_get_state_model_from_buffer(const uint8_t *buffer, size_t length, GB_model_t *model);
 
+/* Snapshots are fast, in-memory copies of the emulation state, meant for speculative emulation such as run-ahead.
+   Unlike save states, a snapshot may only be restored into the same instance it was taken from, and only before its
+   ROM, model or memory sizes change. Taking and restoring snapshots has no other side effects. */
+size_t GB_get_snapshot_size(GB_gameboy_t *gb);
+/* Assumes buffer is big enough to contain the snapshot. Use with GB_get_snapshot_size(). */
+void GB_take_snapshot(GB_gameboy_t *gb, void *buffer);
+void GB_restore_snapshot(GB_gameboy_t *gb, const void *buffer);
+/* While speculating, such as while running ahead of a snapshot that is going to be restored, the emulation is not
+   synced to real time, no audio samples are output, and rewind and battery saving are paused. */
+void GB_set_speculating(GB_gameboy_t *gb, bool speculating);
+
+/* State hashes are CRC32s of each region of the saved state: its sections, then the SGB state and each page of
+   cartridge RAM, RAM and VRAM. Taking them has no side effects on the emulation, so two runs that should be identical
+   can be compared at any point to find both when and where they diverged. The regions depend only on the model and
+   cartridge, so runs of the same ROM always have the same count. Like the native save state sections, regions are
+   hashed as they're laid out in memory, so hashes are only comparable between builds with the same byte order and
+   bool size. */
+#define GB_STATE_HASH_PAGE_SIZE 0x1000
+unsigned GB_get_state_hash_count(GB_gameboy_t *gb);
+/* Assumes hashes has room for GB_get_state_hash_count() entries */
+void GB_get_state_hashes(GB_gameboy_t *gb, uint32_t *hashes);
+/* Names a region, such as "video" or "ram page $2000" */
+void GB_get_state_hash_name(GB_gameboy_t *gb, unsigned index, char *name, size_t size);
+/* A single hash of all regions, much cheaper than GB_get_state_hashes for checking often whether runs still match */
+uint64_t GB_get_state_hash(GB_gameboy_t *gb);
+
 #ifdef GB_INTERNAL
 static inline uint32_t GB_state_magic(void)
 {
@@ -53,4 +79,8 @@ static inline uint32_t GB_state_magic(void)
 /* For internal in-memory save states (rewind, debugger) that do not need BESS */
 internal size_t GB_get_save_state_size_no_bess(GB_gameboy_t *gb);
 internal void GB_save_state_to_buffer_no_bess(GB_gameboy_t *gb, uint8_t *buffer);
+/* Restores a snapshot taken from another instance of the same model, keeping this instance's own MBC, RTC and cartridge
+   RAM, and its settings-derived caches. mbc_ram_size is the cartridge RAM size of the instance the snapshot was taken
+   from, which it contains. */
+internal void GB_restore_foreign_snapshot(GB_gameboy_t *gb, const void *buffer, uint32_t mbc_ram_size);
 #endif
@@ -863,6 +863,7 @@ static void render_jingle(GB_gameboy_t *gb, size_t count)
     };
     
     assert(gb->apu_output.sample_callback);
+    if (unlikely(gb->speculating)) return;
     
     if (gb->sgb->intro_animation < 0) {
         GB_sample_t sample = {0, 0};
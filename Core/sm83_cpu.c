@@ -1,6 +1,9 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <limits.h>
 #include "gb.h"
 
 
@@ -88,13 +91,35 @@ static const conflict_t sgb_conflict_map[0x80] = {
     [GB_IO_SCX] = GB_CONFLICT_READ_NEW,
 };
 
-static uint8_t cycle_read(GB_gameboy_t *gb, uint16_t addr)
+/* While running a translated block, the data bus decay countdown holds this value until the bus is driven again */
+#define DATA_BUS_UNTOUCHED UINT32_MAX
+
+static void advance_pending_cycles(GB_gameboy_t *gb)
 {
+    if (unlikely(gb->deferring_block)) {
+        /* Only ROM, WRAM and HRAM are accessed, so the time can pass later; only remember when the bus was driven */
+        if (gb->data_bus_decay_countdown != DATA_BUS_UNTOUCHED) {
+            gb->deferred_bus_access = gb->deferred_cycles;
+            gb->data_bus_decay_countdown = DATA_BUS_UNTOUCHED;
+        }
+        gb->deferred_cycles += gb->pending_cycles;
+        return;
+    }
     if (gb->pending_cycles) {
         GB_advance_cycles(gb, gb->pending_cycles);
     }
+}
+
+static bool read_deferring_block(GB_gameboy_t *gb, uint16_t addr, uint8_t *data);
+
+static uint8_t cycle_read(GB_gameboy_t *gb, uint16_t addr)
+{
+    advance_pending_cycles(gb);
     gb->address_bus = addr;
-    uint8_t ret = GB_read_memory(gb, addr);
+    uint8_t ret;
+    if (likely(!gb->deferring_block) || !read_deferring_block(gb, addr, &ret)) {
+        ret = GB_read_memory(gb, addr);
+    }
     gb->pending_cycles = 4;
     return ret;
 }
@@ -135,7 +160,7 @@ static void cycle_write(GB_gameboy_t *gb, uint16_t addr, uint8_t value)
     }
     switch (conflict) {
         case GB_CONFLICT_READ_OLD:
-            GB_advance_cycles(gb, gb->pending_cycles);
+            advance_pending_cycles(gb);
             GB_write_memory(gb, addr, value);
             gb->pending_cycles = 4;
             break;
@@ -328,9 +353,7 @@ static void cycle_no_access(GB_gameboy_t *gb)
 
 static void cycle_oam_bug(GB_gameboy_t *gb, uint8_t register_id)
 {
-    if (gb->pending_cycles) {
-        GB_advance_cycles(gb, gb->pending_cycles);
-    }
+    advance_pending_cycles(gb);
     gb->address_bus = gb->registers[register_id];
     GB_trigger_oam_bug(gb, gb->registers[register_id]); /* Todo: test T-cycle timing */
     gb->pending_cycles = 4;
@@ -1606,6 +1629,606 @@ static opcode_t *opcodes[256] = {
     ld_a_da8,   pop_rr,     ld_a_dc,    di,         ill,        push_rr,    or_a_d8,    rst,        /* fX */
     ld_hl_sp_r8,ld_sp_hl,   ld_a_da16,  ei,         ill,        ill,        cp_a_d8,    rst,
 };
+/* Idle loop detection: recognizes `LDH A, (a8); <test A>; JR cc, loop` polling loops in ROM and fast-forwards through
+   them. Every iteration still performs the actual register read at the right cycle, so the loop exits exactly when it
+   would otherwise, but the ROM fetches are replaced by their (unobservable) side effects on the buses, and each
+   instruction's M-cycles are run with a single call to GB_advance_cycles_coalesced. */
+
+/* How long fast-forwarded code may run before returning to GB_run, in 8MHz units (about one line) */
+#define FAST_FORWARD_MAX_CYCLES 912
+
+/* Returns the length of the A testing instruction at addr, or 0 if it's not a supported one */
+static uint8_t idle_loop_test_length(GB_gameboy_t *gb, uint16_t addr)
+{
+    switch (GB_safe_read_memory(gb, addr)) {
+        case 0xA7: // AND A
+        case 0xB7: // OR A
+            return 1;
+        case 0xE6: // AND d8
+        case 0xFE: // CP d8
+            return 2;
+        case 0xCB: // BIT n, A
+            return (GB_safe_read_memory(gb, addr + 1) & 0xC7) == 0x47? 2 : 0;
+    }
+    return 0;
+}
+
+static bool is_idle_loop(GB_gameboy_t *gb)
+{
+    uint16_t pc = gb->pc;
+    /* Only loops in ROM, which can't modify themselves and can be fetched without side effects */
+    if (pc >= 0x8000 - 6 || !gb->boot_rom_finished) return false;
+    if (GB_safe_read_memory(gb, pc) != 0xF0) return false; // LDH A, (a8)
+    
+    uint8_t test_length = idle_loop_test_length(gb, pc + 2);
+    if (!test_length) return false;
+    
+    uint16_t jr = pc + 2 + test_length;
+    switch (GB_safe_read_memory(gb, jr)) {
+        case 0x20: case 0x28: case 0x30: case 0x38: // JR cc, r8
+            return (int8_t)GB_safe_read_memory(gb, jr + 1) == -(int8_t)(jr + 2 - pc);
+    }
+    return false;
+}
+
+static bool can_fast_forward(GB_gameboy_t *gb)
+{
+    /* Anything that observes or alters individual instructions or memory accesses */
+    if (gb->execution_callback || gb->read_memory_callback || gb->halt_bug || gb->ime_toggle || gb->returned_open_bus) return false;
+#ifndef GB_DISABLE_DEBUGGER
+    if (gb->debug_active || gb->n_watchpoints) return false;
+#endif
+#ifndef GB_DISABLE_REWIND
+    if (gb->backstep_instructions ||
+        (gb->rewind_sequences && gb->rewind_sequences[gb->rewind_pos].key_state)) return false;
+#endif
+#ifndef GB_DISABLE_CHEATS
+    if (gb->cheat_enabled) return false;
+#endif
+    /* Things GB_cpu_run handles between instructions */
+    if (gb->hdma_on || gb->hdma_on_hblank || GB_is_dma_active(gb)) return false;
+    if ((gb->interrupt_enable & 0x10) && gb->ime) return false;
+    return true;
+}
+
+/* Mirrors what GB_run and GB_cpu_run do between two instructions */
+static bool fast_forward_should_break(GB_gameboy_t *gb, unsigned start)
+{
+    if (!(gb->io_registers[GB_IO_IF] & 0x10) && (gb->io_registers[GB_IO_JOYP] & 0x30) != 0x30) {
+        gb->joyp_accessed = true;
+    }
+    return gb->vblank_just_occured || gb->hdma_on ||
+           (gb->ime && (gb->interrupt_enable & gb->io_registers[GB_IO_IF] & 0x1F)) ||
+           gb->cycles_since_run - start >= FAST_FORWARD_MAX_CYCLES;
+}
+
+/* Whether the instruction boundaries inside the next loop iteration or translated block are uneventful, so it can be run
+   as a whole:
+   no interrupt can be dispatched and no vblank can end GB_run. Joypad interrupts can't happen either, as
+   GB_can_coalesce_cycles requires a stable joypad. An interrupt might already be pending if EI just took effect. */
+static bool can_merge_instructions(GB_gameboy_t *gb)
+{
+    if (gb->ime && (gb->interrupt_enable & (0x0E | (gb->io_registers[GB_IO_IF] & 0x1F)))) return false;
+    return (gb->io_registers[GB_IO_LCDC] & GB_LCDC_ENABLE) && gb->current_line < 143 && gb->current_lcd_line < 143;
+}
+
+/* Sets the buses up so that, after the next GB_advance_cycles_coalesced, they look as if data was fetched from addr
+   `delay` cycles into it */
+static void idle_loop_fetch(GB_gameboy_t *gb, uint16_t addr, uint8_t data, uint8_t delay)
+{
+    gb->address_bus = addr;
+    gb->data_bus = data;
+    gb->data_bus_decay_countdown = gb->data_bus_decay;
+    if (gb->data_bus_decay_countdown) {
+        /* GB_advance_cycles decays the data bus in 8MHz units */
+        gb->data_bus_decay_countdown += gb->cgb_double_speed? delay : delay * 2;
+    }
+}
+
+/* The same as GB_cpu_run's run mode, used when an instruction can't be fast-forwarded */
+static void idle_loop_run_instruction(GB_gameboy_t *gb)
+{
+    uint8_t opcode = cycle_read(gb, gb->pc++);
+    opcodes[opcode](gb, opcode);
+    flush_pending_cycles(gb);
+}
+
+static void idle_loop_test(GB_gameboy_t *gb, uint8_t opcode, uint8_t operand)
+{
+    uint8_t a = gb->af >> 8;
+    switch (opcode) {
+        case 0xA7: // AND A
+        case 0xB7: // OR A
+            opcodes[opcode](gb, opcode);
+            return;
+        case 0xCB: // BIT n, A
+            bit_r(gb, operand);
+            return;
+        case 0xE6: // AND d8
+            gb->af = ((a & operand) << 8) | GB_HALF_CARRY_FLAG;
+            if ((a & operand) == 0) {
+                gb->af |= GB_ZERO_FLAG;
+            }
+            return;
+        case 0xFE: // CP d8
+            gb->af &= 0xFF00;
+            gb->af |= GB_SUBTRACT_FLAG;
+            if (a == operand) {
+                gb->af |= GB_ZERO_FLAG;
+            }
+            if ((a & 0xF) < (operand & 0xF)) {
+                gb->af |= GB_HALF_CARRY_FLAG;
+            }
+            if (a < operand) {
+                gb->af |= GB_CARRY_FLAG;
+            }
+            return;
+        nodefault;
+    }
+}
+
+static bool run_idle_loop(GB_gameboy_t *gb)
+{
+    if (gb->pending_cycles || !is_idle_loop(gb) || !can_fast_forward(gb)) return false;
+    
+    uint16_t head = gb->pc;
+    uint8_t address = GB_safe_read_memory(gb, head + 1);
+    uint8_t test_opcode = GB_safe_read_memory(gb, head + 2);
+    uint8_t test_length = test_opcode == 0xA7 || test_opcode == 0xB7? 1 : 2;
+    uint8_t test_operand = GB_safe_read_memory(gb, head + 3);
+    uint16_t jr = head + 2 + test_length;
+    uint8_t jr_opcode = GB_safe_read_memory(gb, jr);
+    uint8_t jr_offset = GB_safe_read_memory(gb, jr + 1);
+    
+    unsigned start = gb->cycles_since_run;
+    while (true) {
+        /* LDH A, (a8) */
+        if (GB_can_coalesce_cycles(gb, 2)) {
+            gb->pc = head + 2;
+            idle_loop_fetch(gb, head + 1, address, 4);
+            GB_advance_cycles_coalesced(gb, 8);
+            gb->address_bus = 0xFF00 | address;
+            gb->af &= 0xFF;
+            gb->af |= GB_read_memory(gb, 0xFF00 | address) << 8;
+            
+            /* If the loop is taken again, run the rest of the iteration in one go */
+            uint16_t af = gb->af;
+            idle_loop_test(gb, test_opcode, test_operand);
+            if (condition_code(gb, jr_opcode) && can_merge_instructions(gb) && GB_can_coalesce_cycles(gb, 4 + test_length)) {
+                gb->pc = head;
+                idle_loop_fetch(gb, jr + 1, jr_offset, 8 + test_length * 4);
+                gb->address_bus = head;
+                GB_advance_cycles_coalesced(gb, 16 + test_length * 4);
+                if (fast_forward_should_break(gb, start)) break;
+                continue;
+            }
+            gb->af = af;
+            GB_advance_cycles(gb, 4);
+        }
+        else {
+            idle_loop_run_instruction(gb);
+        }
+        if (fast_forward_should_break(gb, start)) break;
+        
+        /* The test */
+        if (test_length == 1) {
+            gb->pc = jr;
+            idle_loop_fetch(gb, head + 2, test_opcode, 0);
+            GB_advance_cycles(gb, 4);
+            idle_loop_test(gb, test_opcode, test_operand);
+        }
+        else if (GB_can_coalesce_cycles(gb, 2)) {
+            gb->pc = jr;
+            idle_loop_fetch(gb, head + 3, test_operand, 4);
+            GB_advance_cycles_coalesced(gb, 8);
+            idle_loop_test(gb, test_opcode, test_operand);
+        }
+        else {
+            idle_loop_run_instruction(gb);
+        }
+        if (fast_forward_should_break(gb, start)) break;
+        
+        /* JR cc, r8 */
+        bool taken = condition_code(gb, jr_opcode);
+        if (GB_can_coalesce_cycles(gb, taken? 3 : 2)) {
+            gb->pc = taken? head : jr + 2;
+            idle_loop_fetch(gb, jr + 1, jr_offset, 4);
+            if (taken) {
+                gb->address_bus = head; // From cycle_oam_bug, which can't trigger the bug outside of OAM
+            }
+            GB_advance_cycles_coalesced(gb, taken? 12 : 8);
+        }
+        else {
+            idle_loop_run_instruction(gb);
+        }
+        if (!taken || fast_forward_should_break(gb, start)) break;
+    }
+    GB_PERF_COUNT(gb, idle_loop_cycles, gb->cycles_since_run - start);
+    return true;
+}
+
+void GB_set_idle_loop_detection(GB_gameboy_t *gb, bool enabled)
+{
+    gb->idle_loop_detection = enabled;
+}
+
+bool GB_get_idle_loop_detection(GB_gameboy_t *gb)
+{
+    return gb->idle_loop_detection;
+}
+
+/* Block translation: straight-line ROM code is decoded once into blocks of instructions, cached per ROM bank. Blocks
+   still run through the regular instruction handlers, but they may only access ROM, WRAM and HRAM, which makes
+   the exact time of each access unobservable, so the time they take is advanced in one go once the block is done.
+   What an instruction accesses usually depends on registers, so it's checked right before it runs; if the check fails,
+   the rest of the block is left to the interpreter. ROM can't be modified, so blocks only need to be translated again
+   when a different ROM is loaded.
+   Blocks also keep a copy of their instruction bytes, so while a block's time is deferred, fetching opcodes and
+   operands only needs to drive the buses, rather than going through GB_read_memory. */
+
+#define TRANSLATED_BLOCK_MAX_LENGTH 16
+#define TRANSLATED_BLOCK_COUNT 0x1000
+#define TRANSLATED_BLOCK_EMPTY 0xFFFFFFFF
+#define NO_DEFERRED_BUS_ACCESS UINT_MAX
+
+typedef enum {
+    CHECK_NONE,
+    CHECK_DBC,
+    CHECK_DDE,
+    CHECK_DHL,
+    CHECK_DC,
+    CHECK_PUSH,
+    CHECK_POP,
+    /* INC rr, DEC rr and LD SP, HL, which trigger the OAM bug */
+    CHECK_OAM_BUG_BC,
+    CHECK_OAM_BUG_DE,
+    CHECK_OAM_BUG_HL,
+    CHECK_OAM_BUG_SP,
+} translation_check_t;
+
+typedef struct {
+    opcode_t *handler;
+    uint8_t check;
+    uint8_t m_cycles; // At most, including the opcode fetch
+} translated_instruction_t;
+
+struct GB_translated_block_s {
+    uint32_t key; // ROM bank << 16 | address
+    uint8_t length; // In instructions, 0 if the first instruction can't be translated
+    uint8_t m_cycles; // At most
+    uint8_t size; // In bytes
+    translated_instruction_t instructions[TRANSLATED_BLOCK_MAX_LENGTH];
+    uint8_t bytes[TRANSLATED_BLOCK_MAX_LENGTH * 3];
+};
+
+/* Memory that can be accessed at any point in time with the same result */
+static bool is_plain_ram(uint16_t addr)
+{
+    return (addr >= 0xC000 && addr < 0xE000) || (addr >= 0xFF80 && addr != 0xFFFF);
+}
+
+static uint8_t instruction_length(uint8_t opcode)
+{
+    if ((opcode & 0xCF) == 0x01) return 3; // LD rr, d16
+    if ((opcode & 0xC7) == 0x06) return 2; // LD r, d8
+    if ((opcode & 0xC7) == 0xC6) return 2; // ALU d8
+    switch (opcode) {
+        case 0x08: // LD (a16), SP
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA: // JP (cc), a16
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC: // CALL (cc), a16
+        case 0xEA: case 0xFA: // LD (a16), A / LD A, (a16)
+            return 3;
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // JR (cc), r8
+        case 0xCB:
+        case 0xE0: case 0xF0: // LDH
+        case 0xE8: case 0xF8: // ADD SP, r8 / LD HL, SP+r8
+            return 2;
+    }
+    return 1;
+}
+
+/* Returns the instruction's length, or 0 if it can't be translated */
+static uint8_t translate_instruction(GB_gameboy_t *gb, uint16_t addr, uint16_t region_end,
+                                     translated_instruction_t *instruction, bool *ends_block)
+{
+    uint8_t opcode = GB_safe_read_memory(gb, addr);
+    uint8_t length = instruction_length(opcode);
+    /* Other regions might be banked differently by the time the instruction runs */
+    if (addr + length > region_end) return 0;
+    uint8_t operand = length > 1? GB_safe_read_memory(gb, addr + 1) : 0;
+    uint16_t address = length > 2? operand | GB_safe_read_memory(gb, addr + 2) << 8 : 0;
+    
+    instruction->check = CHECK_NONE;
+    instruction->m_cycles = length;
+    *ends_block = false;
+    
+    if ((opcode & 0xC0) == 0x40 || (opcode & 0xC0) == 0x80) { // LD r, r / ALU r
+        if (opcode == 0x40 || opcode == 0x76) return 0; // Software breakpoint, HALT
+        if ((opcode & 7) == 6 || (opcode & 0xF8) == 0x70) {
+            instruction->check = CHECK_DHL;
+            instruction->m_cycles = 2;
+        }
+        return length;
+    }
+    
+    switch (opcode) {
+        case 0x02: case 0x0A:
+            instruction->check = CHECK_DBC;
+            instruction->m_cycles = 2;
+            break;
+        case 0x12: case 0x1A:
+            instruction->check = CHECK_DDE;
+            instruction->m_cycles = 2;
+            break;
+        case 0x22: case 0x2A: case 0x32: case 0x3A:
+            instruction->check = CHECK_DHL;
+            instruction->m_cycles = 2;
+            break;
+        case 0x03: case 0x13: case 0x23: case 0x33: // INC rr
+        case 0x0B: case 0x1B: case 0x2B: case 0x3B: // DEC rr
+            instruction->check = CHECK_OAM_BUG_BC + (opcode >> 4);
+            instruction->m_cycles = 2;
+            break;
+        case 0x09: case 0x19: case 0x29: case 0x39: // ADD HL, rr
+            instruction->m_cycles = 2;
+            break;
+        case 0x34: case 0x35: case 0x36: // INC (HL), DEC (HL), LD (HL), d8
+            instruction->check = CHECK_DHL;
+            instruction->m_cycles = 3;
+            break;
+        case 0x08:
+            if (!is_plain_ram(address) || !is_plain_ram(address + 1)) return 0;
+            instruction->m_cycles = 5;
+            break;
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+            instruction->m_cycles = 3;
+            *ends_block = true;
+            break;
+        case 0xC0: case 0xC8: case 0xD0: case 0xD8: // RET cc
+            instruction->check = CHECK_POP;
+            instruction->m_cycles = 5;
+            *ends_block = true;
+            break;
+        case 0xC9:
+            instruction->check = CHECK_POP;
+            instruction->m_cycles = 4;
+            *ends_block = true;
+            break;
+        case 0xC1: case 0xD1: case 0xE1: case 0xF1: // POP rr
+            instruction->check = CHECK_POP;
+            instruction->m_cycles = 3;
+            break;
+        case 0xC5: case 0xD5: case 0xE5: case 0xF5: // PUSH rr
+            instruction->check = CHECK_PUSH;
+            instruction->m_cycles = 4;
+            break;
+        case 0xC2: case 0xC3: case 0xCA: case 0xD2: case 0xDA:
+            instruction->m_cycles = 4;
+            *ends_block = true;
+            break;
+        case 0xC4: case 0xCC: case 0xCD: case 0xD4: case 0xDC:
+            instruction->check = CHECK_PUSH;
+            instruction->m_cycles = 6;
+            *ends_block = true;
+            break;
+        case 0xC7: case 0xCF: case 0xD7: case 0xDF: case 0xE7: case 0xEF: case 0xF7: case 0xFF: // RST
+            instruction->check = CHECK_PUSH;
+            instruction->m_cycles = 4;
+            *ends_block = true;
+            break;
+        case 0xCB:
+            if ((operand & 7) == 6) {
+                instruction->check = CHECK_DHL;
+                instruction->m_cycles = (operand & 0xC0) == 0x40? 3 : 4; // BIT n, (HL) doesn't write
+            }
+            break;
+        case 0xE0: case 0xF0:
+            if (!is_plain_ram(0xFF00 | operand)) return 0;
+            instruction->m_cycles = 3;
+            break;
+        case 0xE2: case 0xF2:
+            instruction->check = CHECK_DC;
+            instruction->m_cycles = 2;
+            break;
+        case 0xE8:
+            instruction->m_cycles = 4;
+            break;
+        case 0xF8:
+            instruction->m_cycles = 3;
+            break;
+        case 0xE9:
+            *ends_block = true;
+            break;
+        case 0xF9:
+            instruction->check = CHECK_OAM_BUG_HL;
+            instruction->m_cycles = 2;
+            break;
+        case 0xEA: case 0xFA:
+            if (!is_plain_ram(address)) return 0;
+            instruction->m_cycles = 4;
+            break;
+        /* These interact with interrupts or the rest of the system, or aren't valid instructions */
+        case 0x10: case 0xD9: case 0xFB:
+        case 0xD3: case 0xDB: case 0xDD: case 0xE3: case 0xE4: case 0xEB: case 0xEC: case 0xED: case 0xF4: case 0xFC: case 0xFD:
+            return 0;
+    }
+    return length;
+}
+
+static void translate_block(GB_gameboy_t *gb, struct GB_translated_block_s *block, uint16_t addr)
+{
+    uint16_t region_end = addr < 0x4000? 0x4000 : 0x8000;
+    bool ends_block = false;
+    block->length = 0;
+    block->m_cycles = 0;
+    block->size = 0;
+    while (block->length < TRANSLATED_BLOCK_MAX_LENGTH && !ends_block && addr < region_end) {
+        translated_instruction_t *instruction = &block->instructions[block->length];
+        uint8_t length = translate_instruction(gb, addr, region_end, instruction, &ends_block);
+        if (!length) break;
+        for (unsigned i = 0; i < length; i++) {
+            block->bytes[block->size++] = GB_safe_read_memory(gb, addr++);
+        }
+        instruction->handler = opcodes[block->bytes[block->size - length]];
+        block->m_cycles += instruction->m_cycles;
+        block->length++;
+    }
+}
+
+static const struct GB_translated_block_s *get_translated_block(GB_gameboy_t *gb)
+{
+    uint16_t pc = gb->pc;
+    if (pc >= 0x8000 || !gb->boot_rom_finished) return NULL;
+    uint16_t bank = pc < 0x4000? gb->mbc_rom0_bank : gb->mbc_rom_bank;
+    uint32_t key = bank << 16 | pc;
+    struct GB_translated_block_s *block = &gb->translated_blocks[(pc ^ (bank << 5)) & (TRANSLATED_BLOCK_COUNT - 1)];
+    if (unlikely(block->key != key)) {
+        translate_block(gb, block, pc);
+        block->key = key;
+    }
+    return block->length? block : NULL;
+}
+
+static bool check_instruction(GB_gameboy_t *gb, translation_check_t check)
+{
+    switch (check) {
+        case CHECK_NONE: return true;
+        case CHECK_DBC: return is_plain_ram(gb->bc);
+        case CHECK_DDE: return is_plain_ram(gb->de);
+        case CHECK_DHL: return is_plain_ram(gb->hl);
+        case CHECK_DC: return is_plain_ram(0xFF00 | (gb->bc & 0xFF));
+        case CHECK_PUSH: return is_plain_ram(gb->sp - 1) && is_plain_ram(gb->sp - 2);
+        case CHECK_POP: return is_plain_ram(gb->sp) && is_plain_ram(gb->sp + 1);
+        case CHECK_OAM_BUG_BC:
+        case CHECK_OAM_BUG_DE:
+        case CHECK_OAM_BUG_HL:
+        case CHECK_OAM_BUG_SP:
+            return (gb->registers[GB_REGISTER_BC + check - CHECK_OAM_BUG_BC] & 0xFF00) != 0xFE00;
+        nodefault;
+    }
+    return false;
+}
+
+/* The same as GB_read_memory for the block's own bytes, which are in ROM. can_fast_forward already made sure nothing
+   watches or alters these reads, and DMA can't start while time is deferred. */
+static bool read_deferring_block(GB_gameboy_t *gb, uint16_t addr, uint8_t *data)
+{
+    const struct GB_translated_block_s *block = gb->deferring_block;
+    uint16_t offset = addr - (uint16_t)block->key;
+    if (offset >= block->size) return false;
+    *data = gb->data_bus = block->bytes[offset];
+    gb->data_bus_decay_countdown = gb->data_bus_decay;
+    return true;
+}
+
+static void defer_cycles(GB_gameboy_t *gb, const struct GB_translated_block_s *block)
+{
+    gb->deferring_block = block;
+    gb->deferred_cycles = 0;
+    gb->deferred_bus_access = NO_DEFERRED_BUS_ACCESS;
+    gb->deferred_data_bus_decay_countdown = gb->data_bus_decay_countdown;
+    gb->data_bus_decay_countdown = DATA_BUS_UNTOUCHED;
+}
+
+static void flush_deferred_cycles(GB_gameboy_t *gb)
+{
+    gb->deferring_block = NULL;
+    if (gb->data_bus_decay_countdown != DATA_BUS_UNTOUCHED) {
+        gb->deferred_bus_access = gb->deferred_cycles;
+    }
+    if (gb->deferred_bus_access == NO_DEFERRED_BUS_ACCESS) {
+        gb->data_bus_decay_countdown = gb->deferred_data_bus_decay_countdown;
+    }
+    else {
+        /* Make the bus decay as if the cycles before the last access already passed */
+        gb->data_bus_decay_countdown = gb->data_bus_decay;
+        if (gb->data_bus_decay_countdown) {
+            gb->data_bus_decay_countdown += gb->cgb_double_speed? gb->deferred_bus_access : gb->deferred_bus_access * 2;
+        }
+    }
+    if (gb->deferred_cycles) {
+        GB_advance_cycles_coalesced(gb, gb->deferred_cycles);
+    }
+    /* The last call's length is observable through dma_cycles */
+    flush_pending_cycles(gb);
+}
+
+/* Returns whether the next block may run right away */
+static bool run_translated_block(GB_gameboy_t *gb, const struct GB_translated_block_s *block, unsigned start)
+{
+    bool merge = can_merge_instructions(gb) && GB_can_coalesce_cycles(gb, block->m_cycles);
+    if (merge) {
+        defer_cycles(gb, block);
+    }
+    for (unsigned i = 0; i < block->length; i++) {
+        const translated_instruction_t *instruction = &block->instructions[i];
+        if (!check_instruction(gb, instruction->check)) {
+            if (merge) {
+                flush_deferred_cycles(gb);
+            }
+            return false;
+        }
+        
+        /* Otherwise, the instruction boundaries are handled like in GB_cpu_run, but each instruction is still
+           advanced as a whole if possible */
+        bool coalesce = !merge && GB_can_coalesce_cycles(gb, instruction->m_cycles);
+        if (coalesce) {
+            defer_cycles(gb, block);
+        }
+        uint8_t opcode = cycle_read(gb, gb->pc++);
+        instruction->handler(gb, opcode);
+        if (!merge) {
+            if (coalesce) {
+                flush_deferred_cycles(gb);
+            }
+            else {
+                flush_pending_cycles(gb);
+            }
+            if (fast_forward_should_break(gb, start)) return false;
+        }
+    }
+    if (merge) {
+        flush_deferred_cycles(gb);
+        return !fast_forward_should_break(gb, start);
+    }
+    return true;
+}
+
+static bool run_translated_blocks(GB_gameboy_t *gb)
+{
+    /* Callbacks could observe memory or the rest of the system while time is being deferred */
+    if (gb->pending_cycles || gb->write_memory_callback || gb->lcd_line_callback || !can_fast_forward(gb)) return false;
+    
+    unsigned start = gb->cycles_since_run;
+    const struct GB_translated_block_s *block;
+    while ((block = get_translated_block(gb)) && run_translated_block(gb, block, start));
+    if (gb->cycles_since_run == start) return false;
+    GB_PERF_COUNT(gb, translated_cycles, gb->cycles_since_run - start);
+    return true;
+}
+
+void GB_invalidate_translated_blocks(GB_gameboy_t *gb)
+{
+    if (!gb->translated_blocks) return;
+    for (unsigned i = 0; i < TRANSLATED_BLOCK_COUNT; i++) {
+        gb->translated_blocks[i].key = TRANSLATED_BLOCK_EMPTY;
+    }
+}
+
+void GB_set_block_translation(GB_gameboy_t *gb, bool enabled)
+{
+    if (enabled && !gb->translated_blocks) {
+        gb->translated_blocks = malloc(sizeof(gb->translated_blocks[0]) * TRANSLATED_BLOCK_COUNT);
+        GB_invalidate_translated_blocks(gb);
+    }
+    gb->block_translation = enabled;
+}
+
+bool GB_get_block_translation(GB_gameboy_t *gb)
+{
+    return gb->block_translation;
+}
+
 void GB_cpu_run(GB_gameboy_t *gb)
 {
     if (unlikely(gb->stopped)) {
@@ -1704,6 +2327,12 @@ void GB_cpu_run(GB_gameboy_t *gb)
     }
     /* Run mode */
     else if (!gb->halted) {
+        if (unlikely(gb->idle_loop_detection) && run_idle_loop(gb)) {
+            return;
+        }
+        if (unlikely(gb->block_translation) && run_translated_blocks(gb)) {
+            return;
+        }
         uint8_t opcode = cycle_read(gb, gb->pc++);
         if (unlikely(gb->hdma_on)) {
             GB_hdma_run(gb);
@@ -1,10 +1,20 @@
 #pragma once
 #include "defs.h"
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifndef GB_DISABLE_DEBUGGER
 void GB_cpu_disassemble(GB_gameboy_t *gb, uint16_t pc, uint16_t count);
 #endif
+/* Runs LDH A, (a8) polling loops in one go; this makes GB_run return less often but doesn't affect emulation */
+void GB_set_idle_loop_detection(GB_gameboy_t *gb, bool enabled);
+bool GB_get_idle_loop_detection(GB_gameboy_t *gb);
+/* Runs straight-line ROM code a block at a time, with fewer timing updates; like idle loop detection, this makes
+   GB_run return less often but doesn't affect emulation. Blocks are translated again after resets and ROM loads, so
+   frontends that patch the ROM in place should reset afterwards. */
+void GB_set_block_translation(GB_gameboy_t *gb, bool enabled);
+bool GB_get_block_translation(GB_gameboy_t *gb);
 #ifdef GB_INTERNAL
 internal void GB_cpu_run(GB_gameboy_t *gb);
+internal void GB_invalidate_translated_blocks(GB_gameboy_t *gb);
 #endif
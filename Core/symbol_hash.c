@@ -2,8 +2,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <sys/types.h>
 
+/* Returns the first symbol with the given key, or where it would be inserted. Symbols added later go before existing
+   ones with the same key, so the last definition takes precedence. */
 static size_t map_find_symbol_index(GB_symbol_map_t *map, uint16_t addr, bool is_local)
 {
     if (!map->symbols) {
@@ -13,8 +16,7 @@ static size_t map_find_symbol_index(GB_symbol_map_t *map, uint16_t addr, bool is
     ssize_t max = map->n_symbols;
     while (min < max) {
         size_t pivot = (min + max) / 2;
-        if (map->symbols[pivot].addr == addr && map->symbols[pivot].is_local == is_local) return pivot;
-        if ((map->symbols[pivot].addr * 2 + !map->symbols[pivot].is_local) > (addr * 2 + !is_local)) {
+        if ((map->symbols[pivot].addr * 2 + !map->symbols[pivot].is_local) >= (addr * 2 + !is_local)) {
             max = pivot;
         }
         else {
@@ -24,7 +26,61 @@ static size_t map_find_symbol_index(GB_symbol_map_t *map, uint16_t addr, bool is
     return (size_t) min;
 }
 
-GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, const char *name)
+struct GB_symbol_arena_block_s {
+    GB_symbol_arena_block_t *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+#define ARENA_BLOCK_SIZE 0x10000
+
+void *GB_arena_alloc(GB_symbol_arena_t *arena, size_t size)
+{
+    size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    GB_symbol_arena_block_t *block = arena->blocks;
+    if (!block || block->size - block->used < size) {
+        size_t block_size = MAX(size, ARENA_BLOCK_SIZE);
+        block = malloc(sizeof(*block) + block_size);
+        block->size = block_size;
+        block->used = 0;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    void *ret = (uint8_t *)block->data + block->used;
+    block->used += size;
+    return ret;
+}
+
+char *GB_arena_strdup(GB_symbol_arena_t *arena, const char *string)
+{
+    size_t size = strlen(string) + 1;
+    return memcpy(GB_arena_alloc(arena, size), string, size);
+}
+
+/* Keeps the most recent block around for the next batch of symbols */
+void GB_arena_reset(GB_symbol_arena_t *arena)
+{
+    GB_symbol_arena_block_t *block = arena->blocks;
+    if (!block) return;
+    while (block->next) {
+        GB_symbol_arena_block_t *next = block->next->next;
+        free(block->next);
+        block->next = next;
+    }
+    block->used = 0;
+}
+
+void GB_arena_free(GB_symbol_arena_t *arena)
+{
+    while (arena->blocks) {
+        GB_symbol_arena_block_t *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+}
+
+GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, char *name)
 {
     bool is_local = strchr(name, '.');
     size_t index = map_find_symbol_index(map, addr, is_local);
@@ -32,12 +88,37 @@ GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, const c
     map->symbols = realloc(map->symbols, (map->n_symbols + 1) * sizeof(map->symbols[0]));
     memmove(&map->symbols[index + 1], &map->symbols[index], (map->n_symbols - index) * sizeof(map->symbols[0]));
     map->symbols[index].addr = addr;
-    map->symbols[index].name = strdup(name);
+    map->symbols[index].name = name;
     map->symbols[index].is_local = is_local;
     map->n_symbols++;
     return &map->symbols[index];
 }
 
+int GB_map_compare_symbols(const GB_bank_symbol_t *a, const GB_bank_symbol_t *b)
+{
+    return (a->addr * 2 + !a->is_local) - (b->addr * 2 + !b->is_local);
+}
+
+void GB_map_add_symbols(GB_symbol_map_t *map, const GB_bank_symbol_t *symbols, size_t count)
+{
+    if (!count) return;
+    size_t old_count = map->n_symbols;
+    map->n_symbols += count;
+    map->symbols = realloc(map->symbols, map->n_symbols * sizeof(map->symbols[0]));
+
+    /* Merge from the end, new symbols go before existing ones with the same key, like GB_map_add_symbol */
+    GB_bank_symbol_t *old = map->symbols;
+    size_t i = old_count, j = count, k = map->n_symbols;
+    while (j) {
+        if (i && GB_map_compare_symbols(&old[i - 1], &symbols[j - 1]) >= 0) {
+            map->symbols[--k] = old[--i];
+        }
+        else {
+            map->symbols[--k] = symbols[--j];
+        }
+    }
+}
+
 const GB_bank_symbol_t *GB_map_find_symbol(GB_symbol_map_t *map, uint16_t addr, bool prefer_local)
 {
     if (!map) return NULL;
@@ -63,10 +144,7 @@ GB_symbol_map_t *GB_map_alloc(void)
 
 void GB_map_free(GB_symbol_map_t *map)
 {
-    for (unsigned i = 0; i < map->n_symbols; i++) {
-        free(map->symbols[i].name);
-    }
-
+    /* Names are owned by the symbol arena */
     if (map->symbols) {
         free(map->symbols);
     }
@@ -88,10 +166,10 @@ static unsigned hash_name(const char *name)
     return r;
 }
 
-void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, uint16_t bank, GB_bank_symbol_t *bank_symbol)
+void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, GB_symbol_arena_t *arena, uint16_t bank, const GB_bank_symbol_t *bank_symbol)
 {
     unsigned hash = hash_name(bank_symbol->name);
-    GB_symbol_t *symbol = malloc(sizeof(*symbol));
+    GB_symbol_t *symbol = GB_arena_alloc(arena, sizeof(*symbol));
     symbol->name = bank_symbol->name;
     symbol->addr = bank_symbol->addr;
     symbol->bank = bank;
@@ -99,6 +177,12 @@ void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, uint16_t bank, GB
     map->buckets[hash] = symbol;
 }
 
+void GB_reversed_map_clear(GB_reversed_symbol_map_t *map)
+{
+    /* Entries are owned by the symbol arena */
+    memset(map->buckets, 0, sizeof(map->buckets));
+}
+
 const GB_symbol_t *GB_reversed_map_find_symbol(GB_reversed_symbol_map_t *map, const char *name)
 {
     unsigned hash = hash_name(name);
@@ -27,10 +27,25 @@ typedef struct {
     GB_symbol_t *buckets[0x2000];
 } GB_reversed_symbol_map_t;
 
+/* Backing storage for symbol names and reversed map entries, released all at once */
+typedef struct GB_symbol_arena_block_s GB_symbol_arena_block_t;
+typedef struct {
+    GB_symbol_arena_block_t *blocks;
+} GB_symbol_arena_t;
+
 #ifdef GB_INTERNAL
-internal void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, uint16_t bank, GB_bank_symbol_t *symbol);
+internal void *GB_arena_alloc(GB_symbol_arena_t *arena, size_t size);
+internal char *GB_arena_strdup(GB_symbol_arena_t *arena, const char *string);
+internal void GB_arena_reset(GB_symbol_arena_t *arena);
+internal void GB_arena_free(GB_symbol_arena_t *arena);
+internal void GB_reversed_map_add_symbol(GB_reversed_symbol_map_t *map, GB_symbol_arena_t *arena, uint16_t bank, const GB_bank_symbol_t *symbol);
+internal void GB_reversed_map_clear(GB_reversed_symbol_map_t *map);
 internal const GB_symbol_t *GB_reversed_map_find_symbol(GB_reversed_symbol_map_t *map, const char *name);
-internal GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, const char *name);
+/* name must outlive the map, i.e. be allocated from the symbol arena */
+internal GB_bank_symbol_t *GB_map_add_symbol(GB_symbol_map_t *map, uint16_t addr, char *name);
+/* symbols must be sorted by GB_map_compare_symbols, among equal keys the first one takes precedence */
+internal void GB_map_add_symbols(GB_symbol_map_t *map, const GB_bank_symbol_t *symbols, size_t count);
+internal int GB_map_compare_symbols(const GB_bank_symbol_t *a, const GB_bank_symbol_t *b);
 internal const GB_bank_symbol_t *GB_map_find_symbol(GB_symbol_map_t *map, uint16_t addr, bool prefer_local);
 internal GB_symbol_map_t *GB_map_alloc(void);
 internal void GB_map_free(GB_symbol_map_t *map);
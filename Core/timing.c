@@ -45,6 +45,7 @@ bool GB_timing_sync_turbo(GB_gameboy_t *gb)
 #ifndef GB_DISABLE_DEBUGGER
     if (unlikely(gb->backstep_instructions)) return false;
 #endif
+    if (unlikely(gb->speculating)) return false;
     if (!gb->turbo_dont_skip) {
         int64_t nanoseconds = get_nanoseconds();
         if (nanoseconds <= gb->last_sync + (1000000000LL * LCDC_PERIOD / GB_get_clock_rate(gb))) {
@@ -60,6 +61,8 @@ void GB_timing_sync(GB_gameboy_t *gb)
 #ifndef GB_DISABLE_DEBUGGER
     if (unlikely(gb->backstep_instructions)) return;
 #endif
+    /* Speculative frames are thrown away, they should run as fast as possible */
+    if (unlikely(gb->speculating)) return;
     /* Prevent syncing if not enough time has passed.*/
     if (gb->cycles_since_last_sync < LCDC_PERIOD / 3) return;
 
@@ -76,6 +79,7 @@ void GB_timing_sync(GB_gameboy_t *gb)
     int64_t time_to_sleep = target_nanoseconds + gb->last_sync - nanoseconds;
     if (time_to_sleep > 0 && time_to_sleep < LCDC_PERIOD * 1200000000LL / GB_get_clock_rate(gb)) { // +20% to be more forgiving
         nsleep(time_to_sleep);
+        GB_PERF_COUNT(gb, timing_sleeps, 1);
         gb->last_sync += target_nanoseconds;
     }
     else {
@@ -104,6 +108,7 @@ void GB_timing_sync(GB_gameboy_t *gb)
 #ifndef GB_DISABLE_DEBUGGER
     if (unlikely(gb->backstep_instructions)) return;
 #endif
+    if (unlikely(gb->speculating)) return;
     if (gb->cycles_since_last_sync < LCDC_PERIOD / 3) return;
     gb->cycles_since_last_sync = 0;
 
@@ -121,14 +126,34 @@ void GB_timing_sync(GB_gameboy_t *gb)
 #define IR_THRESHOLD 240
 #define IR_MAX IR_THRESHOLD * 2 + IR_DECAY + 268
 
+static bool has_ir(GB_gameboy_t *gb)
+{
+    return (gb->model <= GB_MODEL_CGB_E && gb->cgb_mode) || gb->cartridge_type->mbc_type == GB_HUC1 || gb->cartridge_type->mbc_type == GB_HUC3;
+}
+
+static bool ir_is_sensing(GB_gameboy_t *gb)
+{
+    return (gb->io_registers[GB_IO_RP] & 0xC0) == 0xC0 ||
+           (gb->cartridge_type->mbc_type == GB_HUC1 && gb->huc1.ir_mode) ||
+           (gb->cartridge_type->mbc_type == GB_HUC3 && gb->huc3.mode == 0xE);
+}
+
+bool GB_is_sensing_infrared(GB_gameboy_t *gb)
+{
+    return has_ir(gb) && ir_is_sensing(gb);
+}
+
+static bool ir_has_input(GB_gameboy_t *gb)
+{
+    return gb->infrared_input || gb->cart_ir || (gb->io_registers[GB_IO_RP] & 1);
+}
+
 static void ir_run(GB_gameboy_t *gb, uint32_t cycles)
 {
     /* TODO: the way this thing works makes the CGB IR port behave inaccurately when used together with HUC1/3 IR ports*/
-    if ((gb->model > GB_MODEL_CGB_E || !gb->cgb_mode) && gb->cartridge_type->mbc_type != GB_HUC1 && gb->cartridge_type->mbc_type != GB_HUC3) return;
-    bool is_sensing = (gb->io_registers[GB_IO_RP] & 0xC0) == 0xC0 ||
-                       (gb->cartridge_type->mbc_type == GB_HUC1 && gb->huc1.ir_mode) ||
-                       (gb->cartridge_type->mbc_type == GB_HUC3 && gb->huc3.mode == 0xE);
-    if (is_sensing && (gb->infrared_input || gb->cart_ir || (gb->io_registers[GB_IO_RP] & 1))) {
+    if (!has_ir(gb)) return;
+    bool is_sensing = ir_is_sensing(gb);
+    if (is_sensing && ir_has_input(gb)) {
         gb->ir_sensor += cycles;
         if (gb->ir_sensor > IR_MAX) {
             gb->ir_sensor = IR_MAX;
@@ -442,8 +467,7 @@ void GB_advance_cycles(GB_gameboy_t *gb, uint8_t cycles)
     // Affected by speed boost
     gb->dma_cycles = cycles;
 
-    timers_run(gb, cycles);
-    camera_run(gb, cycles);
+    GB_PERF_TIME(gb, GB_PERF_TIMERS, timers_run(gb, cycles); camera_run(gb, cycles));
 
     if (unlikely(gb->speed_switch_halt_countdown)) {
         gb->speed_switch_halt_countdown -= cycles;
@@ -494,14 +518,54 @@ void GB_advance_cycles(GB_gameboy_t *gb, uint8_t cycles)
         }
     }
     
-    GB_joypad_run(gb, cycles);
-    GB_apu_run(gb, false);
-    GB_display_run(gb, cycles, false);
+    GB_PERF_TIME(gb, GB_PERF_TIMERS, GB_joypad_run(gb, cycles));
+    GB_PERF_TIME(gb, GB_PERF_APU, GB_apu_run(gb, false));
+    GB_PERF_TIME(gb, GB_PERF_DISPLAY, GB_display_run(gb, cycles, false));
     if (unlikely(!gb->stopped)) { // TODO: Verify what happens in STOP mode
-        GB_dma_run(gb);
+        GB_PERF_TIME(gb, GB_PERF_DMA, GB_dma_run(gb));
     }
-    ir_run(gb, cycles);
-    rtc_run(gb, cycles);
+    GB_PERF_TIME(gb, GB_PERF_MISC, ir_run(gb, cycles); rtc_run(gb, cycles));
+}
+
+/* Whether running the next m_cycles M-cycles in one call to GB_advance_cycles leaves every component in the same
+   state as running them one by one */
+bool GB_can_coalesce_cycles(GB_gameboy_t *gb, unsigned m_cycles)
+{
+    if (gb->stopped || gb->speed_switch_countdown || gb->speed_switch_freeze || gb->speed_switch_halt_countdown) return false;
+    /* A pending HDMA would have to start between M-cycles, unless the caller is that HDMA */
+    if (GB_is_dma_active(gb) || (gb->hdma_on && !gb->hdma_in_progress) || !gb->joypad_is_stable) return false;
+    /* cycles_since_vblank_callback is counted per call, so a chunk must not contain a vblank callback */
+    if (gb->io_registers[GB_IO_LCDC] & GB_LCDC_ENABLE) {
+        if (gb->current_line == 143 || gb->current_line == 144 || gb->current_lcd_line == 143) return false;
+    }
+    else if (gb->cycles_since_vblank_callback + m_cycles * 8 >= LCDC_PERIOD ||
+             gb->display_cycles + (signed)m_cycles * 8 > 0) return false; // The LCD-off vblank fires when the PPU wakes up
+    /* GB_display_run cuts lines that appear to be too long based on the length of each call; 456 is LINE_LENGTH */
+    if ((gb->io_registers[GB_IO_LCDC] & GB_LCDC_ENABLE) &&
+        (signed)(gb->cycles_for_line * 2 + gb->display_cycles + m_cycles * 8) > 456 * 2) return false;
+    /* Rumble is sampled once per call, and reported on vblank */
+    if (gb->cartridge_type->has_rumble || (gb->rumble_callback && gb->rumble_mode == GB_RUMBLE_ALL_GAMES)) return false;
+    /* The IR sensor saturates differently while warming up or decaying */
+    if (has_ir(gb) && !(ir_is_sensing(gb) && ir_has_input(gb)) && gb->ir_sensor != (ir_is_sensing(gb)? IR_WARMUP : 0)) return false;
+    /* DIV events may start sweep calculations, which need the APU to run on every M-cycle */
+    uint16_t apu_bit = gb->cgb_double_speed? 0x2000 : 0x1000;
+    if ((gb->div_counter & (apu_bit - 1)) + (m_cycles + 1) * 4 >= apu_bit) return false;
+    return GB_apu_is_lazy_for(gb, m_cycles - 1);
+}
+
+void GB_advance_cycles_coalesced(GB_gameboy_t *gb, unsigned cycles)
+{
+    /* GB_advance_cycles doubles cycles into a uint8_t in single speed mode */
+    unsigned skipped_calls = cycles / 4;
+    while (cycles) {
+        uint8_t chunk = MIN(cycles, 124);
+        GB_advance_cycles(gb, chunk);
+        cycles -= chunk;
+        skipped_calls--;
+    }
+    gb->dma_cycles = 4;
+    gb->rumble_on_cycles += (gb->rumble_strength & 3) * skipped_calls;
+    gb->rumble_off_cycles += ((gb->rumble_strength & 3) ^ 3) * skipped_calls;
 }
 
 /* 
@@ -15,12 +15,18 @@ void GB_set_rtc_multiplier(GB_gameboy_t *gb, double multiplier);
 
 #ifdef GB_INTERNAL
 internal void GB_advance_cycles(GB_gameboy_t *gb, uint8_t cycles);
+/* GB_advance_cycles_coalesced is the same as one GB_advance_cycles(gb, 4) per M-cycle, but only valid if
+   GB_can_coalesce_cycles, and if the CPU does nothing but access ROM, WRAM and HRAM during these cycles. */
+internal bool GB_can_coalesce_cycles(GB_gameboy_t *gb, unsigned m_cycles);
+internal void GB_advance_cycles_coalesced(GB_gameboy_t *gb, unsigned cycles);
 internal void GB_emulate_timer_glitch(GB_gameboy_t *gb, uint8_t old_tac, uint8_t new_tac);
 internal bool GB_timing_sync_turbo(GB_gameboy_t *gb); /* Returns true if should skip frame */
 internal void GB_timing_sync(GB_gameboy_t *gb);
 internal void GB_set_internal_div_counter(GB_gameboy_t *gb, uint16_t value);
 internal void GB_serial_master_edge(GB_gameboy_t *gb);
 internal void GB_rtc_set_time(GB_gameboy_t *gb, uint64_t time);
+/* Infrared input is ignored while this is false */
+internal bool GB_is_sensing_infrared(GB_gameboy_t *gb);
 
 #define GB_SLEEP(gb, unit, state, cycles) do {\
     (gb)->unit##_cycles -= (cycles) * __state_machine_divisor; \
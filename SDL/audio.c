@@ -79,6 +79,18 @@ size_t GB_audio_get_queue_length(void)
     return driver->audio_get_queue_length();
 }
 
+size_t GB_audio_get_queue_capacity(void)
+{
+    if (unlikely(!driver)) return 0;
+    return driver->audio_get_queue_capacity();
+}
+
+unsigned GB_audio_get_underrun_count(void)
+{
+    if (unlikely(!driver)) return 0;
+    return driver->audio_get_underrun_count();
+}
+
 void GB_audio_queue_sample(GB_sample_t *sample)
 {
     if (unlikely(!driver)) return;
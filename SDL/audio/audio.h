@@ -9,6 +9,8 @@ void GB_audio_set_paused(bool paused);
 void GB_audio_clear_queue(void);
 unsigned GB_audio_get_frequency(void);
 size_t GB_audio_get_queue_length(void);
+size_t GB_audio_get_queue_capacity(void); // The most samples the driver can hold queued
+unsigned GB_audio_get_underrun_count(void); // Times the device ran out of samples
 void GB_audio_queue_sample(GB_sample_t *sample);
 bool GB_audio_init(void);
 void GB_audio_deinit(void);
@@ -21,6 +23,8 @@ typedef struct {
     typeof(GB_audio_clear_queue) *audio_clear_queue;
     typeof(GB_audio_get_frequency) *audio_get_frequency;
     typeof(GB_audio_get_queue_length) *audio_get_queue_length;
+    typeof(GB_audio_get_queue_capacity) *audio_get_queue_capacity;
+    typeof(GB_audio_get_underrun_count) *audio_get_underrun_count;
     typeof(GB_audio_queue_sample) *audio_queue_sample;
     typeof(GB_audio_init) *audio_init;
     typeof(GB_audio_deinit) *audio_deinit;
@@ -33,6 +37,8 @@ typedef struct {
     .audio_clear_queue = _audio_clear_queue, \
     .audio_get_frequency = _audio_get_frequency, \
     .audio_get_queue_length = _audio_get_queue_length, \
+    .audio_get_queue_capacity = _audio_get_queue_capacity, \
+    .audio_get_underrun_count = _audio_get_underrun_count, \
     .audio_queue_sample = _audio_queue_sample, \
     .audio_init = _audio_init, \
     .audio_deinit = _audio_deinit, \
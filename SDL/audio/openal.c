@@ -21,6 +21,8 @@ static ALCint sample_rate = 0;
 static unsigned buffer_size = 0;
 static unsigned buffer_pos = 0;
 static bool is_paused = false;
+static unsigned underrun_count = 0;
+static bool queue_cleared = true;
 
 #define AL_ERR_STRINGIFY(x) #x
 #define AL_ERR_TOSTRING(x) AL_ERR_STRINGIFY(x)
@@ -161,6 +163,7 @@ static void _audio_clear_queue(void)
 
     free_processed_buffers();
     buffer_pos = 0;
+    queue_cleared = true;
 
     if (is_playing) {
         _audio_set_paused(false);
@@ -191,6 +194,17 @@ static size_t _audio_get_queue_length(void)
     return (buffers - processed) * buffer_size + buffer_pos;
 }
 
+static size_t _audio_get_queue_capacity(void)
+{
+    // Buffers are allocated as they are queued
+    return SIZE_MAX;
+}
+
+static unsigned _audio_get_underrun_count(void)
+{
+    return underrun_count;
+}
+
 static void _audio_queue_sample(GB_sample_t *sample)
 {
     if (is_paused) return;
@@ -218,9 +232,15 @@ static void _audio_queue_sample(GB_sample_t *sample)
         // In case of an audio underrun, the source might
         // have finished playing all attached buffers
         // which means its status will be "AL_STOPPED".
-        if (!_audio_is_playing()) {
+        ALenum state;
+        alGetSourcei(al_source, AL_SOURCE_STATE, &state);
+        if (state != AL_PLAYING) {
+            if (state == AL_STOPPED && !queue_cleared) {
+                underrun_count++;
+            }
             alSourcePlay(al_source);
         }
+        queue_cleared = false;
 
         free_processed_buffers();
     }
@@ -25,9 +25,46 @@
 static SDL_AudioDeviceID device_id;
 static SDL_AudioSpec want_aspec, have_aspec;
 
-#define AUDIO_BUFFER_SIZE 512
-static unsigned buffer_pos = 0;
-static GB_sample_t audio_buffer[AUDIO_BUFFER_SIZE];
+/* Samples are passed from the emulation thread to SDL's audio thread through a single-producer single-consumer ring,
+   so neither side ever has to wait for the other. Each position is only advanced by one of the threads, and both
+   only grow, wrapping around naturally. */
+#define AUDIO_RING_SIZE 0x8000 // Must be a power of 2
+static GB_sample_t audio_ring[AUDIO_RING_SIZE];
+static unsigned ring_read = 0, ring_write = 0;
+static unsigned underrun_count = 0;
+static bool starving = true; // Running out of samples only counts as an underrun after playback started
+static GB_sample_t last_sample;
+
+static void audio_callback(void *userdata, Uint8 *stream, int len)
+{
+    GB_sample_t *output = (GB_sample_t *)stream;
+    unsigned count = len / sizeof(GB_sample_t);
+    unsigned read = ring_read;
+    unsigned available = __atomic_load_n(&ring_write, __ATOMIC_ACQUIRE) - read;
+    unsigned i = 0;
+    for (; i < count && i < available; i++) {
+        output[i] = audio_ring[(read + i) & (AUDIO_RING_SIZE - 1)];
+    }
+    __atomic_store_n(&ring_read, read + i, __ATOMIC_RELEASE);
+    
+    if (i < count) {
+        /* Holding the last sample avoids a pop */
+        if (i) {
+            last_sample = output[i - 1];
+        }
+        if (!starving) {
+            starving = true;
+            __atomic_fetch_add(&underrun_count, 1, __ATOMIC_RELAXED);
+        }
+        for (; i < count; i++) {
+            output[i] = last_sample;
+        }
+    }
+    else if (count) {
+        last_sample = output[count - 1];
+        starving = false;
+    }
+}
 
 static bool _audio_is_playing(void)
 {
@@ -36,7 +73,11 @@ static bool _audio_is_playing(void)
 
 static void _audio_clear_queue(void)
 {
-    SDL_ClearQueuedAudio(device_id);
+    /* The read position belongs to the audio thread */
+    SDL_LockAudioDevice(device_id);
+    ring_read = __atomic_load_n(&ring_write, __ATOMIC_RELAXED);
+    starving = true;
+    SDL_UnlockAudioDevice(device_id);
 }
 
 static void _audio_set_paused(bool paused)
@@ -52,17 +93,25 @@ static unsigned _audio_get_frequency(void)
 
 static size_t _audio_get_queue_length(void)
 {
-    return SDL_GetQueuedAudioSize(device_id) / sizeof(GB_sample_t);
+    return ring_write - __atomic_load_n(&ring_read, __ATOMIC_ACQUIRE);
 }
 
-static void _audio_queue_sample(GB_sample_t *sample)
+static size_t _audio_get_queue_capacity(void)
 {
-    audio_buffer[buffer_pos++] = *sample;
+    return AUDIO_RING_SIZE;
+}
 
-    if (buffer_pos == AUDIO_BUFFER_SIZE) {
-        buffer_pos = 0;
-        SDL_QueueAudio(device_id, (const void *)audio_buffer, sizeof(audio_buffer));
-    }
+static unsigned _audio_get_underrun_count(void)
+{
+    return __atomic_load_n(&underrun_count, __ATOMIC_RELAXED);
+}
+
+static void _audio_queue_sample(GB_sample_t *sample)
+{
+    unsigned write = ring_write;
+    if (write - __atomic_load_n(&ring_read, __ATOMIC_ACQUIRE) == AUDIO_RING_SIZE) return;
+    audio_ring[write & (AUDIO_RING_SIZE - 1)] = *sample;
+    __atomic_store_n(&ring_write, write + 1, __ATOMIC_RELEASE);
 }
 
 static bool _audio_init(void)
@@ -78,6 +127,7 @@ static bool _audio_init(void)
     want_aspec.format = AUDIO_S16SYS;
     want_aspec.channels = 2;
     want_aspec.samples = 512;
+    want_aspec.callback = audio_callback;
     
     SDL_version _sdl_version;
     SDL_GetVersion(&_sdl_version);
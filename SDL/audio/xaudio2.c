@@ -27,6 +27,8 @@ static IXAudio2SourceVoice *source_voice = NULL;
 static bool playing = false;
 static GB_sample_t sample_pool[0x2000];
 static unsigned pos = 0;
+static unsigned underrun_count = 0;
+static bool queue_cleared = true;
 
 #define BATCH_SIZE 256
 
@@ -46,6 +48,7 @@ static bool _audio_is_playing(void)
 static void _audio_clear_queue(void)
 {
     pos = 0;
+    queue_cleared = true;
     IXAudio2SourceVoice_FlushSourceBuffers(source_voice);
 }
 
@@ -112,6 +115,16 @@ static size_t _audio_get_queue_length(void)
     return state.BuffersQueued * BATCH_SIZE + (pos & (BATCH_SIZE - 1));
 }
 
+static size_t _audio_get_queue_capacity(void)
+{
+    return sizeof(sample_pool) / sizeof(sample_pool[0]);
+}
+
+static unsigned _audio_get_underrun_count(void)
+{
+    return underrun_count;
+}
+
 static void _audio_queue_sample(GB_sample_t *sample)
 {
     if (!playing) return;
@@ -122,6 +135,12 @@ static void _audio_queue_sample(GB_sample_t *sample)
     pos++;
     pos &= 0x1fff;
     if ((pos & (BATCH_SIZE - 1)) == 0) {
+        XAUDIO2_VOICE_STATE state;
+        IXAudio2SourceVoice_GetState(source_voice, &state, XAUDIO2_VOICE_NOSAMPLESPLAYED);
+        if (!state.BuffersQueued && !queue_cleared) {
+            underrun_count++;
+        }
+        queue_cleared = false;
         IXAudio2SourceVoice_SubmitSourceBuffer(source_voice, &buffer, NULL);
     }
 }
@@ -131,6 +131,9 @@ typedef struct {
         char dmg_palette_name[25];
         hotkey_action_t hotkey_actions[2];
         uint16_t agb_revision;
+        /* v0.17 */
+        uint8_t audio_latency; // In milliseconds
+        uint8_t run_ahead_frames;
     };
 } configuration_t;
 
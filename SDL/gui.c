@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <dirent.h>
 #include "utils.h"
 #include "gui.h"
@@ -38,6 +39,32 @@ static unsigned factor;
 
 static SDL_Surface *converted_background = NULL;
 
+static GB_frame_blending_mode_t blending_mode(void *previous)
+{
+    GB_frame_blending_mode_t mode = configuration.blending_mode;
+    if (!previous) {
+        return GB_FRAME_BLENDING_MODE_DISABLED;
+    }
+    if (mode == GB_FRAME_BLENDING_MODE_ACCURATE) {
+        if (GB_is_sgb(&gb)) {
+            return GB_FRAME_BLENDING_MODE_SIMPLE;
+        }
+        return GB_is_odd_frame(&gb)? GB_FRAME_BLENDING_MODE_ACCURATE_ODD : GB_FRAME_BLENDING_MODE_ACCURATE_EVEN;
+    }
+    return mode;
+}
+
+static void draw_with_shader(void *pixels, void *previous, unsigned width, unsigned height, GB_frame_blending_mode_t mode)
+{
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    render_bitmap_with_shader(&shader, pixels, previous,
+                              width, height,
+                              rect.x, rect.y, rect.w, rect.h,
+                              mode);
+    SDL_GL_SwapWindow(window);
+}
+
 void render_texture(void *pixels,  void *previous)
 {
     if (renderer) {
@@ -53,26 +80,160 @@ void render_texture(void *pixels,  void *previous)
         if (pixels) {
             _pixels = pixels;
         }
-        glClearColor(0, 0, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT);
-        GB_frame_blending_mode_t mode = configuration.blending_mode;
-        if (!previous) {
-            mode = GB_FRAME_BLENDING_MODE_DISABLED;
+        draw_with_shader(_pixels, previous, GB_get_screen_width(&gb), GB_get_screen_height(&gb), blending_mode(previous));
+    }
+}
+
+/* While the emulator runs, frames are drawn and presented by a separate thread, so GL stalls and waiting for vsync
+   don't delay emulation or audio. Frames are passed to it through a lock-free triple buffer: the emulation thread fills
+   the back frame and swaps it with the middle one, and the render thread takes the middle one whenever it's newer
+   than what it last presented. Neither thread ever waits for the other; frames the render thread is too slow for are
+   dropped. The GUI still draws from the main thread, so the GL context is handed back while it's open. */
+typedef struct {
+    uint32_t pixels[256 * 224];
+    uint32_t previous[256 * 224];
+    unsigned width, height;
+    GB_frame_blending_mode_t mode;
+    uint32_t input_ticks; // When the oldest input this frame reflects was handled, 0 if none
+} published_frame_t;
+
+#define FRAME_IS_NEW 4
+static published_frame_t published_frames[3];
+static unsigned back_frame = 0; // Only accessed by the emulation thread
+static unsigned middle_frame = 1; // Swapped by both threads, FRAME_IS_NEW is set until the render thread takes it
+static unsigned front_frame = 2; // Only accessed by the render thread
+
+static SDL_Thread *render_thread = NULL;
+static SDL_GLContext render_context;
+static SDL_sem *render_semaphore = NULL;
+static bool render_thread_should_stop, viewport_changed, swap_interval_changed;
+bool print_frame_stats = false;
+
+/* GL calls have to be made from the render thread while it's running, which is the only thread with a current context */
+static bool is_on_other_thread(void)
+{
+    return render_thread && SDL_GL_GetCurrentContext() != render_context;
+}
+
+static void print_frame_stats_if_needed(uint32_t input_ticks)
+{
+    static uint64_t last_present = 0, stats_start = 0;
+    static unsigned frames = 0, inputs = 0;
+    static double frame_time_sum = 0, frame_time_square_sum = 0, input_latency_sum = 0;
+    
+    uint64_t now = SDL_GetPerformanceCounter();
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    if (!last_present) {
+        last_present = stats_start = now;
+        return;
+    }
+    double frame_time = (now - last_present) * 1000.0 / frequency;
+    last_present = now;
+    frames++;
+    frame_time_sum += frame_time;
+    frame_time_square_sum += frame_time * frame_time;
+    if (input_ticks) {
+        inputs++;
+        input_latency_sum += SDL_GetTicks() - input_ticks;
+    }
+    
+    if (now - stats_start >= frequency * 5) {
+        double mean = frame_time_sum / frames;
+        double variance = frame_time_square_sum / frames - mean * mean;
+        printf("Frame time: %.2fms, standard deviation %.2fms", mean, variance > 0? sqrt(variance) : 0);
+        if (inputs) {
+            printf(", input latency %.1fms", input_latency_sum / inputs);
         }
-        else if (mode == GB_FRAME_BLENDING_MODE_ACCURATE) {
-            if (GB_is_sgb(&gb)) {
-                mode = GB_FRAME_BLENDING_MODE_SIMPLE;
-            }
-            else {
-                mode = GB_is_odd_frame(&gb)? GB_FRAME_BLENDING_MODE_ACCURATE_ODD : GB_FRAME_BLENDING_MODE_ACCURATE_EVEN;
-            }
+        printf(" (%u frames)\n", frames);
+        stats_start = now;
+        frames = inputs = 0;
+        frame_time_sum = frame_time_square_sum = input_latency_sum = 0;
+    }
+}
+
+static int render_thread_main(void *unused)
+{
+    SDL_GL_MakeCurrent(window, render_context);
+    update_swap_interval();
+    update_viewport();
+    bool has_frame = false;
+    
+    while (true) {
+        SDL_SemWait(render_semaphore);
+        while (SDL_SemTryWait(render_semaphore) == 0);
+        if (__atomic_load_n(&render_thread_should_stop, __ATOMIC_ACQUIRE)) break;
+        
+        if (__atomic_exchange_n(&swap_interval_changed, false, __ATOMIC_ACQ_REL)) {
+            update_swap_interval();
+        }
+        if (__atomic_exchange_n(&viewport_changed, false, __ATOMIC_ACQ_REL)) {
+            update_viewport();
         }
-        render_bitmap_with_shader(&shader, _pixels, previous,
-                                  GB_get_screen_width(&gb), GB_get_screen_height(&gb),
-                                  rect.x, rect.y, rect.w, rect.h,
-                                  mode);
-        SDL_GL_SwapWindow(window);
+        
+        uint32_t input_ticks = 0;
+        if (__atomic_load_n(&middle_frame, __ATOMIC_RELAXED) & FRAME_IS_NEW) {
+            front_frame = __atomic_exchange_n(&middle_frame, front_frame, __ATOMIC_ACQ_REL) & ~FRAME_IS_NEW;
+            has_frame = true;
+            input_ticks = published_frames[front_frame].input_ticks;
+        }
+        if (!has_frame) continue;
+        
+        published_frame_t *frame = &published_frames[front_frame];
+        draw_with_shader(frame->pixels, frame->mode == GB_FRAME_BLENDING_MODE_DISABLED? NULL : frame->previous,
+                         frame->width, frame->height, frame->mode);
+        if (print_frame_stats) {
+            print_frame_stats_if_needed(input_ticks);
+        }
+    }
+    
+    SDL_GL_MakeCurrent(window, NULL);
+    return 0;
+}
+
+void start_render_thread(void)
+{
+    /* SDL_Renderer can only be used from the thread that created it */
+    if (renderer || render_thread) return;
+    if (!render_semaphore) {
+        render_semaphore = SDL_CreateSemaphore(0);
+    }
+    render_context = SDL_GL_GetCurrentContext();
+    SDL_GL_MakeCurrent(window, NULL);
+    render_thread_should_stop = false;
+    render_thread = SDL_CreateThread(render_thread_main, "SameBoy Renderer", NULL);
+    if (!render_thread) {
+        SDL_GL_MakeCurrent(window, render_context);
+    }
+}
+
+void stop_render_thread(void)
+{
+    if (!render_thread) return;
+    __atomic_store_n(&render_thread_should_stop, true, __ATOMIC_RELEASE);
+    SDL_SemPost(render_semaphore);
+    SDL_WaitThread(render_thread, NULL);
+    render_thread = NULL;
+    SDL_GL_MakeCurrent(window, render_context);
+}
+
+void present_frame(uint32_t *pixels, uint32_t *previous, uint32_t input_ticks)
+{
+    if (!render_thread) {
+        render_texture(pixels, previous);
+        return;
+    }
+    
+    published_frame_t *frame = &published_frames[back_frame];
+    frame->width = GB_get_screen_width(&gb);
+    frame->height = GB_get_screen_height(&gb);
+    frame->mode = blending_mode(previous);
+    frame->input_ticks = input_ticks;
+    memcpy(frame->pixels, pixels, frame->width * frame->height * sizeof(pixels[0]));
+    if (previous) {
+        memcpy(frame->previous, previous, frame->width * frame->height * sizeof(previous[0]));
     }
+    back_frame = __atomic_exchange_n(&middle_frame, back_frame | FRAME_IS_NEW, __ATOMIC_ACQ_REL) & ~FRAME_IS_NEW;
+    SDL_SemPost(render_semaphore);
 }
 
 static const char *help[] = {
@@ -103,6 +264,11 @@ static const char *help[] = {
 
 void update_viewport(void)
 {
+    if (is_on_other_thread()) {
+        __atomic_store_n(&viewport_changed, true, __ATOMIC_RELEASE);
+        SDL_SemPost(render_semaphore);
+        return;
+    }
     int win_width, win_height;
     SDL_GL_GetDrawableSize(window, &win_width, &win_height);
     int logical_width, logical_height;
@@ -1132,6 +1298,34 @@ static const char *current_agb_revision_string(unsigned index)
     return "CPU AGB A (AGB)";
 }
 
+static void cycle_run_ahead(unsigned index)
+{
+    configuration.run_ahead_frames = (configuration.run_ahead_frames + 1) % 5;
+}
+
+static void cycle_run_ahead_backwards(unsigned index)
+{
+    configuration.run_ahead_frames = (configuration.run_ahead_frames + 4) % 5;
+}
+
+static const char *current_run_ahead_string(unsigned index)
+{
+    if (!configuration.run_ahead_frames) return "Disabled";
+    static char ret[24];
+    double frame_rate = GB_is_inited(&gb)? GB_get_usual_frame_rate(&gb) : 59.7275;
+    sprintf(ret, "%u Frame%s (-%.0fms)", configuration.run_ahead_frames, configuration.run_ahead_frames == 1? "" : "s",
+            configuration.run_ahead_frames * 1000 / frame_rate);
+    return ret;
+}
+
+static const char *run_ahead_cost_string(unsigned index)
+{
+    if (!configuration.run_ahead_frames || !run_ahead_cost) return "-";
+    static char ret[24];
+    sprintf(ret, "%.2fms per Frame", run_ahead_cost);
+    return ret;
+}
+
 static const struct menu_item emulation_menu[] = {
     {"Emulated Model:", cycle_model, current_model_string, cycle_model_backwards},
     {"SGB Revision:", cycle_sgb_revision, current_sgb_revision_string, cycle_sgb_revision_backwards},
@@ -1140,6 +1334,8 @@ static const struct menu_item emulation_menu[] = {
     {"Boot ROMs Folder:", toggle_bootrom, current_bootrom_string, toggle_bootrom},
     {"Rewind Length:", cycle_rewind, current_rewind_string, cycle_rewind_backwards},
     {"Real Time Clock:", toggle_rtc_mode, current_rtc_mode_string, toggle_rtc_mode},
+    {"Run-Ahead:", cycle_run_ahead, current_run_ahead_string, cycle_run_ahead_backwards},
+    {"Run-Ahead Cost:", nop, run_ahead_cost_string},
     {"Back", enter_options_menu},
     {NULL,}
 };
@@ -1645,6 +1841,42 @@ static void decrease_interference_volume(unsigned index)
     }
 }
 
+static const char *audio_latency_string(unsigned index)
+{
+    static char ret[8];
+    sprintf(ret, "%dms", configuration.audio_latency);
+    return ret;
+}
+
+static void increase_audio_latency(unsigned index)
+{
+    if (configuration.audio_latency < 200) {
+        configuration.audio_latency += 10;
+    }
+}
+
+static void decrease_audio_latency(unsigned index)
+{
+    if (configuration.audio_latency > 20) {
+        configuration.audio_latency -= 10;
+    }
+}
+
+static const char *audio_underruns_string(unsigned index)
+{
+    static char ret[16];
+    sprintf(ret, "%u", GB_audio_get_underrun_count());
+    return ret;
+}
+
+static const char *audio_queue_latency_string(unsigned index)
+{
+    static char ret[16];
+    unsigned frequency = GB_audio_get_frequency();
+    sprintf(ret, "%.0fms", frequency? GB_audio_get_queue_length() * 1000.0 / frequency : 0);
+    return ret;
+}
+
 static const char *audio_driver_string(unsigned index)
 {
     return GB_audio_driver_name();
@@ -1718,6 +1950,9 @@ static struct menu_item audio_menu[] = {
     {"Interference Volume:", increase_interference_volume, interference_volume_string, decrease_interference_volume},
     {"Preferred Audio Driver:", cycle_prefrered_audio_driver, preferred_audio_driver_string, cycle_preferred_audio_driver_backwards},
     {"Active Driver:", nop, audio_driver_string},
+    {"Latency:", increase_audio_latency, audio_latency_string, decrease_audio_latency},
+    {"Underruns:", nop, audio_underruns_string},
+    {"Measured Latency:", nop, audio_queue_latency_string},
     {"Back", enter_options_menu},
     {NULL,}
 };
@@ -2134,6 +2369,11 @@ void convert_mouse_coordinates(signed *x, signed *y)
 
 void update_swap_interval(void)
 {
+    if (is_on_other_thread()) {
+        __atomic_store_n(&swap_interval_changed, true, __ATOMIC_RELEASE);
+        SDL_SemPost(render_semaphore);
+        return;
+    }
     SDL_DisplayMode mode;
     SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode);
     if (mode.refresh_rate >= 60) {
@@ -45,6 +45,11 @@ extern char *dropped_state_file;
 void update_viewport(void);
 void run_gui(bool is_running);
 void render_texture(void *pixels, void *previous);
+void present_frame(uint32_t *pixels, uint32_t *previous, uint32_t input_ticks);
+void start_render_thread(void);
+void stop_render_thread(void);
+extern bool print_frame_stats;
+extern double run_ahead_cost; // In milliseconds per frame
 void connect_joypad(void);
 
 joypad_button_t get_joypad_button(uint8_t physical_button);
@@ -5,6 +5,7 @@
 #include <unistd.h>
 #include <errno.h>
 #include <limits.h>
+#include <time.h>
 #include <OpenDialog/open_dialog.h>
 #include <SDL.h>
 #include <Core/gb.h>
@@ -15,7 +16,8 @@
 #include "console.h"
 
 #include <zmq.h>
-#include "traceboy.pb-c.h"
+#include "trace.h"
+#include "trace_archive.h"
 
 #ifndef _WIN32
 #include <fcntl.h>
@@ -32,11 +34,25 @@ static bool underclock_down = false, rewind_down = false, do_rewind = false, rew
 static double clock_mutliplier = 1.0;
 static GB_key_mask_t key_mask = 0;
 static bool vblank_just_occured = false;
+/* For measuring input latency, when the first input since the last vblank was handled, and the input that applies to
+   the current frame */
+static uint32_t pending_input_ticks = 0, applied_input_ticks = 0;
+/* Run-ahead emulates past the real frame using the latest input, shows the last frame and rolls back, hiding the game's
+   own input lag */
+static bool run_ahead_pending = false;
+static unsigned frames_to_run_ahead = 0;
+static void *run_ahead_snapshot = NULL;
+static size_t run_ahead_snapshot_size = 0;
+double run_ahead_cost = 0;
 
 void update_key_mask(GB_key_t index, bool pressed)
 {
+	GB_key_mask_t old_mask = key_mask;
 	key_mask &= ~(1<<index);
 	key_mask |= pressed ? (1<<index) : 0;
+	if (key_mask != old_mask && !pending_input_ticks) {
+		pending_input_ticks = SDL_GetTicks();
+	}
 }
 
 char *filename = NULL;
@@ -196,7 +212,9 @@ static void open_menu(void)
         GB_audio_set_paused(true);
     }
     size_t previous_width = GB_get_screen_width(&gb);
+    stop_render_thread();
     run_gui(true);
+    start_render_thread();
     SDL_ShowCursor(SDL_DISABLE);
     if (audio_playing) {
         GB_audio_set_paused(false);
@@ -522,67 +540,89 @@ static uint32_t rgb_encode(GB_gameboy_t *gb, uint8_t r, uint8_t g, uint8_t b)
     return SDL_MapRGB(pixel_format, r, g, b);
 }
 
-static uint32_t calc_crc32(size_t size, const uint8_t *byte)
+/* The queue length to aim for, in samples. Samples are dropped past twice that, so it's limited to half of what the
+   driver can hold. */
+static size_t audio_queue_target(void)
 {
-    static const uint32_t table[] = {
-        0x00000000, 0x77073096, 0xEE0E612C, 0x990951BA, 0x076DC419, 0x706AF48F,
-        0xE963A535, 0x9E6495A3, 0x0EDB8832, 0x79DCB8A4, 0xE0D5E91E, 0x97D2D988,
-        0x09B64C2B, 0x7EB17CBD, 0xE7B82D07, 0x90BF1D91, 0x1DB71064, 0x6AB020F2,
-        0xF3B97148, 0x84BE41DE, 0x1ADAD47D, 0x6DDDE4EB, 0xF4D4B551, 0x83D385C7,
-        0x136C9856, 0x646BA8C0, 0xFD62F97A, 0x8A65C9EC, 0x14015C4F, 0x63066CD9,
-        0xFA0F3D63, 0x8D080DF5, 0x3B6E20C8, 0x4C69105E, 0xD56041E4, 0xA2677172,
-        0x3C03E4D1, 0x4B04D447, 0xD20D85FD, 0xA50AB56B, 0x35B5A8FA, 0x42B2986C,
-        0xDBBBC9D6, 0xACBCF940, 0x32D86CE3, 0x45DF5C75, 0xDCD60DCF, 0xABD13D59,
-        0x26D930AC, 0x51DE003A, 0xC8D75180, 0xBFD06116, 0x21B4F4B5, 0x56B3C423,
-        0xCFBA9599, 0xB8BDA50F, 0x2802B89E, 0x5F058808, 0xC60CD9B2, 0xB10BE924,
-        0x2F6F7C87, 0x58684C11, 0xC1611DAB, 0xB6662D3D, 0x76DC4190, 0x01DB7106,
-        0x98D220BC, 0xEFD5102A, 0x71B18589, 0x06B6B51F, 0x9FBFE4A5, 0xE8B8D433,
-        0x7807C9A2, 0x0F00F934, 0x9609A88E, 0xE10E9818, 0x7F6A0DBB, 0x086D3D2D,
-        0x91646C97, 0xE6635C01, 0x6B6B51F4, 0x1C6C6162, 0x856530D8, 0xF262004E,
-        0x6C0695ED, 0x1B01A57B, 0x8208F4C1, 0xF50FC457, 0x65B0D9C6, 0x12B7E950,
-        0x8BBEB8EA, 0xFCB9887C, 0x62DD1DDF, 0x15DA2D49, 0x8CD37CF3, 0xFBD44C65,
-        0x4DB26158, 0x3AB551CE, 0xA3BC0074, 0xD4BB30E2, 0x4ADFA541, 0x3DD895D7,
-        0xA4D1C46D, 0xD3D6F4FB, 0x4369E96A, 0x346ED9FC, 0xAD678846, 0xDA60B8D0,
-        0x44042D73, 0x33031DE5, 0xAA0A4C5F, 0xDD0D7CC9, 0x5005713C, 0x270241AA,
-        0xBE0B1010, 0xC90C2086, 0x5768B525, 0x206F85B3, 0xB966D409, 0xCE61E49F,
-        0x5EDEF90E, 0x29D9C998, 0xB0D09822, 0xC7D7A8B4, 0x59B33D17, 0x2EB40D81,
-        0xB7BD5C3B, 0xC0BA6CAD, 0xEDB88320, 0x9ABFB3B6, 0x03B6E20C, 0x74B1D29A,
-        0xEAD54739, 0x9DD277AF, 0x04DB2615, 0x73DC1683, 0xE3630B12, 0x94643B84,
-        0x0D6D6A3E, 0x7A6A5AA8, 0xE40ECF0B, 0x9309FF9D, 0x0A00AE27, 0x7D079EB1,
-        0xF00F9344, 0x8708A3D2, 0x1E01F268, 0x6906C2FE, 0xF762575D, 0x806567CB,
-        0x196C3671, 0x6E6B06E7, 0xFED41B76, 0x89D32BE0, 0x10DA7A5A, 0x67DD4ACC,
-        0xF9B9DF6F, 0x8EBEEFF9, 0x17B7BE43, 0x60B08ED5, 0xD6D6A3E8, 0xA1D1937E,
-        0x38D8C2C4, 0x4FDFF252, 0xD1BB67F1, 0xA6BC5767, 0x3FB506DD, 0x48B2364B,
-        0xD80D2BDA, 0xAF0A1B4C, 0x36034AF6, 0x41047A60, 0xDF60EFC3, 0xA867DF55,
-        0x316E8EEF, 0x4669BE79, 0xCB61B38C, 0xBC66831A, 0x256FD2A0, 0x5268E236,
-        0xCC0C7795, 0xBB0B4703, 0x220216B9, 0x5505262F, 0xC5BA3BBE, 0xB2BD0B28,
-        0x2BB45A92, 0x5CB36A04, 0xC2D7FFA7, 0xB5D0CF31, 0x2CD99E8B, 0x5BDEAE1D,
-        0x9B64C2B0, 0xEC63F226, 0x756AA39C, 0x026D930A, 0x9C0906A9, 0xEB0E363F,
-        0x72076785, 0x05005713, 0x95BF4A82, 0xE2B87A14, 0x7BB12BAE, 0x0CB61B38,
-        0x92D28E9B, 0xE5D5BE0D, 0x7CDCEFB7, 0x0BDBDF21, 0x86D3D2D4, 0xF1D4E242,
-        0x68DDB3F8, 0x1FDA836E, 0x81BE16CD, 0xF6B9265B, 0x6FB077E1, 0x18B74777,
-        0x88085AE6, 0xFF0F6A70, 0x66063BCA, 0x11010B5C, 0x8F659EFF, 0xF862AE69,
-        0x616BFFD3, 0x166CCF45, 0xA00AE278, 0xD70DD2EE, 0x4E048354, 0x3903B3C2,
-        0xA7672661, 0xD06016F7, 0x4969474D, 0x3E6E77DB, 0xAED16A4A, 0xD9D65ADC,
-        0x40DF0B66, 0x37D83BF0, 0xA9BCAE53, 0xDEBB9EC5, 0x47B2CF7F, 0x30B5FFE9,
-        0xBDBDF21C, 0xCABAC28A, 0x53B39330, 0x24B4A3A6, 0xBAD03605, 0xCDD70693,
-        0x54DE5729, 0x23D967BF, 0xB3667A2E, 0xC4614AB8, 0x5D681B02, 0x2A6F2B94,
-        0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
-    };
+    size_t target = GB_audio_get_frequency() * configuration.audio_latency / 1000;
+    size_t capacity = GB_audio_get_queue_capacity();
+    return target > capacity / 2? capacity / 2 : target;
+}
 
-    uint32_t ret = 0xFFFFFFFF;
-    while (size--) {
-        ret = table[(ret ^ *byte++) & 0xFF] ^ (ret >> 8);
+/* The emulator and the audio device are driven by different clocks, so the sample rate is constantly nudged, by up to
+   0.5%, to keep the audio queue at the configured latency */
+static void update_audio_rate(GB_gameboy_t *gb)
+{
+    unsigned frequency = GB_audio_get_frequency();
+    if (!frequency) return;
+    
+    size_t queue_length = GB_audio_get_queue_length();
+    double target = audio_queue_target();
+    double error = (queue_length - target) / target;
+    if (error > 1) {
+        error = 1;
+    }
+    else if (error < -1) {
+        error = -1;
+    }
+    GB_set_sample_rate_by_clocks(gb, GB_get_clock_rate(gb) * 2.0 / frequency * (1 + error * 0.005));
+    
+    static unsigned frames = 0;
+    static double queue_length_sum = 0;
+    if (print_frame_stats) {
+        queue_length_sum += queue_length;
+        if (++frames == 300) {
+            printf("Audio queue: %.1fms, target %.1fms, %u underruns\n",
+                   queue_length_sum * 1000 / frames / frequency, target * 1000 / frequency,
+                   GB_audio_get_underrun_count());
+            frames = 0;
+            queue_length_sum = 0;
+        }
+    }
+}
+
+static void show_frame(GB_gameboy_t *gb, GB_vblank_type_t type)
+{
+    if (osd_countdown && configuration.osd) {
+        unsigned width = GB_get_screen_width(gb);
+        unsigned height = GB_get_screen_height(gb);
+        draw_text(active_pixel_buffer,
+                  width, height, 8, height - 8 - osd_text_lines * 12, osd_text,
+                  rgb_encode(gb, 255, 255, 255), rgb_encode(gb, 0, 0, 0),
+                  true);
+        osd_countdown--;
+    }
+    if (type != GB_VBLANK_TYPE_REPEAT) {
+        if (configuration.blending_mode) {
+            present_frame(active_pixel_buffer, previous_pixel_buffer, applied_input_ticks);
+            uint32_t *temp = active_pixel_buffer;
+            active_pixel_buffer = previous_pixel_buffer;
+            previous_pixel_buffer = temp;
+            GB_set_pixels_output(gb, active_pixel_buffer);
+        }
+        else {
+            present_frame(active_pixel_buffer, NULL, applied_input_ticks);
+        }
+        applied_input_ticks = 0;
     }
-    return ~ret;
 }
 
 static void vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
 {
+    if (frames_to_run_ahead) {
+        /* Only the last frame is shown, everything else already happened during the real frame */
+        if (--frames_to_run_ahead == 0) {
+            show_frame(gb, type);
+        }
+        return;
+    }
+    
 	if (type == GB_VBLANK_TYPE_NORMAL_FRAME)
 	{
 		vblank_just_occured = true;
 	}
+    
+    update_audio_rate(gb);
 
     if (underclock_down && clock_mutliplier > 0.5) {
         clock_mutliplier -= 1.0/16;
@@ -603,26 +643,10 @@ static void vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
         show_osd_text("Rewinding...");
     }
     
-    if (osd_countdown && configuration.osd) {
-        unsigned width = GB_get_screen_width(gb);
-        unsigned height = GB_get_screen_height(gb);
-        draw_text(active_pixel_buffer,
-                  width, height, 8, height - 8 - osd_text_lines * 12, osd_text,
-                  rgb_encode(gb, 255, 255, 255), rgb_encode(gb, 0, 0, 0),
-                  true);
-        osd_countdown--;
-    }
-    if (type != GB_VBLANK_TYPE_REPEAT) {
-        if (configuration.blending_mode) {
-            render_texture(active_pixel_buffer, previous_pixel_buffer);
-            uint32_t *temp = active_pixel_buffer;
-            active_pixel_buffer = previous_pixel_buffer;
-            previous_pixel_buffer = temp;
-            GB_set_pixels_output(gb, active_pixel_buffer);
-        }
-        else {
-            render_texture(active_pixel_buffer, NULL);
-        }
+    /* The frame shown is the one emulated ahead, after the new input is applied */
+    run_ahead_pending = configuration.run_ahead_frames && type == GB_VBLANK_TYPE_NORMAL_FRAME && !rewind_down;
+    if (!run_ahead_pending) {
+        show_frame(gb, type);
     }
     do_rewind = rewind_down;
 
@@ -668,7 +692,8 @@ static void gb_audio_callback(GB_gameboy_t *gb, GB_sample_t *sample)
         }
     }
     
-    if (GB_audio_get_queue_length() > GB_audio_get_frequency() / 8) { // Maximum lag of 0.125s
+    // Maximum lag of twice the latency target
+    if (GB_audio_get_queue_length() > audio_queue_target() * 2) {
         return;
     }
     
@@ -845,33 +870,86 @@ void print_buffer(uint8_t* buffer, size_t size, const char* name)
 	printf("\n");
 }
 
+/* Trace packets are pushed to a collector over ZeroMQ, or with --trace-archive, appended to a local archive */
+static const char *trace_archive_path = NULL;
+static trace_sink_t *trace_sink = NULL;
+
+typedef struct {
+    trace_sink_t sink;
+    void *context;
+    void *socket;
+} zmq_sink_t;
+
+static bool zmq_sink_write(trace_sink_t *sink, const uint8_t *packet, size_t size, const trace_packet_info_t *info)
+{
+    zmq_sink_t *zmq = (zmq_sink_t *)sink;
+    return zmq_send(zmq->socket, packet, size, ZMQ_DONTWAIT) == (int)size;
+}
+
+static void zmq_sink_close(trace_sink_t *sink)
+{
+    zmq_sink_t *zmq = (zmq_sink_t *)sink;
+    zmq_close(zmq->socket);
+    zmq_ctx_destroy(zmq->context);
+    free(zmq);
+}
+
+static trace_sink_t *zmq_sink_create(const char *endpoint)
+{
+    zmq_sink_t *zmq = malloc(sizeof(*zmq));
+    zmq->sink.write = zmq_sink_write;
+    zmq->sink.close = zmq_sink_close;
+    zmq->context = zmq_ctx_new();
+    zmq->socket = zmq_socket(zmq->context, ZMQ_PUSH);
+    /* Don't block exiting on packets nothing received */
+    int linger = 0;
+    zmq_setsockopt(zmq->socket, ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_connect(zmq->socket, endpoint);
+    return &zmq->sink;
+}
+
+static void close_trace_sink(void)
+{
+    if (trace_sink) {
+        trace_sink->close(trace_sink);
+        trace_sink = NULL;
+    }
+}
+
 static void issue_trace_packet()
 {
 	static uint8_t inputs[20*60];
 	static int frame_count = -1;
-	static uint8_t *start_state = NULL;
-	static size_t start_state_size;
-
-	static void *context = NULL;
-	static void *requester = NULL;
+	static trace_chain_t chain;
+	static uint32_t session_id = 0;
+	static uint64_t session_frames = 0;
 
 	if (!has_active_trace_packet)
 	{
-		if (!context)
+		if (!trace_sink)
 		{
-			context = zmq_ctx_new();
-			requester = zmq_socket(context, ZMQ_PUSH);
-			zmq_connect (requester, "tcp://localhost:1989");
+			if (trace_archive_path)
+			{
+				trace_sink = trace_archive_sink_create(trace_archive_path);
+				if (!trace_sink)
+				{
+					fprintf(stderr, "Failed to open trace archive %s, sending packets over ZeroMQ instead\n", trace_archive_path);
+				}
+			}
+			if (!trace_sink)
+			{
+				trace_sink = zmq_sink_create("tcp://localhost:1989");
+			}
+			atexit(close_trace_sink);
 		}
 
-		if (start_state)
-		{
-			free(start_state);
-		}
+		session_id = (uint32_t)time(NULL) + session_id + 1;
+		session_frames = 0;
 
-		start_state_size = GB_get_save_state_size(&gb);
-		start_state = malloc(start_state_size);
+		size_t start_state_size = GB_get_save_state_size(&gb);
+		uint8_t *start_state = malloc(start_state_size);
 		GB_save_state_to_buffer(&gb, start_state);
+		trace_chain_start(&chain, start_state, start_state_size);
 
 		print_buffer((void*)GB_get_registers(&gb), sizeof(GB_registers_t), "REGFILE");
 
@@ -902,29 +980,76 @@ static void issue_trace_packet()
 		TracePacket trace_packet;
 		trace_packet__init(&trace_packet);
 		trace_packet.game_rom_crc32 = GB_get_rom_crc32(&gb);;
-		trace_packet.start_state.len = start_state_size;
-		trace_packet.start_state.data = start_state;
 		trace_packet.user_inputs.len = frame_count-1;
 		trace_packet.user_inputs.data = inputs;
-		trace_packet.end_state_crc32 = calc_crc32(end_state_size, end_state);
+		trace_chain_encode(&chain, &trace_packet, end_state, end_state_size);
 
 		size_t packed_size = trace_packet__get_packed_size(&trace_packet);
 		uint8_t *packed_msg = malloc(packed_size);
 		assert(packed_msg);
 		trace_packet__pack(&trace_packet, packed_msg);
 
-		zmq_send (requester, packed_msg, packed_size, ZMQ_DONTWAIT);
+		trace_packet_info_t info = {
+			.rom_crc32 = trace_packet.game_rom_crc32,
+			.session_id = session_id,
+			.sequence_number = trace_packet.sequence_number,
+			.frame_count = trace_packet.user_inputs.len,
+			.first_frame = session_frames,
+		};
+		bool sent = trace_sink->write(trace_sink, packed_msg, packed_size, &info);
+		session_frames += info.frame_count;
 
 		free(packed_msg);
-		free(start_state);
-		start_state = end_state;
-		start_state_size = end_state_size;
+		trace_chain_advance(&chain, &trace_packet);
+
+		if (!sent)
+		{
+			/* Nothing after a lost packet can be decoded until the next key packet, so start a new chain now */
+			trace_chain_restart(&chain);
+			session_id = (uint32_t)time(NULL) + session_id + 1;
+			session_frames = 0;
+		}
 
 		frame_count = 1;
 		inputs[0] = key_mask;
 	}
 }
 
+static void run_ahead(void)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+    size_t size = GB_get_snapshot_size(&gb);
+    if (size > run_ahead_snapshot_size) {
+        free(run_ahead_snapshot);
+        run_ahead_snapshot = malloc(size);
+        run_ahead_snapshot_size = size;
+    }
+    
+    GB_take_snapshot(&gb, run_ahead_snapshot);
+    GB_set_speculating(&gb, true);
+    frames_to_run_ahead = configuration.run_ahead_frames;
+    while (frames_to_run_ahead) {
+        /* Frames that are never shown don't have to be rendered */
+        GB_set_rendering_disabled(&gb, frames_to_run_ahead > 1);
+        GB_run(&gb);
+    }
+    GB_set_rendering_disabled(&gb, false);
+    GB_restore_snapshot(&gb, run_ahead_snapshot);
+    GB_set_speculating(&gb, false);
+    
+    double cost = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    run_ahead_cost = run_ahead_cost? run_ahead_cost * 0.95 + cost * 0.05 : cost;
+    
+    static unsigned frames = 0;
+    if (print_frame_stats && ++frames == 300) {
+        printf("Run-ahead: %u frames, %.1fms latency saved, %.2fms CPU per frame\n",
+               configuration.run_ahead_frames,
+               configuration.run_ahead_frames * 1000 / GB_get_usual_frame_rate(&gb),
+               run_ahead_cost);
+        frames = 0;
+    }
+}
+
 static void run(void)
 {
     SDL_ShowCursor(SDL_DISABLE);
@@ -1077,7 +1202,13 @@ restart:
 		{
 			issue_trace_packet();
 			GB_set_key_mask(&gb, key_mask);
+			applied_input_ticks = pending_input_ticks;
+			pending_input_ticks = 0;
 			vblank_just_occured = false;
+			if (run_ahead_pending) {
+				run_ahead_pending = false;
+				run_ahead();
+			}
 		}
 
         /* These commands can't run in the handle_event function, because they're not safe in a vblank context. */
@@ -1232,11 +1363,22 @@ int main(int argc, char **argv)
     bool fullscreen = get_arg_flag("--fullscreen", &argc, argv) || get_arg_flag("-f", &argc, argv);
     bool nogl = get_arg_flag("--nogl", &argc, argv);
     stop_on_start = get_arg_flag("--stop-debugger", &argc, argv) || get_arg_flag("-s", &argc, argv);
+    print_frame_stats = get_arg_flag("--frame-stats", &argc, argv);
+    trace_archive_path = get_arg_option("--trace-archive", &argc, argv);
+    const char *trace_archive_test_path = get_arg_option("--test-trace-archive", &argc, argv);
     
+    if (trace_archive_test_path) {
+        if (!trace_archive_self_test(trace_archive_test_path)) {
+            fprintf(stderr, "Trace archive test failed\n");
+            exit(1);
+        }
+        fprintf(stderr, "Trace archive test passed\n");
+        exit(0);
+    }
 
     if (argc > 2 || (argc == 2 && argv[1][0] == '-')) {
         fprintf(stderr, "SameBoy v" GB_VERSION "\n");
-        fprintf(stderr, "Usage: %s [--fullscreen|-f] [--nogl] [--stop-debugger|-s] [--model <model>] <rom>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--fullscreen|-f] [--nogl] [--stop-debugger|-s] [--frame-stats] [--model <model>] [--trace-archive <directory>] [--test-trace-archive <new directory>] <rom>\n", argv[0]);
         exit(1);
     }
     
@@ -1300,6 +1442,12 @@ int main(int argc, char **argv)
         if ((configuration.agb_revision & ~GB_MODEL_GBP_BIT) != GB_MODEL_AGB_A) {
             configuration.agb_revision = GB_MODEL_AGB_A;
         }
+        if (configuration.audio_latency < 20 || configuration.audio_latency > 200) {
+            configuration.audio_latency = 50;
+        }
+        if (configuration.run_ahead_frames > 4) {
+            configuration.run_ahead_frames = 0;
+        }
     }
     
     if (configuration.model >= MODEL_MAX) {
@@ -1376,6 +1524,8 @@ int main(int argc, char **argv)
         connect_joypad();
     }
     GB_audio_set_paused(false);
+    start_render_thread();
+    atexit(stop_render_thread);
     run(); // Never returns
     return 0;
 }
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "traceboy.pb-c.h"
+
+/* Trace packets form chains: every packet starts exactly where the previous one ended. Only key packets carry a full
+   start_state, every TRACE_KEY_PACKET_INTERVAL packets or when a chain starts. Every packet carries its end state as
+   a delta against its start state, so the full state of any packet can be rebuilt from the last key packet before it.
+   sequence_number and parent_state_crc32 (the CRC32 of the start state) let a decoder validate the chain. */
+#define TRACE_KEY_PACKET_INTERVAL 15 // 5 minutes of play
+
+typedef struct {
+    uint8_t *state; // The start state of the next packet
+    size_t state_size;
+    uint32_t state_crc32;
+    uint32_t next_sequence_number;
+    bool valid;
+    
+    /* Encoder only */
+    uint8_t *end_state;
+    size_t end_state_size;
+} trace_chain_t;
+
+uint32_t trace_crc32(const uint8_t *data, size_t size);
+
+/* Both return a malloc'ed buffer. Decoding returns NULL if the delta is corrupt. */
+uint8_t *trace_delta_encode(const uint8_t *base, size_t base_size,
+                            const uint8_t *state, size_t state_size, size_t *delta_size);
+uint8_t *trace_delta_decode(const uint8_t *base, size_t base_size,
+                            const uint8_t *delta, size_t delta_size, size_t *state_size);
+
+/* Encoding. trace_chain_start and trace_chain_encode take ownership of the malloc'ed states. The packet's fields point
+   into the chain until trace_chain_advance is called, after the packet was packed. */
+void trace_chain_start(trace_chain_t *chain, uint8_t *start_state, size_t size);
+void trace_chain_encode(trace_chain_t *chain, TracePacket *packet, uint8_t *end_state, size_t end_state_size);
+void trace_chain_advance(trace_chain_t *chain, TracePacket *packet);
+/* Makes the next packet a key packet that starts a new chain, for when a packet was lost. Call after advancing. */
+void trace_chain_restart(trace_chain_t *chain);
+
+/* Decoding. Packets must be fed in order, starting with a key packet. Returns the packet's full start state as a
+   malloc'ed buffer, or NULL if the chain is broken, in which case decoding resumes at the next key packet. */
+uint8_t *trace_chain_decode(trace_chain_t *chain, const TracePacket *packet, size_t *start_state_size);
+void trace_chain_free(trace_chain_t *chain);
+
+/* Describes a packet to sinks, which can index it without unpacking it */
+typedef struct {
+    uint32_t rom_crc32;
+    uint32_t session_id; // Identifies a chain
+    uint32_t sequence_number;
+    uint32_t frame_count;
+    uint64_t first_frame; // Counted from the start of the session
+} trace_packet_info_t;
+
+/* Destination of packed trace packets */
+typedef struct trace_sink_s trace_sink_t;
+struct trace_sink_s {
+    bool (*write)(trace_sink_t *sink, const uint8_t *packet, size_t size, const trace_packet_info_t *info);
+    void (*close)(trace_sink_t *sink); // Flushes pending packets and frees the sink
+};
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace_archive.h"
+
+/* A summary of consecutive records of a single session, in frame order, so lookups can skip everything else */
+typedef struct {
+    uint32_t rom_crc32;
+    uint32_t session_id;
+    uint64_t first_frame, end_frame;
+    size_t first_entry, n_entries;
+} run_t;
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    run_t *runs;
+    size_t n_runs;
+} segment_t;
+
+struct trace_archive_s {
+    segment_t *segments;
+    uint32_t n_segments;
+    trace_archive_entry_t *entries;
+    size_t n_entries;
+    size_t entries_capacity;
+};
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __APPLE__
+#define fdatasync fsync
+#endif
+
+/* Every record in a segment's data starts with a header, and every index entry is the header's offset followed by a
+   copy of it. All fields are little endian. */
+#define RECORD_MAGIC 0x52544253 // SBTR
+#define RECORD_HEADER_SIZE 40
+#define INDEX_ENTRY_SIZE (8 + RECORD_HEADER_SIZE)
+
+static void write_le(uint8_t *out, uint64_t value, unsigned size)
+{
+    for (unsigned i = 0; i < size; i++) {
+        out[i] = value >> (i * 8);
+    }
+}
+
+static uint64_t read_le(const uint8_t *in, unsigned size)
+{
+    uint64_t ret = 0;
+    for (unsigned i = size; i--;) {
+        ret = (ret << 8) | in[i];
+    }
+    return ret;
+}
+
+static void encode_header(uint8_t *out, const trace_archive_entry_t *entry)
+{
+    write_le(out + 0, RECORD_MAGIC, 4);
+    write_le(out + 4, entry->size, 4);
+    write_le(out + 8, entry->crc32, 4);
+    write_le(out + 12, entry->info.rom_crc32, 4);
+    write_le(out + 16, entry->info.session_id, 4);
+    write_le(out + 20, entry->info.sequence_number, 4);
+    write_le(out + 24, entry->info.frame_count, 4);
+    write_le(out + 28, 0, 4);
+    write_le(out + 32, entry->info.first_frame, 8);
+}
+
+static bool decode_header(const uint8_t *in, trace_archive_entry_t *entry)
+{
+    if (read_le(in, 4) != RECORD_MAGIC) return false;
+    entry->size = read_le(in + 4, 4);
+    entry->crc32 = read_le(in + 8, 4);
+    entry->info.rom_crc32 = read_le(in + 12, 4);
+    entry->info.session_id = read_le(in + 16, 4);
+    entry->info.sequence_number = read_le(in + 20, 4);
+    entry->info.frame_count = read_le(in + 24, 4);
+    entry->info.first_frame = read_le(in + 32, 8);
+    return true;
+}
+
+static void segment_path(char *out, size_t size, const char *path, uint32_t segment, const char *extension)
+{
+    snprintf(out, size, "%s/%08u.%s", path, segment, extension);
+}
+
+/* Returns the number of the first segment that doesn't exist yet */
+static uint32_t next_segment(const char *path)
+{
+    uint32_t ret = 0;
+    DIR *dir = opendir(path);
+    if (!dir) return 0;
+    struct dirent *file;
+    while ((file = readdir(dir))) {
+        unsigned segment;
+        char extension[8];
+        if (sscanf(file->d_name, "%8u.%7s", &segment, extension) == 2 && strcmp(extension, "trace") == 0 &&
+            segment >= ret) {
+            ret = segment + 1;
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+/* Writer */
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} buffer_t;
+
+static void buffer_append(buffer_t *buffer, const void *data, size_t size)
+{
+    if (buffer->size + size > buffer->capacity) {
+        buffer->capacity = (buffer->size + size) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+}
+
+typedef struct {
+    trace_sink_t sink;
+    char *path;
+    uint32_t segment;
+    int data_fd, index_fd;
+    uint64_t segment_size; // Including batched records
+    buffer_t data_batch, index_batch;
+    unsigned batched_packets;
+} archive_sink_t;
+
+static bool write_all(int fd, const uint8_t *data, size_t size)
+{
+    while (size) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+/* The data is written first, so an index never points past its data even if the index write is lost */
+static bool flush_batch(archive_sink_t *archive)
+{
+    bool ret = write_all(archive->data_fd, archive->data_batch.data, archive->data_batch.size) &&
+               fdatasync(archive->data_fd) == 0 &&
+               write_all(archive->index_fd, archive->index_batch.data, archive->index_batch.size) &&
+               fdatasync(archive->index_fd) == 0;
+    archive->data_batch.size = archive->index_batch.size = 0;
+    archive->batched_packets = 0;
+    return ret;
+}
+
+static void close_segment(archive_sink_t *archive)
+{
+    if (archive->data_fd >= 0) close(archive->data_fd);
+    if (archive->index_fd >= 0) close(archive->index_fd);
+    archive->data_fd = archive->index_fd = -1;
+}
+
+static bool open_segment(archive_sink_t *archive, uint32_t segment)
+{
+    size_t length = strlen(archive->path) + 32;
+    char path[length];
+    archive->segment = segment;
+    archive->segment_size = 0;
+    segment_path(path, length, archive->path, segment, "trace");
+    archive->data_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    segment_path(path, length, archive->path, segment, "index");
+    archive->index_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (archive->data_fd < 0 || archive->index_fd < 0) {
+        close_segment(archive);
+        return false;
+    }
+    return true;
+}
+
+static bool archive_write(trace_sink_t *sink, const uint8_t *packet, size_t size, const trace_packet_info_t *info)
+{
+    archive_sink_t *archive = (archive_sink_t *)sink;
+    if (archive->data_fd < 0) return false;
+
+    /* Records never span segments */
+    if (archive->segment_size && archive->segment_size + RECORD_HEADER_SIZE + size > TRACE_SEGMENT_SIZE) {
+        bool flushed = flush_batch(archive);
+        close_segment(archive);
+        if (!open_segment(archive, archive->segment + 1) || !flushed) return false;
+    }
+
+    trace_archive_entry_t entry = {
+        .info = *info,
+        .size = size,
+        .crc32 = trace_crc32(packet, size),
+    };
+    uint8_t index_entry[INDEX_ENTRY_SIZE];
+    write_le(index_entry, archive->segment_size, 8);
+    encode_header(index_entry + 8, &entry);
+
+    buffer_append(&archive->data_batch, index_entry + 8, RECORD_HEADER_SIZE);
+    buffer_append(&archive->data_batch, packet, size);
+    buffer_append(&archive->index_batch, index_entry, INDEX_ENTRY_SIZE);
+    archive->segment_size += RECORD_HEADER_SIZE + size;
+
+    if (++archive->batched_packets >= TRACE_ARCHIVE_SYNC_INTERVAL && !flush_batch(archive)) {
+        /* The segment might now end with a partial record, which would hide anything appended after it */
+        close_segment(archive);
+        open_segment(archive, archive->segment + 1);
+        return false;
+    }
+    return true;
+}
+
+static void archive_close(trace_sink_t *sink)
+{
+    archive_sink_t *archive = (archive_sink_t *)sink;
+    if (archive->data_fd >= 0) {
+        flush_batch(archive);
+    }
+    close_segment(archive);
+    free(archive->data_batch.data);
+    free(archive->index_batch.data);
+    free(archive->path);
+    free(archive);
+}
+
+trace_sink_t *trace_archive_sink_create(const char *path)
+{
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) return NULL;
+
+    archive_sink_t *archive = calloc(1, sizeof(*archive));
+    archive->sink.write = archive_write;
+    archive->sink.close = archive_close;
+    archive->path = strdup(path);
+    archive->data_fd = archive->index_fd = -1;
+
+    /* Sessions never append to an existing segment, which might end with a partial record */
+    if (!open_segment(archive, next_segment(path))) {
+        archive_close(&archive->sink);
+        return NULL;
+    }
+    return &archive->sink;
+}
+
+/* Reader */
+
+static bool record_is_valid(const segment_t *segment, uint64_t offset, trace_archive_entry_t *entry)
+{
+    if (offset > segment->size || segment->size - offset < RECORD_HEADER_SIZE) return false;
+    if (!decode_header(segment->data + offset, entry)) return false;
+    if (segment->size - offset - RECORD_HEADER_SIZE < entry->size) return false;
+    entry->offset = offset + RECORD_HEADER_SIZE;
+    return true;
+}
+
+static void add_entry(trace_archive_t *archive, const trace_archive_entry_t *entry)
+{
+    if (archive->n_entries == archive->entries_capacity) {
+        archive->entries_capacity = archive->entries_capacity? archive->entries_capacity * 2 : 256;
+        archive->entries = realloc(archive->entries, archive->entries_capacity * sizeof(archive->entries[0]));
+    }
+    
+    segment_t *segment = &archive->segments[entry->segment];
+    run_t *run = segment->n_runs? &segment->runs[segment->n_runs - 1] : NULL;
+    if (!run || run->rom_crc32 != entry->info.rom_crc32 || run->session_id != entry->info.session_id ||
+        run->end_frame != entry->info.first_frame) {
+        segment->runs = realloc(segment->runs, (segment->n_runs + 1) * sizeof(segment->runs[0]));
+        run = &segment->runs[segment->n_runs++];
+        *run = (run_t){
+            .rom_crc32 = entry->info.rom_crc32,
+            .session_id = entry->info.session_id,
+            .first_frame = entry->info.first_frame,
+            .end_frame = entry->info.first_frame,
+            .first_entry = archive->n_entries,
+        };
+    }
+    run->end_frame += entry->info.frame_count;
+    run->n_entries++;
+    
+    archive->entries[archive->n_entries++] = *entry;
+}
+
+static void load_segment(trace_archive_t *archive, const char *path, uint32_t number)
+{
+    size_t length = strlen(path) + 32;
+    char file_path[length];
+    segment_path(file_path, length, path, number, "trace");
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) return;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+        close(fd);
+        return;
+    }
+    void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return;
+
+    uint32_t segment_index = archive->n_segments++;
+    archive->segments = realloc(archive->segments, archive->n_segments * sizeof(archive->segments[0]));
+    segment_t *segment = &archive->segments[segment_index];
+    *segment = (segment_t){
+        .data = data,
+        .size = file_stat.st_size,
+    };
+
+    uint64_t end = 0;
+    segment_path(file_path, length, path, number, "index");
+    FILE *index = fopen(file_path, "rb");
+    if (index) {
+        uint8_t buffer[INDEX_ENTRY_SIZE];
+        while (fread(buffer, sizeof(buffer), 1, index) == 1) {
+            trace_archive_entry_t entry;
+            uint64_t offset = read_le(buffer, 8);
+            if (offset != end || !record_is_valid(segment, offset, &entry) ||
+                memcmp(buffer + 8, segment->data + offset, RECORD_HEADER_SIZE)) {
+                break;
+            }
+            entry.segment = segment_index;
+            add_entry(archive, &entry);
+            end = entry.offset + entry.size;
+        }
+        fclose(index);
+    }
+
+    /* Recover records whose index entries were lost */
+    trace_archive_entry_t entry;
+    while (record_is_valid(segment, end, &entry) &&
+           trace_crc32(segment->data + entry.offset, entry.size) == entry.crc32) {
+        entry.segment = segment_index;
+        add_entry(archive, &entry);
+        end = entry.offset + entry.size;
+    }
+}
+
+static int compare_numbers(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+trace_archive_t *trace_archive_open(const char *path)
+{
+    DIR *dir = opendir(path);
+    if (!dir) return NULL;
+
+    uint32_t *numbers = NULL;
+    size_t count = 0;
+    struct dirent *file;
+    while ((file = readdir(dir))) {
+        unsigned segment;
+        char extension[8];
+        if (sscanf(file->d_name, "%8u.%7s", &segment, extension) == 2 && strcmp(extension, "trace") == 0) {
+            numbers = realloc(numbers, (count + 1) * sizeof(numbers[0]));
+            numbers[count++] = segment;
+        }
+    }
+    closedir(dir);
+    qsort(numbers, count, sizeof(numbers[0]), compare_numbers);
+
+    trace_archive_t *archive = calloc(1, sizeof(*archive));
+    for (size_t i = 0; i < count; i++) {
+        load_segment(archive, path, numbers[i]);
+    }
+    free(numbers);
+    return archive;
+}
+
+void trace_archive_close(trace_archive_t *archive)
+{
+    if (!archive) return;
+    for (uint32_t i = 0; i < archive->n_segments; i++) {
+        munmap((void *)archive->segments[i].data, archive->segments[i].size);
+        free(archive->segments[i].runs);
+    }
+    free(archive->segments);
+    free(archive->entries);
+    free(archive);
+}
+
+#else
+
+trace_sink_t *trace_archive_sink_create(const char *path)
+{
+    return NULL;
+}
+
+trace_archive_t *trace_archive_open(const char *path)
+{
+    return NULL;
+}
+
+void trace_archive_close(trace_archive_t *archive)
+{
+}
+
+#endif
+
+size_t trace_archive_count(const trace_archive_t *archive)
+{
+    return archive->n_entries;
+}
+
+const trace_archive_entry_t *trace_archive_entry(const trace_archive_t *archive, size_t index)
+{
+    if (index >= archive->n_entries) return NULL;
+    return &archive->entries[index];
+}
+
+const uint8_t *trace_archive_packet(const trace_archive_t *archive, size_t index, size_t *size)
+{
+    const trace_archive_entry_t *entry = trace_archive_entry(archive, index);
+    if (!entry) return NULL;
+    const uint8_t *packet = archive->segments[entry->segment].data + entry->offset;
+    if (trace_crc32(packet, entry->size) != entry->crc32) return NULL;
+    *size = entry->size;
+    return packet;
+}
+
+size_t trace_archive_find(const trace_archive_t *archive, uint32_t rom_crc32, uint32_t session_id, uint64_t frame)
+{
+    for (uint32_t i = 0; i < archive->n_segments; i++) {
+        const segment_t *segment = &archive->segments[i];
+        for (size_t j = 0; j < segment->n_runs; j++) {
+            const run_t *run = &segment->runs[j];
+            if (run->rom_crc32 != rom_crc32 || run->session_id != session_id ||
+                frame < run->first_frame || frame >= run->end_frame) {
+                continue;
+            }
+            
+            /* Runs cover their frames without gaps, so the last record starting at or before frame covers it */
+            size_t low = run->first_entry, high = run->first_entry + run->n_entries;
+            while (high - low > 1) {
+                size_t middle = low + (high - low) / 2;
+                if (archive->entries[middle].info.first_frame <= frame) {
+                    low = middle;
+                }
+                else {
+                    high = middle;
+                }
+            }
+            return low;
+        }
+    }
+    return SIZE_MAX;
+}
+
+/* Self test */
+
+static uint8_t test_packet_byte(const trace_packet_info_t *info, size_t offset)
+{
+    return (info->session_id * 0x9E + info->sequence_number * 0x3B + offset * 0x11 + (offset >> 8)) & 0xFF;
+}
+
+static size_t test_packet_size(const trace_packet_info_t *info)
+{
+    return 1 + (info->sequence_number * 7919 + info->session_id * 104729) % 0x10000;
+}
+
+static bool write_test_session(trace_sink_t *sink, trace_packet_info_t *info, unsigned packets)
+{
+    for (unsigned i = 0; i < packets; i++) {
+        info->frame_count = 1 + (info->sequence_number * 37 + info->session_id) % 1200;
+        size_t size = test_packet_size(info);
+        uint8_t *packet = malloc(size);
+        for (size_t j = 0; j < size; j++) {
+            packet[j] = test_packet_byte(info, j);
+        }
+        bool written = sink->write(sink, packet, size, info);
+        free(packet);
+        if (!written) return false;
+        info->first_frame += info->frame_count;
+        info->sequence_number++;
+    }
+    return true;
+}
+
+static bool check_test_packet(const trace_archive_t *archive, const trace_packet_info_t *info, uint64_t frame)
+{
+    size_t index = trace_archive_find(archive, info->rom_crc32, info->session_id, frame);
+    if (index == SIZE_MAX) {
+        fprintf(stderr, "Frame %llu of session %u not found\n", (unsigned long long)frame, info->session_id);
+        return false;
+    }
+    const trace_packet_info_t *found = &trace_archive_entry(archive, index)->info;
+    if (found->rom_crc32 != info->rom_crc32 || found->session_id != info->session_id ||
+        found->sequence_number != info->sequence_number || found->first_frame != info->first_frame ||
+        found->frame_count != info->frame_count) {
+        fprintf(stderr, "Frame %llu of session %u found in the wrong packet\n", (unsigned long long)frame, info->session_id);
+        return false;
+    }
+    size_t size;
+    const uint8_t *packet = trace_archive_packet(archive, index, &size);
+    if (!packet || size != test_packet_size(info)) {
+        fprintf(stderr, "Packet %u of session %u is corrupt\n", info->sequence_number, info->session_id);
+        return false;
+    }
+    for (size_t i = 0; i < size; i++) {
+        if (packet[i] != test_packet_byte(info, i)) {
+            fprintf(stderr, "Packet %u of session %u reads back differently\n", info->sequence_number, info->session_id);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Reads every packet back, by its first and last frame */
+static bool check_test_session(const trace_archive_t *archive, trace_packet_info_t info, unsigned packets)
+{
+    for (unsigned i = 0; i < packets; i++) {
+        info.frame_count = 1 + (info.sequence_number * 37 + info.session_id) % 1200;
+        if (!check_test_packet(archive, &info, info.first_frame) ||
+            !check_test_packet(archive, &info, info.first_frame + info.frame_count - 1)) {
+            return false;
+        }
+        info.first_frame += info.frame_count;
+        info.sequence_number++;
+    }
+    if (trace_archive_find(archive, info.rom_crc32, info.session_id, info.first_frame) != SIZE_MAX) {
+        fprintf(stderr, "Frame %llu of session %u found past its end\n", (unsigned long long)info.first_frame, info.session_id);
+        return false;
+    }
+    return true;
+}
+
+bool trace_archive_self_test(const char *path)
+{
+    /* Sessions of two ROMs: one per sink, one long enough to fill a segment, then two interleaved in the same sink,
+       one of which continues the first session, so segments hold several runs and sessions span several segments */
+    trace_packet_info_t first = {.rom_crc32 = 0x12345678, .session_id = 1};
+    trace_packet_info_t second = {.rom_crc32 = 0x9ABCDEF0, .session_id = 2};
+    trace_packet_info_t third = {.rom_crc32 = 0x12345678, .session_id = 3};
+    trace_packet_info_t first_start = first, second_start = second, third_start = third;
+    
+    trace_sink_t *sink = trace_archive_sink_create(path);
+    if (!sink) {
+        fprintf(stderr, "Failed to create trace archive %s\n", path);
+        return false;
+    }
+    bool written = write_test_session(sink, &first, 200);
+    sink->close(sink);
+    
+    sink = trace_archive_sink_create(path);
+    written = written && sink && write_test_session(sink, &second, 2500);
+    if (sink) sink->close(sink);
+    
+    sink = trace_archive_sink_create(path);
+    for (unsigned i = 0; written && sink && i < 50; i++) {
+        written = write_test_session(sink, &third, 2) && write_test_session(sink, &first, 1);
+    }
+    if (sink) sink->close(sink);
+    if (!written || !sink) {
+        fprintf(stderr, "Failed to write to trace archive %s\n", path);
+        return false;
+    }
+    
+    trace_archive_t *archive = trace_archive_open(path);
+    if (!archive) {
+        fprintf(stderr, "Failed to open trace archive %s\n", path);
+        return false;
+    }
+    bool ret = true;
+    if (trace_archive_count(archive) != 200 + 2500 + 150) {
+        fprintf(stderr, "Trace archive has %zu packets instead of %u\n", trace_archive_count(archive), 200 + 2500 + 150);
+        ret = false;
+    }
+    ret = ret &&
+          check_test_session(archive, first_start, 250) &&
+          check_test_session(archive, second_start, 2500) &&
+          check_test_session(archive, third_start, 100);
+    if (ret && trace_archive_find(archive, second.rom_crc32, first.session_id, 0) != SIZE_MAX) {
+        fprintf(stderr, "Session %u found under the wrong ROM\n", first.session_id);
+        ret = false;
+    }
+    trace_archive_close(archive);
+    return ret;
+}
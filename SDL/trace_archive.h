@@ -0,0 +1,37 @@
+#pragma once
+#include "trace.h"
+
+/* A trace archive is a directory of append-only segments. Each segment is a data file of packet records, at most
+   TRACE_SEGMENT_SIZE bytes long, and an index file with one entry per record, so readers can find packets by ROM,
+   session and frame without scanning the data. */
+#define TRACE_SEGMENT_SIZE (64 * 1024 * 1024)
+
+/* Writes are batched, and synced to disk every TRACE_ARCHIVE_SYNC_INTERVAL packets (about a minute of play) and when
+   the sink is closed. Returns NULL if the archive can't be created. */
+#define TRACE_ARCHIVE_SYNC_INTERVAL 3
+trace_sink_t *trace_archive_sink_create(const char *path);
+
+typedef struct {
+    trace_packet_info_t info;
+    uint32_t segment; // Index into the archive's segments
+    uint32_t size;
+    uint32_t crc32;
+    uint64_t offset; // Of the packet within the segment's data
+} trace_archive_entry_t;
+
+typedef struct trace_archive_s trace_archive_t;
+
+/* Maps all segments of an archive. Records missing from an index, such as after a crash, are recovered by scanning
+   the data past the last indexed record. */
+trace_archive_t *trace_archive_open(const char *path);
+void trace_archive_close(trace_archive_t *archive);
+size_t trace_archive_count(const trace_archive_t *archive);
+const trace_archive_entry_t *trace_archive_entry(const trace_archive_t *archive, size_t index);
+/* Returns a pointer into the mapped segment, valid until the archive is closed, or NULL if the packet is corrupt */
+const uint8_t *trace_archive_packet(const trace_archive_t *archive, size_t index, size_t *size);
+/* Returns the index of the session's packet that covers frame, or SIZE_MAX if there is none */
+size_t trace_archive_find(const trace_archive_t *archive, uint32_t rom_crc32, uint32_t session_id, uint64_t frame);
+
+/* Writes sessions to a new archive at path, then finds and reads every packet back. Returns false, after printing the
+   first mismatch, if anything doesn't round-trip. */
+bool trace_archive_self_test(const char *path);
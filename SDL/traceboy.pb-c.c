@@ -97,7 +97,7 @@ void   empty__free_unpacked
   assert(message->base.descriptor == &empty__descriptor);
   protobuf_c_message_free_unpacked ((ProtobufCMessage*)message, allocator);
 }
-static const ProtobufCFieldDescriptor trace_packet__field_descriptors[4] =
+static const ProtobufCFieldDescriptor trace_packet__field_descriptors[7] =
 {
   {
     "game_rom_crc32",
@@ -147,17 +147,56 @@ static const ProtobufCFieldDescriptor trace_packet__field_descriptors[4] =
     0,             /* flags */
     0,NULL,NULL    /* reserved1,reserved2, etc */
   },
+  {
+    "sequence_number",
+    5,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(TracePacket, sequence_number),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "parent_state_crc32",
+    6,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_UINT32,
+    0,   /* quantifier_offset */
+    offsetof(TracePacket, parent_state_crc32),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
+  {
+    "end_state_delta",
+    7,
+    PROTOBUF_C_LABEL_NONE,
+    PROTOBUF_C_TYPE_BYTES,
+    0,   /* quantifier_offset */
+    offsetof(TracePacket, end_state_delta),
+    NULL,
+    NULL,
+    0,             /* flags */
+    0,NULL,NULL    /* reserved1,reserved2, etc */
+  },
 };
 static const unsigned trace_packet__field_indices_by_name[] = {
   3,   /* field[3] = end_state_crc32 */
+  6,   /* field[6] = end_state_delta */
   0,   /* field[0] = game_rom_crc32 */
+  5,   /* field[5] = parent_state_crc32 */
+  4,   /* field[4] = sequence_number */
   1,   /* field[1] = start_state */
   2,   /* field[2] = user_inputs */
 };
 static const ProtobufCIntRange trace_packet__number_ranges[1 + 1] =
 {
   { 1, 0 },
-  { 0, 4 }
+  { 0, 7 }
 };
 const ProtobufCMessageDescriptor trace_packet__descriptor =
 {
@@ -167,7 +206,7 @@ const ProtobufCMessageDescriptor trace_packet__descriptor =
   "TracePacket",
   "",
   sizeof(TracePacket),
-  4,
+  7,
   trace_packet__field_descriptors,
   trace_packet__field_indices_by_name,
   1,  trace_packet__number_ranges,
@@ -31,10 +31,13 @@ struct  TracePacket
   ProtobufCBinaryData start_state;
   ProtobufCBinaryData user_inputs;
   uint32_t end_state_crc32;
+  uint32_t sequence_number;
+  uint32_t parent_state_crc32;
+  ProtobufCBinaryData end_state_delta;
 };
 #define TRACE_PACKET__INIT \
  { PROTOBUF_C_MESSAGE_INIT (&trace_packet__descriptor) \
-, 0, {0,NULL}, {0,NULL}, 0 }
+, 0, {0,NULL}, {0,NULL}, 0, 0, 0, {0,NULL} }
 
 
 struct  Empty
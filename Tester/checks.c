@@ -0,0 +1,986 @@
+// The checks compare internal state, and force fast paths off
+#define GB_INTERNAL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "checks.h"
+
+/* One frame, approximately 1/60 a second. Intentionally not the actual length of a frame, like the tester's main loop. */
+#define FRAME_CYCLES 139810
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void print_speedup(const char *name, unsigned frames, double time, double reference_time, const char *reference)
+{
+    fprintf(stderr, "%s: %.0f frames per second, %.0f %s (%.2fx)\n",
+            name, frames / time, frames / reference_time, reference, reference_time / time);
+}
+
+/* Acquires an instance of gb's model running gb's boot ROM and rom, with the RTC's epoch pinned so it can be compared */
+static GB_gameboy_t *acquire_reference(GB_pool_t *pool, GB_gameboy_t *gb, const uint8_t *rom, size_t rom_size)
+{
+    GB_gameboy_t *reference = GB_pool_acquire(pool, GB_get_model(gb));
+    GB_load_boot_rom_from_buffer(reference, gb->boot_rom, sizeof(gb->boot_rom));
+    GB_load_rom_from_buffer(reference, rom, rom_size);
+    reference->last_rtc_second = 0;
+    return reference;
+}
+
+/* A boot ROM that only unmaps itself, leaving the CPU at $0100, on every model */
+static const uint8_t stub_boot_rom[] = {
+    0xC3, 0xFC, 0x00, // JP $00FC
+    [0xFC] =
+    0x3E, 0x11,       // LD A, $11
+    0xE0, GB_IO_BANK, // LDH [BANK], A
+};
+
+/* Returns a 32KiB ROM running code from $0150, on a cartridge of the given type and RAM size (header bytes $147 and
+   $149). The rest of the ROM is filled with a pattern, so DMAs from it copy something. */
+static uint8_t *create_test_rom(const uint8_t *code, size_t size, uint8_t cartridge_type, uint8_t ram_size)
+{
+    uint8_t *rom = malloc(0x8000);
+    for (unsigned i = 0; i < 0x8000; i++) {
+        rom[i] = i ^ (i >> 8);
+    }
+    memset(rom + 0x100, 0, 0x50);
+    memcpy(rom + 0x100, (uint8_t[]){0xC3, 0x50, 0x01}, 3); // JP $0150
+    rom[0x147] = cartridge_type;
+    rom[0x149] = ram_size;
+    memcpy(rom + 0x150, code, size);
+    return rom;
+}
+
+/* Runs gb for the given number of frames, returning the time it took. The state hash at the end of each frame is
+   stored in hashes. */
+static double run_frames(GB_gameboy_t *gb, unsigned frames, uint64_t *hashes)
+{
+    double time = 0;
+    for (unsigned frame = 0; frame < frames; frame++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (unsigned cycles = 0; cycles < FRAME_CYCLES;) {
+            cycles += GB_run(gb);
+        }
+        time += seconds_since(&start);
+        hashes[frame] = GB_get_state_hash(gb);
+    }
+    return time;
+}
+
+static unsigned first_difference(const uint64_t *hashes, const uint64_t *reference, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++) {
+        if (hashes[i] != reference[i]) return i;
+    }
+    return count;
+}
+
+/* Compares anything else after each GB_run of run_lockstep, given the cycles it ran, returning false (once logged) if
+   gb diverged */
+typedef bool (*lockstep_step_t)(GB_gameboy_t *log, GB_gameboy_t *gb, GB_gameboy_t *reference, unsigned frame,
+                                unsigned cycles);
+
+/* Runs gb and reference in lockstep for the given number of frames, comparing the cycles and CPU state of every
+   GB_run, and if compare_hashes is set, the state hashes other than the region named ignored when each frame starts
+   and ends. The first divergence of gb, described as name, is logged to log, and the frame it happened in is returned;
+   frames if none. */
+static unsigned run_lockstep(GB_gameboy_t *log, GB_gameboy_t *gb, GB_gameboy_t *reference, unsigned frames,
+                             const char *name, bool compare_hashes, const char *ignored, lockstep_step_t step)
+{
+    unsigned count = GB_get_state_hash_count(reference);
+    uint32_t *hashes = malloc(count * sizeof(*hashes) * 2);
+    unsigned frame;
+    for (frame = 0;; frame++) {
+        GB_get_state_hashes(gb, hashes);
+        GB_get_state_hashes(reference, hashes + count);
+        bool diverged = false;
+        for (unsigned i = 0; compare_hashes && i < count; i++) {
+            char region[32];
+            GB_get_state_hash_name(reference, i, region, sizeof(region));
+            if (hashes[i] != hashes[count + i] && !(ignored && strcmp(region, ignored) == 0)) {
+                if (!diverged) {
+                    GB_log(log, "%s diverged when frame %u started, in:\n", name, frame);
+                }
+                GB_log(log, "    %s\n", region);
+                diverged = true;
+            }
+        }
+        if (diverged || frame == frames) break;
+        
+        for (unsigned cycles = 0; cycles < FRAME_CYCLES;) {
+            unsigned run_cycles = GB_run(gb);
+            unsigned reference_cycles = GB_run(reference);
+            if (run_cycles != reference_cycles || gb->pc != reference->pc ||
+                memcmp(gb->registers, reference->registers, sizeof(gb->registers))) {
+                GB_log(log, "%s diverged in frame %u: PC $%04x after %u cycles, vs. PC $%04x after %u cycles\n",
+                       name, frame, gb->pc, run_cycles, reference->pc, reference_cycles);
+                goto exit;
+            }
+            cycles += run_cycles;
+            if (step && !step(log, gb, reference, frame, run_cycles)) goto exit;
+        }
+    }
+exit:
+    free(hashes);
+    return frame;
+}
+
+/* Linked tests run the ROM on both ends of a threaded link, and on both ends of an always interleaved one as the
+   reference, holding A on the first end of each so a ROM can tell its ends apart. Every instance's state is hashed on
+   each of its vblanks, a point that doesn't depend on how the run was split into quanta, and the hashes of each end
+   must match its reference. */
+typedef struct {
+    uint64_t *hashes;
+    unsigned count, limit;
+} link_end_t;
+
+static void link_vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
+{
+    link_end_t *end = GB_get_user_data(gb);
+    if (end->count < end->limit) {
+        end->hashes[end->count++] = GB_get_state_hash(gb);
+    }
+}
+
+static double link_run(GB_link_t *link, link_end_t *ends)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (ends[0].count < ends[0].limit || ends[1].count < ends[1].limit) {
+        GB_link_run_frame(link);
+    }
+    return seconds_since(&start);
+}
+
+/* instances hold two pairs running the same ROM, the first one is linked interleaved as the reference */
+static void compare_links(GB_gameboy_t *log, GB_gameboy_t *instances[4], unsigned frames, const char *name)
+{
+    link_end_t ends[4];
+    for (unsigned i = 0; i < 4; i++) {
+        instances[i]->last_rtc_second = 0;
+        ends[i].hashes = malloc(frames * sizeof(ends[i].hashes[0]));
+        ends[i].count = 0;
+        ends[i].limit = frames;
+        GB_set_user_data(instances[i], &ends[i]);
+        GB_set_vblank_callback(instances[i], link_vblank);
+        GB_set_key_state(instances[i], GB_KEY_A, !(i & 1));
+    }
+    
+    GB_link_t *reference = GB_link_create(instances[0], instances[1], false);
+    GB_link_set_interleaved(reference, true);
+    double reference_time = link_run(reference, &ends[0]);
+    GB_link_destroy(reference);
+    
+    GB_link_t *link = GB_link_create(instances[2], instances[3], true);
+    double time = link_run(link, &ends[2]);
+    GB_link_destroy(link);
+    
+    print_speedup(name, frames, time, reference_time, "when interleaved");
+    for (unsigned i = 0; i < 2; i++) {
+        unsigned frame = first_difference(ends[i + 2].hashes, ends[i].hashes, frames);
+        if (frame != frames) {
+            GB_log(log, "%s: instance %u diverged from interleaved execution in frame %u\n", name, i, frame);
+        }
+    }
+    
+    for (unsigned i = 0; i < 4; i++) {
+        free(ends[i].hashes);
+        GB_set_user_data(instances[i], NULL);
+        GB_set_vblank_callback(instances[i], NULL);
+    }
+}
+
+static void run_link_test(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames)
+{
+    GB_gameboy_t *instances[4] = {gb};
+    for (unsigned i = 1; i < 4; i++) {
+        instances[i] = acquire_reference(pool, gb, gb->rom, gb->rom_size);
+    }
+    compare_links(gb, instances, frames, "Linked pair");
+    for (unsigned i = 1; i < 4; i++) {
+        GB_pool_release(pool, instances[i]);
+    }
+}
+
+/* Both ends sense infrared on and off, at different rates. The end holding A blinks its LED, and the other one echoes
+   what it senses with its own LED, and logs it to WRAM. */
+static const uint8_t infrared_workload[] = {
+    0x31, 0xFE, 0xFF,       // LD SP, $FFFE
+    0x21, 0x00, 0xC0,       // LD HL, $C000
+    0x3E, 0x10,             // LD A, $10
+    0xE0, GB_IO_JOYP,       // LDH [JOYP], A
+    /* Loop: */
+    0x03,                   // INC BC
+    0xF0, GB_IO_JOYP,       // LDH A, [JOYP]
+    0x1F,                   // RRA
+    0x38, 0x0D,             // JR C, Echo
+    0x78,                   // LD A, B
+    0xE6, 0x01,             // AND $01
+    0xCB, 0x58,             // BIT 3, B
+    0x28, 0x02,             // JR Z, +2
+    0xF6, 0xC0,             // OR $C0
+    0xE0, GB_IO_RP,         // LDH [RP], A
+    0x18, -0x13,            // JR Loop
+    /* Echo: */
+    0xF0, GB_IO_RP,         // LDH A, [RP]
+    0x22,                   // LD [HL+], A
+    0xCB, 0xA4,             // RES 4, H
+    0x2F,                   // CPL
+    0x1F,                   // RRA
+    0xE6, 0x01,             // AND $01
+    0xCB, 0x50,             // BIT 2, B
+    0x28, 0x02,             // JR Z, +2
+    0xF6, 0xC0,             // OR $C0
+    0xE0, GB_IO_RP,         // LDH [RP], A
+    0x18, -0x26,            // JR Loop
+};
+
+static void run_infrared_link_test(GB_pool_t *pool, unsigned frames)
+{
+    uint8_t *rom = create_test_rom(infrared_workload, sizeof(infrared_workload), 0x00, 0); // ROM only
+    GB_gameboy_t *instances[4];
+    for (unsigned i = 0; i < 4; i++) {
+        instances[i] = GB_pool_acquire_booted(pool, GB_MODEL_CGB_E, stub_boot_rom, sizeof(stub_boot_rom), rom, 0x8000);
+    }
+    compare_links(instances[0], instances, frames, "Infrared linked pair");
+    for (unsigned i = 0; i < 4; i++) {
+        GB_pool_release(pool, instances[i]);
+    }
+    free(rom);
+}
+
+static bool has_cheat[0x10000];
+
+/* Applies the cheat list the straightforward way, what the cheat index must be equivalent to */
+static uint8_t reference_cheat(GB_gameboy_t *gb, uint16_t address, uint8_t value)
+{
+    uint16_t bank = 0;
+    if (address < 0x4000) {
+        bank = gb->mbc_rom0_bank;
+    }
+    else if (address < 0x8000) {
+        bank = gb->mbc_rom_bank;
+    }
+    else if (address >= 0xD000 && address < 0xE000) {
+        bank = gb->cgb_ram_bank;
+    }
+    size_t count;
+    const GB_cheat_t *const *cheats = GB_get_cheats(gb, &count);
+    if (!has_cheat[address]) return value;
+    for (size_t i = 0; i < count; i++) {
+        const GB_cheat_t *cheat = cheats[i];
+        if (!cheat->enabled || cheat->address != address) continue;
+        if (cheat->use_old_value && cheat->old_value != value) continue;
+        if (cheat->bank != GB_CHEAT_ANY_BANK && cheat->bank != bank) continue;
+        return cheat->value;
+    }
+    return value;
+}
+
+static unsigned next_random(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+/* Runs the ROM with 500 active cheats on ROM and WRAM and without them. The cheats only apply when a read gives the
+   value they replace it with, so the ROM runs the same either way, checked by comparing state hashes every frame. */
+static void run_with_active_cheats(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames)
+{
+    const unsigned count = 500;
+    uint64_t *hashes = malloc(frames * sizeof(*hashes) * 2);
+    double times[2];
+    for (unsigned active = 0; active < 2; active++) {
+        GB_gameboy_t *instance = acquire_reference(pool, gb, gb->rom, gb->rom_size);
+        uint32_t seed = 2;
+        for (unsigned i = 0; active && i < count; i++) {
+            uint16_t address = (i & 1)? next_random(&seed) & 0x7FFF : 0xC000 | (next_random(&seed) & 0x1FFF);
+            uint8_t value = next_random(&seed);
+            GB_add_cheat(instance, "", address, i % 4? GB_CHEAT_ANY_BANK : next_random(&seed) & 7, value, value, true, true);
+        }
+        GB_set_cheats_enabled(instance, active);
+        times[active] = run_frames(instance, frames, hashes + active * frames);
+        GB_pool_release(pool, instance);
+    }
+    print_speedup("With 500 active cheats", frames, times[1], times[0], "without cheats");
+    unsigned diverged = first_difference(hashes + frames, hashes, frames);
+    if (diverged != frames) {
+        fprintf(stderr, "Cheats that keep the values they read diverged from running without cheats in frame %u\n", diverged);
+    }
+    free(hashes);
+}
+
+static void run_cheat_test(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames)
+{
+    const unsigned count = 2000;
+    uint32_t seed = 1;
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned i = 0; i < count; i++) {
+        /* Keep addresses clustered so many of them have several cheats */
+        uint16_t address = (next_random(&seed) & 0x7FF) | ((i & 1)? 0x4000 : 0xC000);
+        unsigned type = next_random(&seed) % 3;
+        GB_add_cheat(gb, "", address, type == 1? next_random(&seed) & 3 : GB_CHEAT_ANY_BANK, next_random(&seed),
+                     next_random(&seed) & 3, type == 2, next_random(&seed) % 8);
+    }
+    double add_time = seconds_since(&start);
+    
+    /* Changes and removals after the index was last used */
+    size_t current_count;
+    const GB_cheat_t *const *cheats = GB_get_cheats(gb, &current_count);
+    for (unsigned i = 0; i < count / 10; i++) {
+        const GB_cheat_t *cheat = cheats[next_random(&seed) % current_count];
+        GB_update_cheat(gb, cheat, cheat->description, cheat->address ^ 0x10, cheat->bank, cheat->value,
+                        cheat->old_value, cheat->use_old_value, !cheat->enabled);
+        GB_remove_cheat(gb, cheats[next_random(&seed) % current_count]);
+        cheats = GB_get_cheats(gb, &current_count);
+    }
+    
+    memset(has_cheat, 0, sizeof(has_cheat));
+    for (size_t i = 0; i < current_count; i++) {
+        has_cheat[cheats[i]->address] = true;
+    }
+    
+    bool boot_rom_finished = gb->boot_rom_finished;
+    bool cheats_enabled = GB_cheats_enabled(gb);
+    uint16_t rom_bank = gb->mbc_rom_bank;
+    gb->boot_rom_finished = true;
+    GB_set_cheats_enabled(gb, true);
+    
+    unsigned reads = 0;
+    unsigned mismatches = 0;
+    for (uint16_t bank = 0; bank < 4; bank++) {
+        gb->mbc_rom_bank = bank;
+        for (unsigned value = 0; value < 4; value++) {
+            for (unsigned address = 0; address < 0x10000; address++) {
+                uint8_t data = value;
+                GB_apply_cheat(gb, address, &data);
+                reads++;
+                if (data != reference_cheat(gb, address, value) && !mismatches++) {
+                    GB_log(gb, "Indexed cheats give $%02x for $%04x in bank %u, the cheat list gives $%02x\n",
+                           data, address, bank, reference_cheat(gb, address, value));
+                }
+            }
+        }
+    }
+    
+    /* Timed separately, the reference lookup would dominate the loop above */
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    volatile uint8_t sink = 0;
+    for (unsigned i = 0; i < reads; i++) {
+        uint8_t data = i;
+        GB_apply_cheat(gb, i * 0x9E37, &data);
+        sink += data;
+    }
+    double read_time = seconds_since(&start);
+    
+    fprintf(stderr, "Cheats: %u added in %.2f ms, %.1f ns per read\n", count, add_time * 1000, read_time * 1e9 / reads);
+    if (mismatches) {
+        GB_log(gb, "%u cheated reads differ from the cheat list\n", mismatches);
+    }
+    
+    while (GB_get_cheats(gb, &current_count), current_count) {
+        GB_remove_cheat(gb, GB_get_cheats(gb, NULL)[0]);
+    }
+    gb->mbc_rom_bank = rom_bank;
+    gb->boot_rom_finished = boot_rom_finished;
+    GB_set_cheats_enabled(gb, cheats_enabled);
+    
+    run_with_active_cheats(pool, gb, frames);
+}
+
+static void run_batch_test(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames)
+{
+    const unsigned count = 8, frames_per_step = 10;
+    GB_batch_t *batch = GB_batch_create(count, GB_get_model(gb), 1);
+    for (unsigned i = 0; i < count; i++) {
+        GB_load_boot_rom_from_buffer(GB_batch_get_instance(batch, i), gb->boot_rom, sizeof(gb->boot_rom));
+    }
+    GB_batch_load_rom_from_buffer(batch, gb->rom, gb->rom_size);
+    GB_key_mask_t actions[count];
+    memset(actions, 0, sizeof(actions));
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned frame = 0; frame < frames; frame += frames_per_step) {
+        GB_batch_step(batch, actions, frames_per_step, NULL);
+    }
+    double time = seconds_since(&start);
+    fprintf(stderr, "Batch of %u: %.0f frames per second per instance, %.0f in total\n",
+            count, frames / time, frames * count / time);
+    GB_batch_free(batch);
+}
+
+/* Compares STAT and LY as the CPU sees them about once per line. A line is 912 8MHz cycles in single speed. Reading in
+   the middle of Mode 3 makes the batched instance run it unbatched, so the point in the line these reads happen at
+   drifts by a dot every line. */
+static bool compare_lines(GB_gameboy_t *log, GB_gameboy_t *gb, GB_gameboy_t *reference, unsigned frame, unsigned cycles)
+{
+    static unsigned line_cycles;
+    line_cycles += cycles;
+    if (line_cycles < 914) return true;
+    line_cycles = 0;
+    uint8_t stat = GB_safe_read_memory(gb, 0xFF00 + GB_IO_STAT);
+    uint8_t ly = GB_safe_read_memory(gb, 0xFF00 + GB_IO_LY);
+    uint8_t reference_stat = GB_safe_read_memory(reference, 0xFF00 + GB_IO_STAT);
+    uint8_t reference_ly = GB_safe_read_memory(reference, 0xFF00 + GB_IO_LY);
+    if (stat != reference_stat || ly != reference_ly) {
+        GB_log(log, "Batched Mode 3 diverged in frame %u: PC $%04x, STAT $%02x, LY %u, unbatched PC $%04x, STAT $%02x, LY %u\n",
+               frame, gb->pc, stat, ly, reference->pc, reference_stat, reference_ly);
+        return false;
+    }
+    return true;
+}
+
+/* Runs a second instance with Mode 3 batching disabled in lockstep. Batching leaves the PPU's internal state different
+   from unbatched Mode 3 until the CPU looks, so only what the CPU sees is compared. */
+static void run_batching_test(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames)
+{
+    GB_gameboy_t *reference = acquire_reference(pool, gb, gb->rom, gb->rom_size);
+    reference->debug_flags |= GB_DEBUG_NO_MODE3_BATCHING;
+    gb->last_rtc_second = 0;
+#ifdef GB_ENABLE_PERF_COUNTERS
+    uint64_t batched = gb->perf_counters.mode3_batched, unbatched = gb->perf_counters.mode3_unbatched;
+#endif
+    
+    run_lockstep(gb, gb, reference, frames, "Batched Mode 3", false, NULL, compare_lines);
+
+#ifdef GB_ENABLE_PERF_COUNTERS
+    batched = gb->perf_counters.mode3_batched - batched;
+    unbatched = gb->perf_counters.mode3_unbatched - unbatched;
+    fprintf(stderr, "Mode 3 batched lines: %llu of %llu\n", (unsigned long long)batched, (unsigned long long)(batched + unbatched));
+#endif
+    GB_pool_release(pool, reference);
+}
+
+/* Acquires an instance running rom booted through the pool's boot cache, shared by every ROM of the run, then checks its
+   state against a real boot, and keeps both running for a second to catch anything the state hashes don't cover */
+static void check_skipped_boot(GB_pool_t *pool, GB_gameboy_t *gb, const uint8_t *rom, size_t rom_size)
+{
+    GB_gameboy_t *reference = acquire_reference(pool, gb, rom, rom_size);
+    
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    GB_reset(reference);
+    while (!reference->boot_rom_finished) {
+        GB_run(reference);
+    }
+    double boot_time = seconds_since(&start);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    GB_gameboy_t *skipped = GB_pool_acquire_booted(pool, GB_get_model(gb), gb->boot_rom, sizeof(gb->boot_rom),
+                                                   rom, rom_size);
+    double skip_time = seconds_since(&start);
+    skipped->last_rtc_second = 0;
+    fprintf(stderr, "Booted acquisition: %.2fms, booting took %.2fms\n", skip_time * 1000, boot_time * 1000);
+    
+    /* The RTC doesn't advance for the skipped boot */
+    run_lockstep(gb, skipped, reference, 60, "Skipped boot", true, "rtc", NULL);
+    GB_pool_release(pool, skipped);
+    GB_pool_release(pool, reference);
+}
+
+static void run_boot_cache_test(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames)
+{
+    check_skipped_boot(pool, gb, gb->rom, gb->rom_size);
+    
+    /* The same ROM on a cartridge with a different RAM size boots the same way, but must not share its cache entry */
+    uint8_t *rom = malloc(gb->rom_size);
+    memcpy(rom, gb->rom, gb->rom_size);
+    if (gb->mbc_ram_size == 0x8000) {
+        rom[0x147] = 0x19; // MBC5
+        rom[0x149] = 0;
+    }
+    else {
+        rom[0x147] = 0x1A; // MBC5+RAM
+        rom[0x149] = 3; // 32KiB
+    }
+    check_skipped_boot(pool, gb, rom, gb->rom_size);
+    free(rom);
+}
+
+/* Fills cartridge RAM with a pattern that changes on every pass */
+static const uint8_t cartridge_ram_workload[] = {
+    0x3E, 0x0A,             // LD A, $0A
+    0xEA, 0x00, 0x00,       // LD [$0000], A
+    /* Loop: */
+    0x04,                   // INC B
+    0x21, 0x00, 0xA0,       // LD HL, $A000
+    /* Fill: */
+    0x7D,                   // LD A, L
+    0x80,                   // ADD A, B
+    0x22,                   // LD [HL+], A
+    0x7C,                   // LD A, H
+    0xFE, 0xC0,             // CP $C0
+    0x20, -8,               // JR NZ, Fill
+    0x18, -14,              // JR Loop
+};
+
+/* Runs short jobs on cartridges with different RAM sizes and on different models back to back, so pooled instances and
+   the boot cache keep switching between them. Each job is acquired booted, and checked against a fresh instance booted
+   for real. */
+static void run_pool_jobs_test(GB_pool_t *pool, unsigned frames)
+{
+    static const GB_model_t models[] = {
+        GB_MODEL_DMG_B, GB_MODEL_CGB_E, GB_MODEL_MGB, GB_MODEL_AGB_A, GB_MODEL_SGB2, GB_MODEL_CGB_C,
+    };
+    static const struct {
+        const char *name;
+        uint8_t cartridge_type, ram_size;
+    } cartridges[] = {
+        {"no RAM", 0x00, 0},
+        {"8KiB of RAM", 0x03, 2}, // MBC1+RAM+BATTERY
+        {"32KiB of RAM", 0x1A, 3}, // MBC5+RAM
+        {"2KiB of RAM", 0x02, 1}, // MBC1+RAM
+    };
+    const unsigned model_count = sizeof(models) / sizeof(models[0]);
+    const unsigned cartridge_count = sizeof(cartridges) / sizeof(cartridges[0]);
+    if (frames > 30) {
+        frames = 30;
+    }
+    
+    uint8_t *roms[cartridge_count];
+    for (unsigned i = 0; i < cartridge_count; i++) {
+        roms[i] = create_test_rom(cartridge_ram_workload, sizeof(cartridge_ram_workload),
+                                  cartridges[i].cartridge_type, cartridges[i].ram_size);
+    }
+    
+    GB_profile_t profile = {.rendering_disabled = true};
+    GB_pool_set_profile(pool, &profile);
+    unsigned jobs = 0, diverged = 0;
+    /* Every model meets every cartridge twice, the second time through the boot cache */
+    for (unsigned pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < model_count * cartridge_count; i++) {
+            GB_model_t model = models[i % model_count];
+            unsigned cartridge = (i + i / model_count) % cartridge_count;
+            GB_gameboy_t *job = GB_pool_acquire_booted(pool, model, stub_boot_rom, sizeof(stub_boot_rom),
+                                                       roms[cartridge], 0x8000);
+            job->last_rtc_second = 0;
+            
+            GB_gameboy_t *reference = GB_init(GB_alloc(), model);
+            GB_apply_profile(reference, &profile);
+            GB_load_boot_rom_from_buffer(reference, stub_boot_rom, sizeof(stub_boot_rom));
+            GB_load_rom_from_buffer(reference, roms[cartridge], 0x8000);
+            while (!reference->boot_rom_finished) {
+                GB_run(reference);
+            }
+            reference->last_rtc_second = 0;
+            
+            /* The RTC doesn't advance for the skipped boot */
+            if (run_lockstep(reference, job, reference, frames, "Pooled job", true, "rtc", NULL) != frames) {
+                fprintf(stderr, "Pooled job on model $%03x with %s diverged from a fresh instance\n",
+                        model, cartridges[cartridge].name);
+                diverged++;
+            }
+            jobs++;
+            GB_free(reference);
+            GB_dealloc(reference);
+            GB_pool_release(pool, job);
+        }
+    }
+    fprintf(stderr, "Pooled jobs: %u of %u diverged from fresh instances\n", diverged, jobs);
+    
+    for (unsigned i = 0; i < cartridge_count; i++) {
+        free(roms[i]);
+    }
+}
+
+/* Times setting up short jobs on pooled instances, up to the point the boot ROM is done: booting them for real, resetting
+   them through the pool's boot cache, and acquiring them booted */
+static void run_pool_setup_test(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames)
+{
+    const unsigned jobs = 16;
+    double times[3];
+    unsigned hits = 0;
+    for (unsigned method = 0; method < 3; method++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (unsigned i = 0; i < jobs; i++) {
+            GB_gameboy_t *job;
+            if (method == 2) {
+                job = GB_pool_acquire_booted(pool, GB_get_model(gb), gb->boot_rom, sizeof(gb->boot_rom), gb->rom, gb->rom_size);
+            }
+            else {
+                job = acquire_reference(pool, gb, gb->rom, gb->rom_size);
+                if (method == 1) {
+                    hits += GB_pool_reset(pool, job);
+                }
+                else {
+                    for (unsigned cycles = 0; !job->boot_rom_finished && cycles < CPU_FREQUENCY * 2 * 60;) {
+                        cycles += GB_run(job);
+                    }
+                }
+            }
+            GB_pool_release(pool, job);
+        }
+        times[method] = seconds_since(&start) / jobs;
+    }
+    fprintf(stderr, "Pool job setup: %.3fms booting, %.3fms resetting through the boot cache (%u of %u jobs hit), %.3fms acquiring booted\n",
+            times[0] * 1000, times[1] * 1000, hits, jobs, times[2] * 1000);
+}
+
+#if !defined(_WIN32) && !defined(GB_DISABLE_DEBUGGER)
+/* Parses a symbol file like GB_debugger_load_symbol_file, but adds the symbols one by one */
+static void add_symbols_one_by_one(GB_gameboy_t *gb, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    char *line = NULL;
+    size_t size = 0;
+    while (getline(&line, &size, f) != -1) {
+        unsigned bank, address;
+        char symbol[strlen(line) + 1];
+        if (sscanf(line, "%x:%x %s", &bank, &address, symbol) == 3) {
+            GB_debugger_add_symbol(gb, bank, address, symbol);
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+/* Loads a generated file of 100,000 symbols spread over the given number of ROM banks, and times the load and looking
+   every symbol up by address and by name. The results are checked against parsing the file and adding the symbols one
+   by one, in file order. */
+static void benchmark_symbol_file(GB_pool_t *pool, unsigned banks)
+{
+    const unsigned count = 100000;
+    char path[] = "/tmp/sameboy_tester_symbols_XXXXXX";
+    int fd = mkstemp(path);
+    FILE *f = fd >= 0? fdopen(fd, "w") : NULL;
+    if (!f) {
+        fprintf(stderr, "Could not create a temporary symbol file\n");
+        if (fd >= 0) {
+            close(fd);
+            unlink(path);
+        }
+        return;
+    }
+    
+    /* With some local labels, and some addresses defined more than once */
+    struct {
+        uint16_t bank, addr;
+        char name[24];
+    } *symbols = malloc(count * sizeof(*symbols));
+    uint32_t seed = 0x5EED;
+    for (unsigned i = 0; i < count; i++) {
+        symbols[i].bank = next_random(&seed) % banks;
+        symbols[i].addr = (next_random(&seed) & 0x3FFF) | (symbols[i].bank? 0x4000 : 0);
+        if (i % 4 == 3) {
+            sprintf(symbols[i].name, "Function%u.loop", i - 1);
+        }
+        else {
+            sprintf(symbols[i].name, "Function%u", i);
+        }
+        fprintf(f, "%02x:%04x %s\n", symbols[i].bank, symbols[i].addr, symbols[i].name);
+    }
+    fclose(f);
+    
+    GB_gameboy_t *gb = GB_pool_acquire(pool, GB_MODEL_CGB_E);
+    GB_gameboy_t *reference = GB_pool_acquire(pool, GB_MODEL_CGB_E);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    GB_debugger_load_symbol_file(gb, path);
+    double load_time = seconds_since(&start);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    add_symbols_one_by_one(reference, path);
+    double reference_time = seconds_since(&start);
+    
+    unsigned found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned i = 0; i < count; i++) {
+        found += GB_debugger_describe_address(gb, symbols[i].addr, symbols[i].bank, true, false) != NULL;
+    }
+    double address_time = seconds_since(&start);
+    
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (unsigned i = 0; i < count; i++) {
+        found += GB_reversed_map_find_symbol(&gb->reversed_symbol_map, symbols[i].name) != NULL;
+    }
+    double name_time = seconds_since(&start);
+    
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < count; i++) {
+        const char *name = GB_debugger_describe_address(gb, symbols[i].addr, symbols[i].bank, true, false);
+        const char *reference_name = GB_debugger_describe_address(reference, symbols[i].addr, symbols[i].bank, true, false);
+        const GB_symbol_t *symbol = GB_reversed_map_find_symbol(&gb->reversed_symbol_map, symbols[i].name);
+        const GB_symbol_t *reference_symbol = GB_reversed_map_find_symbol(&reference->reversed_symbol_map, symbols[i].name);
+        if (!name || !reference_name || strcmp(name, reference_name) ||
+            !symbol || !reference_symbol || symbol->bank != reference_symbol->bank || symbol->addr != reference_symbol->addr) {
+            mismatches++;
+        }
+    }
+    
+    fprintf(stderr, "Symbols in %u bank%s: %u loaded in %.1f ms (%.1f ms adding them one by one), %.0f ns per address "
+            "lookup, %.0f ns per name lookup, %u of %u found\n",
+            banks, banks == 1? "" : "s", count, load_time * 1000, reference_time * 1000, address_time * 1e9 / count,
+            name_time * 1e9 / count, found, count * 2);
+    if (mismatches) {
+        fprintf(stderr, "Loaded symbols differ from symbols added one by one for %u of %u lookups\n", mismatches, count);
+    }
+    
+    GB_debugger_clear_symbols(gb);
+    GB_debugger_clear_symbols(reference);
+    GB_pool_release(pool, gb);
+    GB_pool_release(pool, reference);
+    free(symbols);
+    unlink(path);
+}
+
+/* Spread over many banks, each bank only has a few symbols. In a single bank, adding them one by one is quadratic. */
+static void run_symbols_benchmark(GB_pool_t *pool, unsigned frames)
+{
+    benchmark_symbol_file(pool, 64);
+    benchmark_symbol_file(pool, 1);
+}
+#endif
+
+#ifndef _WIN32
+static uint8_t *read_file(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = malloc(*size ?: 1);
+    if (fread(data, 1, *size, f) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+/* Compares a battery file against a save, ignoring the host time the RTC data ends with */
+static bool compare_battery_file(const char *path, const uint8_t *expected, size_t expected_size, bool has_rtc,
+                                 const char *when)
+{
+    size_t size;
+    uint8_t *data = read_file(path, &size);
+    bool same = data && size == expected_size &&
+                memcmp(data, expected, size - (has_rtc? sizeof(uint64_t) : 0)) == 0;
+    if (!same) {
+        fprintf(stderr, "Mapped battery save %s doesn't match the saved battery (%zu bytes, expected %zu)\n",
+                when, data? size : 0, expected_size);
+    }
+    free(data);
+    return same;
+}
+
+/* Maps a save of each cartridge in turn, runs it while the writer syncs every frame, and compares the file with
+   GB_save_battery's output: after explicitly unmapping, and after loading the next cartridge unmaps it. Starts from an
+   existing save with RTC data, and switches between RAM sizes so the file is shrunk and grown. */
+static void run_battery_map_test(GB_pool_t *pool, unsigned frames)
+{
+    static const struct {
+        uint8_t cartridge_type, ram_size;
+        bool has_rtc;
+    } cartridges[] = {
+        {0x10, 3, true}, // MBC3+TIMER+RAM+BATTERY, 32KiB
+        {0x1B, 2, false}, // MBC5+RAM+BATTERY, 8KiB
+        {0x10, 3, true},
+    };
+    const unsigned cartridge_count = sizeof(cartridges) / sizeof(cartridges[0]);
+    if (frames > 30) {
+        frames = 30;
+    }
+    
+    char path[] = "/tmp/sameboy_tester_battery_XXXXXX";
+    char expected_path[] = "/tmp/sameboy_tester_battery_XXXXXX";
+    int fd = mkstemp(path);
+    int expected_fd = mkstemp(expected_path);
+    if (fd < 0 || expected_fd < 0) {
+        fprintf(stderr, "Could not create temporary battery saves\n");
+        if (fd >= 0) {
+            close(fd);
+            unlink(path);
+        }
+        if (expected_fd >= 0) {
+            close(expected_fd);
+            unlink(expected_path);
+        }
+        return;
+    }
+    close(fd);
+    close(expected_fd);
+    
+    uint8_t *roms[cartridge_count];
+    for (unsigned i = 0; i < cartridge_count; i++) {
+        roms[i] = create_test_rom(cartridge_ram_workload, sizeof(cartridge_ram_workload),
+                                  cartridges[i].cartridge_type, cartridges[i].ram_size);
+    }
+    GB_pool_set_profile(pool, &(GB_profile_t){.rendering_disabled = true});
+    
+    /* A save left by a previous session */
+    GB_gameboy_t *gb = GB_pool_acquire_booted(pool, GB_MODEL_CGB_E, stub_boot_rom, sizeof(stub_boot_rom), roms[0], 0x8000);
+    for (unsigned i = 0; i < gb->mbc_ram_size; i++) {
+        gb->mbc_ram[i] = i * 7 + (i >> 8);
+    }
+    gb->rtc_real.hours = 5;
+    gb->rtc_real.days = 3;
+    GB_save_battery(gb, path);
+    uint8_t *existing = malloc(gb->mbc_ram_size);
+    memcpy(existing, gb->mbc_ram, gb->mbc_ram_size);
+    GB_pool_release(pool, gb);
+    
+    unsigned failures = 0;
+    gb = GB_pool_acquire_booted(pool, GB_MODEL_CGB_E, stub_boot_rom, sizeof(stub_boot_rom), roms[0], 0x8000);
+    for (unsigned i = 0; i < cartridge_count; i++) {
+        if (i) {
+            /* Loading the next cartridge unmaps the previous one's save */
+            size_t size = GB_save_battery_size(gb);
+            uint8_t *expected = malloc(size);
+            GB_save_battery_to_buffer(gb, expected, size);
+            GB_load_rom_from_buffer(gb, roms[i], 0x8000);
+            GB_reset(gb);
+            failures += !compare_battery_file(path, expected, size, cartridges[i - 1].has_rtc,
+                                              "after loading another cartridge");
+            free(expected);
+        }
+        
+        int error = GB_map_battery(gb, path);
+        if (error) {
+            fprintf(stderr, "Could not map a battery save: %s\n", strerror(error));
+            failures++;
+            break;
+        }
+        if (i == 0 && (memcmp(gb->mbc_ram, existing, gb->mbc_ram_size) ||
+                       gb->rtc_real.hours != 5 || gb->rtc_real.days != 3)) {
+            fprintf(stderr, "Mapping an existing battery save didn't load it\n");
+            failures++;
+        }
+        size_t size;
+        free(read_file(path, &size));
+        if (size != GB_save_battery_size(gb)) {
+            fprintf(stderr, "Mapped battery save is %zu bytes, expected %d\n", size, GB_save_battery_size(gb));
+            failures++;
+        }
+        
+        GB_set_battery_sync_interval(gb, 1);
+        for (unsigned frame = 0; frame < frames; frame++) {
+            for (unsigned cycles = 0; cycles < FRAME_CYCLES;) {
+                cycles += GB_run(gb);
+            }
+        }
+        if (GB_sync_battery(gb)) {
+            fprintf(stderr, "Syncing a mapped battery save failed\n");
+            failures++;
+        }
+        
+        /* The first cartridge is left mapped, for loading the next one to unmap */
+        if (i == 0) continue;
+        GB_unmap_battery(gb);
+        GB_save_battery(gb, expected_path);
+        size_t expected_size;
+        uint8_t *expected = read_file(expected_path, &expected_size);
+        failures += !compare_battery_file(path, expected, expected_size, cartridges[i].has_rtc, "after unmapping");
+        free(expected);
+    }
+    GB_pool_release(pool, gb);
+    
+    fprintf(stderr, "Mapped battery saves: %s, switching from 32KiB of RAM and an RTC to 8KiB of RAM and back\n",
+            failures? "failed" : "matched");
+    
+    free(existing);
+    for (unsigned i = 0; i < cartridge_count; i++) {
+        free(roms[i]);
+    }
+    unlink(path);
+    unlink(expected_path);
+}
+#endif
+
+/* 2KiB general purpose DMAs from WRAM and from ROM to VRAM in a loop, with the LCD off */
+static const uint8_t gdma_workload[] = {
+    0xAF,                   // XOR A
+    0xE0, GB_IO_LCDC,       // LDH [LCDC], A
+    /* Loop: */
+    0x3E, 0xC0,             // LD A, $C0
+    0xE0, GB_IO_HDMA1,      // LDH [HDMA1], A
+    0xAF,                   // XOR A
+    0xE0, GB_IO_HDMA2,      // LDH [HDMA2], A
+    0x3E, 0x80,             // LD A, $80
+    0xE0, GB_IO_HDMA3,      // LDH [HDMA3], A
+    0xAF,                   // XOR A
+    0xE0, GB_IO_HDMA4,      // LDH [HDMA4], A
+    0x3E, 0x7F,             // LD A, $7F
+    0xE0, GB_IO_HDMA5,      // LDH [HDMA5], A
+    0x3E, 0x40,             // LD A, $40
+    0xE0, GB_IO_HDMA1,      // LDH [HDMA1], A
+    0xAF,                   // XOR A
+    0xE0, GB_IO_HDMA2,      // LDH [HDMA2], A
+    0x3E, 0x88,             // LD A, $88
+    0xE0, GB_IO_HDMA3,      // LDH [HDMA3], A
+    0xAF,                   // XOR A
+    0xE0, GB_IO_HDMA4,      // LDH [HDMA4], A
+    0x3E, 0x7F,             // LD A, $7F
+    0xE0, GB_IO_HDMA5,      // LDH [HDMA5], A
+    0x18, -38,              // JR Loop
+};
+
+/* Runs general purpose DMAs with DMA block copies and without them, checking both stay in sync every frame */
+static void run_dma_benchmark(GB_pool_t *pool, unsigned frames)
+{
+    GB_pool_set_profile(pool, &(GB_profile_t){
+        .turbo = true,
+        .turbo_dont_skip = true,
+        .rendering_disabled = true,
+    });
+    uint8_t *rom = create_test_rom(gdma_workload, sizeof(gdma_workload), 0x00, 0); // ROM only
+    uint64_t *hashes = malloc(frames * sizeof(*hashes) * 2);
+    double times[2];
+    for (unsigned fast = 0; fast < 2; fast++) {
+        GB_gameboy_t *gb = GB_pool_acquire_booted(pool, GB_MODEL_CGB_E, stub_boot_rom, sizeof(stub_boot_rom),
+                                                  rom, 0x8000);
+        gb->debug_flags = fast? 0 : GB_DEBUG_NO_DMA_BLOCK_COPIES;
+        gb->last_rtc_second = 0;
+        times[fast] = run_frames(gb, frames, hashes + fast * frames);
+        GB_pool_release(pool, gb);
+    }
+    print_speedup("General purpose DMA with the LCD off", frames, times[1], times[0], "copying byte by byte");
+    unsigned diverged = first_difference(hashes + frames, hashes, frames);
+    if (diverged != frames) {
+        fprintf(stderr, "DMA block copies diverged from per-byte DMA in frame %u\n", diverged);
+    }
+    free(hashes);
+    free(rom);
+}
+
+check_t checks[] = {
+    {"--link", "Running linked pairs against interleaved ones", run_link_test, run_infrared_link_test},
+    {"--cheats", "Checking cheats against the cheat list", run_cheat_test},
+    {"--batch", "Measuring batched stepping", run_batch_test},
+    {"--mode3-batching", "Checking batched Mode 3 against unbatched Mode 3", run_batching_test},
+    {"--boot-cache", "Checking skipped boots against real ones", run_boot_cache_test},
+    {"--pool-setup", "Measuring pooled job setup", run_pool_setup_test},
+    {"--pool-jobs", "Checking pooled jobs across models and cartridge RAM sizes against fresh instances", NULL, run_pool_jobs_test},
+    {"--dma-benchmark", "Measuring DMA block copies against per-byte DMA", NULL, run_dma_benchmark},
+#if !defined(_WIN32) && !defined(GB_DISABLE_DEBUGGER)
+    {"--symbols", "Measuring loading and looking up 100,000 symbols", NULL, run_symbols_benchmark},
+#endif
+#ifndef _WIN32
+    {"--battery-map", "Checking mapped battery saves against saved ones", NULL, run_battery_map_test},
+#endif
+    {NULL}
+};
+
+check_t *find_check(const char *option)
+{
+    for (check_t *check = checks; check->option; check++) {
+        if (strcmp(check->option, option) == 0) return check;
+    }
+    return NULL;
+}
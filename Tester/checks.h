@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <Core/gb.h>
+
+/* Checks and benchmarks the tester can run. run replaces the usual run of each ROM, getting its freshly loaded instance,
+   and run_once runs after all ROMs are done; either may be NULL. Instances they need are taken from pool. */
+typedef struct {
+    const char *option;
+    const char *description;
+    void (*run)(GB_pool_t *pool, GB_gameboy_t *gb, unsigned frames);
+    void (*run_once)(GB_pool_t *pool, unsigned frames);
+    bool enabled;
+} check_t;
+
+/* Terminated by an entry with no option */
+extern check_t checks[];
+
+check_t *find_check(const char *option);
@@ -18,18 +18,25 @@
 #include <Core/gb.h>
 #include <Core/random.h>
 
+#include "checks.h"
+
 static bool running = false;
 static char *filename;
 static char *bmp_filename;
 static char *log_filename;
 static char *sav_filename;
+#ifdef GB_ENABLE_PERF_COUNTERS
+static char *profile_filename;
+#endif
+static char *hashes_filename;
 static FILE *log_file;
 static void replace_extension(const char *src, size_t length, char *dest, const char *ext);
 static bool push_start_a, start_is_not_first, a_is_bad, b_is_confirm, push_faster, push_slower,
             do_not_stop, push_a_twice, start_is_bad, allow_weird_sp_values, large_stack, push_right,
             semi_random, limit_start, pointer_control, unsafe_speed_switch;
 static unsigned int test_length = 60 * 40;
-GB_gameboy_t gb;
+static GB_gameboy_t *gb;
+static GB_pool_t *pool;
 
 static unsigned int frames = 0;
 static bool use_tga = false;
@@ -123,8 +130,571 @@ static void handle_buttons(GB_gameboy_t *gb)
 
 }
 
+#ifdef GB_ENABLE_PERF_COUNTERS
+static void dump_profile(GB_gameboy_t *gb)
+{
+    FILE *f = fopen(profile_filename, "w");
+    if (!f) {
+        perror("Failed to write profile");
+        return;
+    }
+    const GB_perf_counters_t *counters = GB_get_perf_counters(gb);
+    uint64_t frames = counters->frames ?: 1;
+    uint64_t lines = counters->mode3_batched + counters->mode3_unbatched;
+    
+    fprintf(f, "ROM: %s\n", filename);
+    fprintf(f, "Frames: %llu\n", (unsigned long long)counters->frames);
+    fprintf(f, "Mode 3 batched lines: %llu (%.1f%%)\n", (unsigned long long)counters->mode3_batched,
+            lines? counters->mode3_batched * 100.0 / lines : 0.0);
+    fprintf(f, "Mode 3 unbatched lines: %llu\n", (unsigned long long)counters->mode3_unbatched);
+    fprintf(f, "Mode 3 batched lines per frame: %.1f\n", (double)counters->mode3_batched / frames);
+    fprintf(f, "Display syncs per frame: %.1f\n", (double)counters->display_syncs / frames);
+    fprintf(f, "APU renders per frame: %.1f\n", (double)counters->apu_renders / frames);
+    fprintf(f, "DMA cycles per frame: %.1f\n", (double)counters->dma_cycles / frames);
+    fprintf(f, "HDMA cycles per frame: %.1f\n", (double)counters->hdma_cycles / frames);
+    fprintf(f, "Timing sleeps: %llu\n", (unsigned long long)counters->timing_sleeps);
+    fprintf(f, "Rewind pushes: %llu\n", (unsigned long long)counters->rewind_pushes);
+    fprintf(f, "Idle loop cycles per frame: %.1f\n", (double)counters->idle_loop_cycles / frames);
+    fprintf(f, "Translated block cycles per frame: %.1f\n", (double)counters->translated_cycles / frames);
+    
+    static const char *const names[] = {
+        [GB_PERF_TIMERS] = "Timers",
+        [GB_PERF_APU] = "APU",
+        [GB_PERF_DISPLAY] = "Display",
+        [GB_PERF_DMA] = "DMA",
+        [GB_PERF_MISC] = "Misc",
+    };
+    for (unsigned i = 0; i < GB_PERF_SUBSYSTEM_COUNT; i++) {
+        fprintf(f, "%s ticks per frame: %.0f\n", names[i], (double)counters->subsystem_ticks[i] / frames);
+    }
+    fclose(f);
+}
+#endif
+
+/* State hash logs record the state hashes at the end of every frame of a reference run, and optionally after every
+   scanline and instruction of a single frame. A later run can then be bisected against them to find the first
+   instruction whose effect differs, and which parts of the state it affected. Hashes are of the state's raw bytes, so
+   the header records the state layout, and a log is only accepted by builds with the same one. */
+#define HASH_LOG_MAGIC 'SBHL'
+#define HASH_LOG_HEADER_SIZE (sizeof(uint32_t) * 3)
+
+typedef enum {
+    HASH_FRAME,
+    HASH_LINE,
+    HASH_INSTRUCTION,
+} hash_level_t;
+
+typedef struct {
+    uint32_t level;
+    uint32_t frame;
+    uint32_t instruction; // Instructions run since the frame began
+    uint32_t line;
+    uint32_t hashes[];
+} hash_record_t;
+
+static bool record_hashes, bisect_hashes, bisecting;
+static unsigned hash_detail_frame = -1;
+static FILE *hashes_file;
+static unsigned hash_count;
+static size_t hash_record_size;
+static uint8_t *reference_hashes;
+static size_t reference_hashes_size;
+static size_t reference_frame_offset;
+static hash_record_t *current_hashes;
+static uint8_t *frame_snapshot;
+
+static hash_record_t *reference_record(size_t index)
+{
+    return (hash_record_t *)(reference_hashes + HASH_LOG_HEADER_SIZE + index * hash_record_size);
+}
+
+static size_t reference_record_count(void)
+{
+    return (reference_hashes_size - HASH_LOG_HEADER_SIZE) / hash_record_size;
+}
+
+static bool open_hashes(GB_gameboy_t *gb)
+{
+    hash_count = GB_get_state_hash_count(gb);
+    hash_record_size = sizeof(hash_record_t) + hash_count * sizeof(uint32_t);
+    current_hashes = malloc(hash_record_size);
+    frame_snapshot = malloc(GB_get_snapshot_size(gb));
+    GB_take_snapshot(gb, frame_snapshot);
+    reference_frame_offset = 0;
+    
+    if (record_hashes) {
+        hashes_file = fopen(hashes_filename, "wb");
+        if (!hashes_file) {
+            perror("Failed to create state hash log");
+            return false;
+        }
+        uint32_t header[] = {HASH_LOG_MAGIC, GB_state_magic(), hash_count};
+        fwrite(header, sizeof(header), 1, hashes_file);
+        return true;
+    }
+    
+    FILE *f = fopen(hashes_filename, "rb");
+    if (!f) {
+        perror("Failed to open reference state hash log");
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    reference_hashes_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    reference_hashes = malloc(reference_hashes_size);
+    if (fread(reference_hashes, 1, reference_hashes_size, f) != reference_hashes_size ||
+        reference_hashes_size < HASH_LOG_HEADER_SIZE ||
+        (((uint32_t *)reference_hashes)[0] != HASH_LOG_MAGIC &&
+         ((uint32_t *)reference_hashes)[0] != __builtin_bswap32(HASH_LOG_MAGIC))) {
+        fclose(f);
+        fprintf(stderr, "Invalid reference state hash log %s\n", hashes_filename);
+        return false;
+    }
+    fclose(f);
+    if (((uint32_t *)reference_hashes)[0] != HASH_LOG_MAGIC || ((uint32_t *)reference_hashes)[1] != GB_state_magic()) {
+        fprintf(stderr, "Reference state hash log %s was recorded by a build with a different byte order or bool size\n",
+                hashes_filename);
+        return false;
+    }
+    if (((uint32_t *)reference_hashes)[2] != hash_count) {
+        fprintf(stderr, "Reference state hash log %s is for a different model or cartridge\n", hashes_filename);
+        return false;
+    }
+    return true;
+}
+
+static void close_hashes(void)
+{
+    if (hashes_file) {
+        fclose(hashes_file);
+        hashes_file = NULL;
+    }
+    free(reference_hashes);
+    reference_hashes = NULL;
+    reference_hashes_size = 0;
+    free(current_hashes);
+    current_hashes = NULL;
+    free(frame_snapshot);
+    frame_snapshot = NULL;
+}
+
+static void write_hashes(GB_gameboy_t *gb, hash_level_t level, unsigned instruction)
+{
+    current_hashes->level = level;
+    current_hashes->frame = frames;
+    current_hashes->instruction = instruction;
+    current_hashes->line = gb->current_line;
+    GB_get_state_hashes(gb, current_hashes->hashes);
+    fwrite(current_hashes, hash_record_size, 1, hashes_file);
+}
+
+static bool hashes_match(GB_gameboy_t *gb, const hash_record_t *reference)
+{
+    GB_get_state_hashes(gb, current_hashes->hashes);
+    return memcmp(current_hashes->hashes, reference->hashes, hash_count * sizeof(uint32_t)) == 0;
+}
+
+static void log_differing_regions(GB_gameboy_t *gb, const hash_record_t *reference)
+{
+    GB_get_state_hashes(gb, current_hashes->hashes);
+    for (unsigned i = 0; i < hash_count; i++) {
+        if (current_hashes->hashes[i] != reference->hashes[i]) {
+            char name[32];
+            GB_get_state_hash_name(gb, i, name, sizeof(name));
+            GB_log(gb, "    %s\n", name);
+        }
+    }
+}
+
+/* Idle loops and translated blocks run many instructions in a single GB_run, so with them a frame would end after a
+   later instruction than without them, and instruction numbers would count something else. Runs that are compared
+   hold them off close to the end of every frame, and for whole frames whose instructions are numbered. Neither runs
+   for more than FAST_PATH_MAX_CYCLES in one go. */
+#define FAST_PATH_MAX_CYCLES 0x1000
+static bool idle_loops_requested, block_translation_requested;
+
+static void hold_fast_paths(GB_gameboy_t *gb, bool hold)
+{
+    GB_set_idle_loop_detection(gb, idle_loops_requested && !hold);
+    GB_set_block_translation(gb, block_translation_requested && !hold);
+}
+
+/* Reruns the current frame from its start, up to a given number of instructions */
+static void rerun_frame(GB_gameboy_t *gb, unsigned instructions)
+{
+    GB_restore_snapshot(gb, frame_snapshot);
+    GB_take_snapshot(gb, frame_snapshot);
+    for (unsigned i = 0; i < instructions; i++) {
+        GB_run(gb);
+    }
+}
+
+/* Returns the first of count consecutive detail records the current run doesn't match, or count if it matches them
+   all. Once diverged, runs are assumed to stay diverged. */
+static size_t bisect_records(GB_gameboy_t *gb, hash_record_t *const *records, size_t count)
+{
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        rerun_frame(gb, records[middle]->instruction);
+        if (hashes_match(gb, records[middle])) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static void bisect_frame(GB_gameboy_t *gb, const hash_record_t *reference_frame)
+{
+    GB_log(gb, "State diverged from the reference in frame %u, in:\n", frames);
+    log_differing_regions(gb, reference_frame);
+    
+    size_t line_count = 0, instruction_count = 0;
+    hash_record_t **lines = malloc(reference_record_count() * sizeof(*lines));
+    hash_record_t **instructions = malloc(reference_record_count() * sizeof(*instructions));
+    for (size_t i = 0; i < reference_record_count(); i++) {
+        hash_record_t *record = reference_record(i);
+        if (record->frame != frames) continue;
+        if (record->level == HASH_LINE) {
+            lines[line_count++] = record;
+        }
+        else if (record->level == HASH_INSTRUCTION) {
+            instructions[instruction_count++] = record;
+        }
+    }
+    
+    if (!instruction_count) {
+        GB_log(gb, "Record the reference with --hash-detail %u to bisect this frame\n", frames);
+        goto exit;
+    }
+    
+    /* Narrow the divergence to a scanline first, then to an instruction within it */
+    bisecting = true;
+    hold_fast_paths(gb, true);
+    size_t line = bisect_records(gb, lines, line_count);
+    unsigned first = line? lines[line - 1]->instruction : 0;
+    unsigned last = line < line_count? lines[line]->instruction : instructions[instruction_count - 1]->instruction;
+    size_t first_index = 0;
+    while (first_index < instruction_count && instructions[first_index]->instruction <= first) {
+        first_index++;
+    }
+    size_t last_index = first_index;
+    while (last_index < instruction_count && instructions[last_index]->instruction <= last) {
+        last_index++;
+    }
+    size_t instruction = first_index + bisect_records(gb, instructions + first_index, last_index - first_index);
+    
+    if (instruction == instruction_count) {
+        GB_log(gb, "Every instruction of the frame matches the reference, so the divergence is in its joypad input\n");
+    }
+    else {
+        const hash_record_t *reference = instructions[instruction];
+        rerun_frame(gb, reference->instruction - 1);
+        GB_log(gb, "First diverging instruction is #%u of the frame, on line %u:\n",
+               reference->instruction, gb->current_line);
+        GB_cpu_disassemble(gb, gb->pc, 1);
+        GB_run(gb);
+        GB_log(gb, "It changed the state differently in:\n");
+        log_differing_regions(gb, reference);
+    }
+    bisecting = false;
+    
+exit:
+    free(lines);
+    free(instructions);
+}
+
+/* Called after every instruction, and again at the end of every frame once its buttons are handled */
+static void handle_hashes(GB_gameboy_t *gb, unsigned instruction, bool frame_ended)
+{
+    static unsigned last_line;
+    if (!frame_ended) {
+        if (record_hashes && frames == hash_detail_frame) {
+            write_hashes(gb, HASH_INSTRUCTION, instruction);
+            if (gb->current_line != last_line) {
+                write_hashes(gb, HASH_LINE, instruction);
+            }
+        }
+        last_line = gb->current_line;
+        return;
+    }
+    
+    if (record_hashes) {
+        write_hashes(gb, HASH_FRAME, instruction);
+    }
+    else {
+        while (reference_frame_offset < reference_record_count() &&
+               reference_record(reference_frame_offset)->level != HASH_FRAME) {
+            reference_frame_offset++;
+        }
+        if (reference_frame_offset < reference_record_count()) {
+            const hash_record_t *reference = reference_record(reference_frame_offset++);
+            if (reference->frame == frames && !hashes_match(gb, reference)) {
+                bisect_frame(gb, reference);
+                /* Everything past this point diverges as well */
+                running = false;
+                return;
+            }
+        }
+    }
+    
+    GB_take_snapshot(gb, frame_snapshot);
+}
+
+/* Lockstep auditing runs a second instance beside the tested one with the same inputs, and stops at the first point
+   their states differ. With --audit, the second instance is in this process and steps instruction by instruction with
+   the first one. With --audit-with, it runs in another build of the tester over a pair of pipes, and the two compare
+   state hashes every --audit-interval frames. These hash the state's raw bytes, so both builds must have the same state
+   layout, which they check before each test. */
+typedef enum {
+    AUDIT_NONE,
+    AUDIT_IN_PROCESS,
+    AUDIT_WITH_PEER,
+    AUDIT_AS_PEER,
+} audit_mode_t;
+
+typedef struct {
+    uint32_t frame;
+    uint32_t ended;
+    uint64_t hash;
+} audit_message_t;
+
+static audit_mode_t audit_mode = AUDIT_NONE;
+static bool auditing;
+static unsigned audit_interval = 1;
+static GB_gameboy_t audit_gb;
+static uint32_t audit_bitmap[256*224];
+static char *audit_state_filename;
+static char *audit_peer_state_filename;
+#ifndef _WIN32
+static const char *audit_peer_path;
+static int audit_read_fd = -1, audit_write_fd = -1;
+
+static bool audit_read(void *data, size_t size)
+{
+    while (size) {
+        ssize_t ret = read(audit_read_fd, data, size);
+        if (ret <= 0) return false;
+        data = (uint8_t *)data + ret;
+        size -= ret;
+    }
+    return true;
+}
+
+static bool audit_write(const void *data, size_t size)
+{
+    while (size) {
+        ssize_t ret = write(audit_write_fd, data, size);
+        if (ret <= 0) return false;
+        data = (const uint8_t *)data + ret;
+        size -= ret;
+    }
+    return true;
+}
+
+/* The peer gets the same arguments, except for running it and forking */
+static bool spawn_audit_peer(int argc, char **argv)
+{
+    int to_peer[2], from_peer[2];
+    if (pipe(to_peer) || pipe(from_peer)) {
+        perror("Failed to create audit pipes");
+        return false;
+    }
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("Failed to start audit peer");
+        return false;
+    }
+    
+    if (pid == 0) {
+        close(to_peer[1]);
+        close(from_peer[0]);
+        char read_fd[16], write_fd[16];
+        snprintf(read_fd, sizeof(read_fd), "%d", to_peer[0]);
+        snprintf(write_fd, sizeof(write_fd), "%d", from_peer[1]);
+        char **peer_argv = malloc((argc + 4) * sizeof(*peer_argv));
+        unsigned peer_argc = 0;
+        peer_argv[peer_argc++] = (char *)audit_peer_path;
+        peer_argv[peer_argc++] = "--audit-peer";
+        peer_argv[peer_argc++] = read_fd;
+        peer_argv[peer_argc++] = write_fd;
+        for (unsigned i = 1; i < argc; i++) {
+            if ((strcmp(argv[i], "--audit-with") == 0 || strcmp(argv[i], "--jobs") == 0) && i != argc - 1) {
+                i++;
+                continue;
+            }
+            peer_argv[peer_argc++] = argv[i];
+        }
+        peer_argv[peer_argc] = NULL;
+        execv(audit_peer_path, peer_argv);
+        perror("Failed to start audit peer");
+        exit(1);
+    }
+    
+    close(to_peer[0]);
+    close(from_peer[1]);
+    audit_read_fd = from_peer[0];
+    audit_write_fd = to_peer[1];
+    return true;
+}
+#endif
+
+static void start_audit(GB_gameboy_t *gb)
+{
+    auditing = audit_mode != AUDIT_NONE;
+#ifndef _WIN32
+    if (audit_mode == AUDIT_WITH_PEER || audit_mode == AUDIT_AS_PEER) {
+        /* Written in native order, so a peer with the other byte order reads back something else too */
+        uint32_t layout[] = {HASH_LOG_MAGIC, GB_state_magic()}, peer_layout[2];
+        if (!audit_write(layout, sizeof(layout)) || !audit_read(peer_layout, sizeof(peer_layout))) {
+            GB_log(gb, "Lost connection to the audit peer\n");
+            audit_mode = AUDIT_NONE;
+            auditing = false;
+        }
+        else if (memcmp(layout, peer_layout, sizeof(layout)) != 0) {
+            fprintf(stderr, "The audit peer was built with a different byte order or bool size, so its state hashes "
+                            "can't be compared\n");
+            exit(1);
+        }
+    }
+#endif
+    if (audit_mode != AUDIT_IN_PROCESS) return;
+    
+    /* Set up exactly like the tested instance, except for its output */
+    GB_init(&audit_gb, GB_get_model(gb));
+    GB_load_boot_rom_from_buffer(&audit_gb, gb->boot_rom, sizeof(gb->boot_rom));
+    GB_set_pixels_output(&audit_gb, &audit_bitmap[0]);
+    GB_set_rgb_encode_callback(&audit_gb, gb->rgb_encode_callback);
+    GB_set_async_input_callback(&audit_gb, async_input_callback);
+    GB_set_color_correction_mode(&audit_gb, GB_COLOR_CORRECTION_EMULATE_HARDWARE);
+    GB_set_rtc_mode(&audit_gb, GB_RTC_MODE_ACCURATE);
+    GB_set_emulate_joypad_bouncing(&audit_gb, false);
+    GB_set_idle_loop_detection(&audit_gb, gb->idle_loop_detection);
+    GB_set_block_translation(&audit_gb, gb->block_translation);
+    GB_load_rom_from_buffer(&audit_gb, gb->rom, gb->rom_size);
+    audit_gb.turbo = audit_gb.turbo_dont_skip = audit_gb.disable_rendering = true;
+    audit_gb.last_rtc_second = gb->last_rtc_second;
+}
+
+static void audit_diverged(GB_gameboy_t *gb, const uint32_t *peer_hashes)
+{
+    GB_log(gb, "State diverged from the audit peer in frame %u", frames);
+    if (peer_hashes) {
+        GB_log(gb, ", in:\n");
+        unsigned count = GB_get_state_hash_count(gb);
+        uint32_t *hashes = malloc(count * sizeof(*hashes));
+        GB_get_state_hashes(gb, hashes);
+        for (unsigned i = 0; i < count; i++) {
+            if (hashes[i] != peer_hashes[i]) {
+                char name[32];
+                GB_get_state_hash_name(gb, i, name, sizeof(name));
+                GB_log(gb, "    %s\n", name);
+            }
+        }
+        free(hashes);
+    }
+    else {
+        GB_log(gb, "\n");
+    }
+    GB_save_state(gb, audit_state_filename);
+    if (audit_mode == AUDIT_IN_PROCESS) {
+        GB_save_state(&audit_gb, audit_peer_state_filename);
+    }
+    GB_log(gb, "Saved both states for inspection\n");
+    auditing = false;
+    running = false;
+}
+
+static void audit_in_process_diverged(GB_gameboy_t *gb)
+{
+    unsigned count = GB_get_state_hash_count(&audit_gb);
+    uint32_t *peer_hashes = malloc(count * sizeof(*peer_hashes));
+    GB_get_state_hashes(&audit_gb, peer_hashes);
+    audit_diverged(gb, peer_hashes);
+    free(peer_hashes);
+}
+
+/* Steps the in-process instance along with the tested one, checking their timing and PC after every instruction */
+static void audit_step(GB_gameboy_t *gb, unsigned cycles)
+{
+    audit_gb.disable_rendering = gb->disable_rendering;
+    unsigned peer_cycles = GB_run(&audit_gb);
+    if (peer_cycles != cycles || gb->pc != audit_gb.pc) {
+        GB_log(gb, "Execution diverged from the audit peer: PC $%04x after %u cycles, vs. PC $%04x after %u cycles\n",
+               gb->pc, cycles, audit_gb.pc, peer_cycles);
+        audit_in_process_diverged(gb);
+    }
+}
+
+/* Called every --audit-interval frames once its buttons are handled, and when the test ends */
+static void audit_check(GB_gameboy_t *gb, bool ended)
+{
+    if (audit_mode == AUDIT_IN_PROCESS) {
+        if (GB_get_state_hash(gb) != GB_get_state_hash(&audit_gb)) {
+            audit_in_process_diverged(gb);
+        }
+        return;
+    }
+    
+#ifndef _WIN32
+    audit_message_t message = {frames, ended, GB_get_state_hash(gb)};
+    unsigned count = GB_get_state_hash_count(gb);
+    uint32_t *hashes = malloc(count * sizeof(*hashes));
+    audit_message_t peer_message;
+    uint8_t reply;
+    
+    if (audit_mode == AUDIT_AS_PEER) {
+        if (!audit_write(&message, sizeof(message)) || !audit_read(&reply, sizeof(reply))) goto broken;
+        if (reply == 'd') {
+            GB_get_state_hashes(gb, hashes);
+            if (!audit_write(hashes, count * sizeof(*hashes))) goto broken;
+            GB_save_state(gb, audit_peer_state_filename);
+            auditing = false;
+            running = false;
+        }
+        goto exit;
+    }
+    
+    if (!audit_read(&peer_message, sizeof(peer_message))) goto broken;
+    reply = memcmp(&message, &peer_message, sizeof(message))? 'd' : 'c';
+    if (!audit_write(&reply, sizeof(reply))) goto broken;
+    if (reply == 'd') {
+        if (!audit_read(hashes, count * sizeof(*hashes))) goto broken;
+        if (peer_message.frame != frames || peer_message.ended != ended) {
+            GB_log(gb, "The audit peer %s in frame %u\n", peer_message.ended? "ended" : "is", peer_message.frame);
+        }
+        audit_diverged(gb, hashes);
+    }
+    goto exit;
+    
+broken:
+    GB_log(gb, "Lost connection to the audit peer\n");
+    audit_mode = AUDIT_NONE;
+    auditing = false;
+exit:
+    free(hashes);
+#endif
+}
+
+static void end_audit(GB_gameboy_t *gb)
+{
+    if (auditing) {
+        audit_check(gb, true);
+    }
+    if (audit_mode == AUDIT_IN_PROCESS) {
+        GB_free(&audit_gb);
+    }
+    auditing = false;
+}
+
 static void vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
 {
+    if (bisecting) return;
+    
     /* Detect common crashes and stop the test early */
     if (frames < test_length - 1) {
         if (gb->backtrace_size >= 0x200 + (large_stack? 0x80: 0) || (!allow_weird_sp_values && (gb->registers[GB_REGISTER_SP] >= 0xfe00 && gb->registers[GB_REGISTER_SP] < 0xff80))) {
@@ -187,6 +757,11 @@ static void vblank(GB_gameboy_t *gb, GB_vblank_type_t type)
             if (sav_filename) {
                 GB_save_battery(gb, sav_filename);
             }
+#ifdef GB_ENABLE_PERF_COUNTERS
+            if (profile_filename) {
+                dump_profile(gb);
+            }
+#endif
             running = false;
         }
     }
@@ -291,11 +866,20 @@ int main(int argc, char **argv)
     fprintf(stderr, "SameBoy Tester v" GB_VERSION "\n");
 
     if (argc == 1) {
-        fprintf(stderr, "Usage: %s [--dmg] [--sgb] [--cgb] [--start] [--length seconds] [--sav] [--boot path to boot ROM]"
+        fprintf(stderr, "Usage: %s [--dmg] [--sgb] [--cgb] [--start] [--length seconds] [--sav] [--idle-loops] [--translate-blocks] [--boot path to boot ROM]"
+                        " [--record-hashes [--hash-detail frame]] [--bisect] [--audit] [--audit-interval frames]"
+#ifdef GB_ENABLE_PERF_COUNTERS
+                        " [--profile]"
+#endif
 #ifndef _WIN32
+                        " [--audit-with path to another tester build]"
                         " [--jobs number of tests to run simultaneously]"
 #endif
-                        " rom ...\n", argv[0]);
+                        , argv[0]);
+        for (check_t *check = checks; check->option; check++) {
+            fprintf(stderr, " [%s]", check->option);
+        }
+        fprintf(stderr, " rom ...\n");
         exit(1);
     }
 
@@ -307,9 +891,16 @@ int main(int argc, char **argv)
     bool dmg = false;
     bool sgb = false;
     bool sav = false;
+    bool idle_loops = false;
+    bool translate_blocks = false;
+#ifdef GB_ENABLE_PERF_COUNTERS
+    bool profile = false;
+#endif
     const char *boot_rom_path = NULL;
     
     GB_random_set_enabled(false);
+    /* Instances are reused between ROMs, so running many short tests doesn't churn allocations */
+    pool = GB_pool_create(NULL);
 
     for (unsigned i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--dmg") == 0) {
@@ -363,6 +954,82 @@ int main(int argc, char **argv)
             continue;
         }
         
+        if (strcmp(argv[i], "--idle-loops") == 0) {
+            fprintf(stderr, "Fast-forwarding idle loops\n");
+            idle_loops = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "--translate-blocks") == 0) {
+            fprintf(stderr, "Translating ROM blocks\n");
+            translate_blocks = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "--record-hashes") == 0) {
+            fprintf(stderr, "Recording state hashes\n");
+            record_hashes = true;
+            bisect_hashes = false;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "--hash-detail") == 0 && i != argc - 1) {
+            hash_detail_frame = atoi(argv[++i]);
+            fprintf(stderr, "Recording state hashes of every instruction in frame %u\n", hash_detail_frame);
+            continue;
+        }
+        
+        if (strcmp(argv[i], "--audit") == 0) {
+            fprintf(stderr, "Auditing determinism against a second instance\n");
+            audit_mode = AUDIT_IN_PROCESS;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "--audit-interval") == 0 && i != argc - 1) {
+            audit_interval = atoi(argv[++i]);
+            if (audit_interval < 1) audit_interval = 1;
+            fprintf(stderr, "Comparing audited states every %u frames\n", audit_interval);
+            continue;
+        }
+        
+#ifndef _WIN32
+        if (strcmp(argv[i], "--audit-with") == 0 && i != argc - 1) {
+            audit_peer_path = argv[++i];
+            fprintf(stderr, "Auditing determinism against %s\n", audit_peer_path);
+            audit_mode = AUDIT_WITH_PEER;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "--audit-peer") == 0 && i < argc - 2) {
+            audit_read_fd = atoi(argv[++i]);
+            audit_write_fd = atoi(argv[++i]);
+            audit_mode = AUDIT_AS_PEER;
+            continue;
+        }
+#endif
+        
+        check_t *check = find_check(argv[i]);
+        if (check) {
+            fprintf(stderr, "%s\n", check->description);
+            check->enabled = true;
+            continue;
+        }
+        
+        if (strcmp(argv[i], "--bisect") == 0) {
+            fprintf(stderr, "Bisecting divergences from recorded state hashes\n");
+            bisect_hashes = true;
+            record_hashes = false;
+            continue;
+        }
+        
+#ifdef GB_ENABLE_PERF_COUNTERS
+        if (strcmp(argv[i], "--profile") == 0) {
+            fprintf(stderr, "Saving performance profiles\n");
+            profile = true;
+            continue;
+        }
+#endif
+        
 #ifndef _WIN32
         if (strcmp(argv[i], "--jobs") == 0 && i != argc - 1) {
             max_forks = atoi(argv[++i]);
@@ -373,7 +1040,8 @@ int main(int argc, char **argv)
             continue;
         }
 
-        if (max_forks > 1) {
+        /* Audit peers process the ROMs in the same order */
+        if (max_forks > 1 && audit_mode != AUDIT_WITH_PEER && audit_mode != AUDIT_AS_PEER) {
             while (current_forks >= max_forks) {
                 int wait_out;
                 while (wait(&wait_out) == -1);
@@ -386,13 +1054,15 @@ int main(int argc, char **argv)
 #endif
         filename = argv[i];
         size_t path_length = strlen(filename);
+        /* Audit peers write their outputs beside the audited tester's */
+        bool peer = audit_mode == AUDIT_AS_PEER;
 
-        char bitmap_path[path_length + 5]; /* At the worst case, size is strlen(path) + 4 bytes for .bmp + NULL */
-        replace_extension(filename, path_length, bitmap_path, use_tga? ".tga" : ".bmp");
+        char bitmap_path[path_length + 10]; /* At the worst case, size is strlen(path) + 9 bytes for .peer.bmp + NULL */
+        replace_extension(filename, path_length, bitmap_path, use_tga? (peer? ".peer.tga" : ".tga") : (peer? ".peer.bmp" : ".bmp"));
         bmp_filename = &bitmap_path[0];
         
-        char log_path[path_length + 5];
-        replace_extension(filename, path_length, log_path, ".log");
+        char log_path[path_length + 10];
+        replace_extension(filename, path_length, log_path, peer? ".peer.log" : ".log");
         log_filename = &log_path[0];
         
         char sav_path[path_length + 5];
@@ -401,127 +1071,208 @@ int main(int argc, char **argv)
             sav_filename = &sav_path[0];
         }
         
+#ifdef GB_ENABLE_PERF_COUNTERS
+        char profile_path[path_length + 6];
+        if (profile) {
+            replace_extension(filename, path_length, profile_path, ".prof");
+            profile_filename = &profile_path[0];
+        }
+#endif
+        
+        char hashes_path[path_length + 8];
+        replace_extension(filename, path_length, hashes_path, ".hashes");
+        hashes_filename = &hashes_path[0];
+        
+        char audit_state_path[path_length + 13];
+        replace_extension(filename, path_length, audit_state_path, ".audit.state");
+        audit_state_filename = &audit_state_path[0];
+        
+        char audit_peer_state_path[path_length + 18];
+        replace_extension(filename, path_length, audit_peer_state_path, ".audit-peer.state");
+        audit_peer_state_filename = &audit_peer_state_path[0];
+        
         fprintf(stderr, "Testing ROM %s\n", filename);
         
+        GB_pool_set_profile(pool, &(GB_profile_t){
+            .pixels = &bitmap[0],
+            .vblank_callback = (GB_vblank_callback_t) vblank,
+            .log_callback = log_callback,
+            .async_input_callback = async_input_callback,
+            .rgb_encode_callback = rgb_encode,
+            .color_correction_mode = GB_COLOR_CORRECTION_EMULATE_HARDWARE,
+            .rtc_mode = GB_RTC_MODE_ACCURATE,
+            .turbo = true,
+            .turbo_dont_skip = true,
+            .rendering_disabled = true,
+            .joypad_bouncing_disabled = true, // Adds too much noise
+            .idle_loop_detection = idle_loops,
+            .block_translation = translate_blocks,
+        });
+        
         if (dmg) {
-            GB_init(&gb, GB_MODEL_DMG_B);
-            if (GB_load_boot_rom(&gb, boot_rom_path ?: executable_relative_path("dmg_boot.bin"))) {
+            gb = GB_pool_acquire(pool, GB_MODEL_DMG_B);
+            if (GB_load_boot_rom(gb, boot_rom_path ?: executable_relative_path("dmg_boot.bin"))) {
                 fprintf(stderr, "Failed to load boot ROM from '%s'\n", boot_rom_path ?: executable_relative_path("dmg_boot.bin"));
                 exit(1);
             }
         }
         else if (sgb) {
-            GB_init(&gb, GB_MODEL_SGB2);
-            if (GB_load_boot_rom(&gb, boot_rom_path ?: executable_relative_path("sgb2_boot.bin"))) {
+            gb = GB_pool_acquire(pool, GB_MODEL_SGB2);
+            if (GB_load_boot_rom(gb, boot_rom_path ?: executable_relative_path("sgb2_boot.bin"))) {
                 fprintf(stderr, "Failed to load boot ROM from '%s'\n", boot_rom_path ?: executable_relative_path("sgb2_boot.bin"));
                 exit(1);
             }
         }
         else {
-            GB_init(&gb, GB_MODEL_CGB_E);
-            if (GB_load_boot_rom(&gb, boot_rom_path ?: executable_relative_path("cgb_boot.bin"))) {
+            gb = GB_pool_acquire(pool, GB_MODEL_CGB_E);
+            if (GB_load_boot_rom(gb, boot_rom_path ?: executable_relative_path("cgb_boot.bin"))) {
                 fprintf(stderr, "Failed to load boot ROM from '%s'\n", boot_rom_path ?: executable_relative_path("cgb_boot.bin"));
                 exit(1);
             }
         }
         
-        GB_set_vblank_callback(&gb, (GB_vblank_callback_t) vblank);
-        GB_set_pixels_output(&gb, &bitmap[0]);
-        GB_set_rgb_encode_callback(&gb, rgb_encode);
-        GB_set_log_callback(&gb, log_callback);
-        GB_set_async_input_callback(&gb, async_input_callback);
-        GB_set_color_correction_mode(&gb, GB_COLOR_CORRECTION_EMULATE_HARDWARE);
-        GB_set_rtc_mode(&gb, GB_RTC_MODE_ACCURATE);
-        GB_set_emulate_joypad_bouncing(&gb, false); // Adds too much noise
-        
-        if (GB_load_rom(&gb, filename)) {
+        if (GB_load_rom(gb, filename)) {
             perror("Failed to load ROM");
             exit(1);
         }
         
         /* Game specific hacks for start attempt automations */
         /* It's OK. No overflow is possible here. */
-        start_is_not_first = strcmp((const char *)(gb.rom + 0x134), "NEKOJARA") == 0 ||
-                             strcmp((const char *)(gb.rom + 0x134), "GINGA") == 0;
-        a_is_bad = strcmp((const char *)(gb.rom + 0x134), "DESERT STRIKE") == 0 ||
+        start_is_not_first = strcmp((const char *)(gb->rom + 0x134), "NEKOJARA") == 0 ||
+                             strcmp((const char *)(gb->rom + 0x134), "GINGA") == 0;
+        a_is_bad = strcmp((const char *)(gb->rom + 0x134), "DESERT STRIKE") == 0 ||
                     /* Restarting in Puzzle Boy/Kwirk (Start followed by A) leaks stack. */
-                   strcmp((const char *)(gb.rom + 0x134), "KWIRK") == 0 ||
-                   strcmp((const char *)(gb.rom + 0x134), "PUZZLE BOY") == 0;
-        start_is_bad = strcmp((const char *)(gb.rom + 0x134), "BLUESALPHA") == 0 ||
-                       strcmp((const char *)(gb.rom + 0x134), "ONI 5") == 0;
-        b_is_confirm = strcmp((const char *)(gb.rom + 0x134), "ELITE SOCCER") == 0 ||
-                       strcmp((const char *)(gb.rom + 0x134), "SOCCER") == 0 ||
-                       strcmp((const char *)(gb.rom + 0x134), "GEX GECKO") == 0 ||
-                       strcmp((const char *)(gb.rom + 0x134), "BABE") == 0;
-        push_faster = strcmp((const char *)(gb.rom + 0x134), "MOGURA DE PON!") == 0 ||
-                      strcmp((const char *)(gb.rom + 0x134), "HUGO2 1/2") == 0 ||
-                      strcmp((const char *)(gb.rom + 0x134), "HUGO") == 0;
-        push_slower = strcmp((const char *)(gb.rom + 0x134), "BAKENOU") == 0;
-        do_not_stop = strcmp((const char *)(gb.rom + 0x134), "SPACE INVADERS") == 0;
-        push_right = memcmp((const char *)(gb.rom + 0x134), "BOB ET BOB", strlen("BOB ET BOB")) == 0 ||
-                     strcmp((const char *)(gb.rom + 0x134), "LITTLE MASTER") == 0 ||
+                   strcmp((const char *)(gb->rom + 0x134), "KWIRK") == 0 ||
+                   strcmp((const char *)(gb->rom + 0x134), "PUZZLE BOY") == 0;
+        start_is_bad = strcmp((const char *)(gb->rom + 0x134), "BLUESALPHA") == 0 ||
+                       strcmp((const char *)(gb->rom + 0x134), "ONI 5") == 0;
+        b_is_confirm = strcmp((const char *)(gb->rom + 0x134), "ELITE SOCCER") == 0 ||
+                       strcmp((const char *)(gb->rom + 0x134), "SOCCER") == 0 ||
+                       strcmp((const char *)(gb->rom + 0x134), "GEX GECKO") == 0 ||
+                       strcmp((const char *)(gb->rom + 0x134), "BABE") == 0;
+        push_faster = strcmp((const char *)(gb->rom + 0x134), "MOGURA DE PON!") == 0 ||
+                      strcmp((const char *)(gb->rom + 0x134), "HUGO2 1/2") == 0 ||
+                      strcmp((const char *)(gb->rom + 0x134), "HUGO") == 0;
+        push_slower = strcmp((const char *)(gb->rom + 0x134), "BAKENOU") == 0;
+        do_not_stop = strcmp((const char *)(gb->rom + 0x134), "SPACE INVADERS") == 0;
+        push_right = memcmp((const char *)(gb->rom + 0x134), "BOB ET BOB", strlen("BOB ET BOB")) == 0 ||
+                     strcmp((const char *)(gb->rom + 0x134), "LITTLE MASTER") == 0 ||
                      /* M&M's Minis Madness Demo (which has no menu but the same title as the full game) */
-                     (memcmp((const char *)(gb.rom + 0x134), "MINIMADNESSBMIE", strlen("MINIMADNESSBMIE")) == 0 &&
-                      gb.rom[0x14e] == 0x6c);
+                     (memcmp((const char *)(gb->rom + 0x134), "MINIMADNESSBMIE", strlen("MINIMADNESSBMIE")) == 0 &&
+                      gb->rom[0x14e] == 0x6c);
         /* This game has some terrible menus. */
-        semi_random = strcmp((const char *)(gb.rom + 0x134), "KUKU GAME") == 0;
+        semi_random = strcmp((const char *)(gb->rom + 0x134), "KUKU GAME") == 0;
         
 
         
         /* This game temporarily sets SP to OAM RAM */
-        allow_weird_sp_values = strcmp((const char *)(gb.rom + 0x134), "WDL:TT") == 0 ||
+        allow_weird_sp_values = strcmp((const char *)(gb->rom + 0x134), "WDL:TT") == 0 ||
         /* Some mooneye-gb tests abuse the stack */
-                                strcmp((const char *)(gb.rom + 0x134), "mooneye-gb test") == 0;
+                                strcmp((const char *)(gb->rom + 0x134), "mooneye-gb test") == 0;
         
         /* This game uses some recursive algorithms and therefore requires quite a large call stack */
-        large_stack = memcmp((const char *)(gb.rom + 0x134), "MICRO EPAK1BM", strlen("MICRO EPAK1BM")) == 0 ||
-                      strcmp((const char *)(gb.rom + 0x134), "TECMO BOWL") == 0;
+        large_stack = memcmp((const char *)(gb->rom + 0x134), "MICRO EPAK1BM", strlen("MICRO EPAK1BM")) == 0 ||
+                      strcmp((const char *)(gb->rom + 0x134), "TECMO BOWL") == 0;
         /* High quality game that leaks stack whenever you open the menu (with start),
          but requires pressing start to play it. */
-        limit_start = strcmp((const char *)(gb.rom + 0x134), "DIVA STARS") == 0;
+        limit_start = strcmp((const char *)(gb->rom + 0x134), "DIVA STARS") == 0;
         large_stack |= limit_start;
 
         /* Pressing start while in the map in Tsuri Sensei will leak an internal screen-stack which
            will eventually overflow, override an array of jump-table indexes, jump to a random
            address, execute an invalid opcode, and crash. Pressing A twice while slowing down
            will prevent this scenario. */
-        push_a_twice = strcmp((const char *)(gb.rom + 0x134), "TURI SENSEI V1") == 0;
+        push_a_twice = strcmp((const char *)(gb->rom + 0x134), "TURI SENSEI V1") == 0;
 
         /* Yes, you should totally use a cursor point & click interface for the language select menu. */
-        pointer_control = memcmp((const char *)(gb.rom + 0x134), "LEGO ATEAM BLPP", strlen("LEGO ATEAM BLPP")) == 0;
+        pointer_control = memcmp((const char *)(gb->rom + 0x134), "LEGO ATEAM BLPP", strlen("LEGO ATEAM BLPP")) == 0;
         push_faster |= pointer_control;
         
         /* Games that perform an unsafe speed switch, don't input until in double speed */
-        unsafe_speed_switch = strcmp((const char *)(gb.rom + 0x134), "GBVideo") == 0 || // lulz this is my fault
-                              strcmp((const char *)(gb.rom + 0x134), "POKEMONGOLD 2") == 0; // Pokemon Adventure
+        unsafe_speed_switch = strcmp((const char *)(gb->rom + 0x134), "GBVideo") == 0 || // lulz this is my fault
+                              strcmp((const char *)(gb->rom + 0x134), "POKEMONGOLD 2") == 0; // Pokemon Adventure
 
         
+        bool checked = false;
+        for (check_t *check = checks; check->option; check++) {
+            if (check->enabled && check->run) {
+                check->run(pool, gb, test_length);
+                checked = true;
+            }
+        }
+        
         /* Run emulation */
-        running = true;
-        gb.turbo = gb.turbo_dont_skip = gb.disable_rendering = true;
+        running = !checked;
         frames = 0;
         unsigned cycles = 0;
+        unsigned instructions = 0;
+        if (record_hashes || bisect_hashes || audit_mode != AUDIT_NONE) {
+            /* The RTC's epoch comes from the wall clock, pin it so runs can be compared */
+            gb->last_rtc_second = 0;
+        }
+        if ((record_hashes || bisect_hashes) && !open_hashes(gb)) {
+            exit(1);
+        }
+#ifndef _WIN32
+        if (audit_mode == AUDIT_WITH_PEER && audit_write_fd < 0 && !spawn_audit_peer(argc, argv)) {
+            exit(1);
+        }
+#endif
+        start_audit(gb);
+        bool compared = record_hashes || bisect_hashes || audit_mode != AUDIT_NONE;
+        idle_loops_requested = gb->idle_loop_detection;
+        block_translation_requested = gb->block_translation;
         while (running) {
-            cycles += GB_run(&gb);
+            if (compared) {
+                bool hold = cycles + FAST_PATH_MAX_CYCLES >= 139810 || (record_hashes && frames == hash_detail_frame);
+                hold_fast_paths(gb, hold);
+                if (auditing && audit_mode == AUDIT_IN_PROCESS) {
+                    hold_fast_paths(&audit_gb, hold);
+                }
+            }
+            unsigned run_cycles = GB_run(gb);
+            cycles += run_cycles;
+            if (auditing && audit_mode == AUDIT_IN_PROCESS) {
+                audit_step(gb, run_cycles);
+            }
+            if (record_hashes || bisect_hashes) {
+                handle_hashes(gb, ++instructions, false);
+            }
             if (cycles >= 139810) { /* Approximately 1/60 a second. Intentionally not the actual length of a frame. */
-                handle_buttons(&gb);
+                handle_buttons(gb);
+                if (auditing && audit_mode == AUDIT_IN_PROCESS) {
+                    handle_buttons(&audit_gb);
+                }
+                if (record_hashes || bisect_hashes) {
+                    handle_hashes(gb, instructions, true);
+                }
+                if (auditing && frames % audit_interval == 0) {
+                    audit_check(gb, false);
+                }
                 cycles -= 139810;
                 frames++;
+                instructions = 0;
             }
             /* This early crash test must not run in vblank because PC might not point to the next instruction. */
-            if (gb.pc == 0x38 && frames < test_length - 1 && GB_read_memory(&gb, 0x38) == 0xFF) {
-                GB_log(&gb, "The game is probably stuck in an FF loop.\n");
+            if (gb->pc == 0x38 && frames < test_length - 1 && GB_read_memory(gb, 0x38) == 0xFF) {
+                GB_log(gb, "The game is probably stuck in an FF loop.\n");
                 frames = test_length - 1;
             }
         }
         
+        if (compared) {
+            hold_fast_paths(gb, false);
+        }
+        
+        close_hashes();
+        end_audit(gb);
         
         if (log_file) {
             fclose(log_file);
             log_file = NULL;
         }
         
-        GB_free(&gb);
+        GB_pool_release(pool, gb);
 #ifndef _WIN32
         if (max_forks > 1) {
             exit(0);
@@ -529,9 +1280,19 @@ int main(int argc, char **argv)
 #endif
     }
 #ifndef _WIN32
+    if (audit_mode == AUDIT_WITH_PEER && audit_write_fd >= 0) {
+        close(audit_read_fd);
+        close(audit_write_fd);
+    }
     int wait_out;
     while (wait(&wait_out) != -1);
 #endif
+    for (check_t *check = checks; check->option; check++) {
+        if (check->enabled && check->run_once) {
+            check->run_once(pool, test_length);
+        }
+    }
+    GB_pool_free(pool);
     return 0;
 }
 
@@ -16,6 +16,14 @@ static inline int pthread_create(pthread_t *pthread,
     return *pthread? 0 : GetLastError();
 }
 
+static inline int pthread_join(pthread_t pthread, void **ret)
+{
+    assert(!ret);
+    WaitForSingleObject(pthread, INFINITE);
+    CloseHandle(pthread);
+    return 0;
+}
+
 
 typedef struct {
     unsigned status;
@@ -78,6 +86,12 @@ static inline int pthread_cond_signal(pthread_cond_t *cond)
     return 0;
 }
 
+static inline int pthread_cond_broadcast(pthread_cond_t *cond)
+{
+    WakeAllConditionVariable(pthread_cond_to_win(cond));
+    return 0;
+}
+
 static inline int pthread_cond_wait(pthread_cond_t *cond,
                                     pthread_mutex_t *mutex)
 {
@@ -98,6 +98,10 @@ static unsigned audio_out = 0;
 
 static bool geometry_updated = false;
 static bool link_cable_emulation = false;
+static unsigned run_ahead_frames = 0;
+static void *run_ahead_snapshot = NULL;
+static size_t run_ahead_snapshot_size = 0;
+static struct retro_perf_callback perf_cb;
 /*static bool infrared_emulation   = false;*/
 
 static struct {
@@ -348,7 +352,8 @@ static void set_variable_visibility(void)
             (strcmp(key, "sameboy_border")                  == 0) ||
             (strcmp(key, "sameboy_high_pass_filter_mode")   == 0) ||
             (strcmp(key, "sameboy_audio_interference")      == 0) ||
-            (strcmp(key, "sameboy_rumble")                  == 0)) {
+            (strcmp(key, "sameboy_rumble")                  == 0) ||
+            (strcmp(key, "sameboy_run_ahead")               == 0)) {
             option_display_singlecart.key = key;
             environ_cb(RETRO_ENVIRONMENT_SET_CORE_OPTIONS_DISPLAY, &option_display_singlecart);
         }
@@ -869,6 +874,12 @@ static void check_variables()
             }
         }
 
+        var.key = "sameboy_run_ahead";
+        var.value = NULL;
+        if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+            run_ahead_frames = atoi(var.value);
+        }
+
     }
     else {
         GB_set_border_mode(&gameboy[0], GB_BORDER_NEVER);
@@ -1305,6 +1316,41 @@ void retro_reset(void)
     geometry_updated = true;
 }
 
+/* Emulates past the current frame with the current input, shows the last frame and rolls back, hiding the game's own
+   input lag. Only the snapshot is copied, which is much cheaper than a full save state round trip. */
+static void run_ahead(GB_gameboy_t *gb)
+{
+    retro_time_t start = perf_cb.get_time_usec? perf_cb.get_time_usec() : 0;
+    size_t size = GB_get_snapshot_size(gb);
+    if (size > run_ahead_snapshot_size) {
+        free(run_ahead_snapshot);
+        run_ahead_snapshot = malloc(size);
+        run_ahead_snapshot_size = size;
+    }
+    
+    GB_take_snapshot(gb, run_ahead_snapshot);
+    GB_set_speculating(gb, true);
+    for (unsigned i = 0; i < run_ahead_frames; i++) {
+        /* Frames that are never shown don't have to be rendered */
+        GB_set_rendering_disabled(gb, i != run_ahead_frames - 1);
+        GB_run_frame(gb);
+    }
+    GB_set_rendering_disabled(gb, false);
+    GB_restore_snapshot(gb, run_ahead_snapshot);
+    GB_set_speculating(gb, false);
+    
+    if (!perf_cb.get_time_usec) return;
+    static retro_time_t total_cost = 0;
+    static unsigned frames = 0;
+    total_cost += perf_cb.get_time_usec() - start;
+    if (++frames == 600) {
+        log_cb(RETRO_LOG_INFO, "Run-ahead: %u frames, %.1fms latency saved, %.2fms CPU per frame\n",
+               run_ahead_frames, run_ahead_frames * 1000 / GB_get_usual_frame_rate(gb), total_cost / 1000.0 / frames);
+        total_cost = 0;
+        frames = 0;
+    }
+}
+
 void retro_run(void)
 {
 
@@ -1356,6 +1402,9 @@ void retro_run(void)
     }
     else {
         GB_run_frame(&gameboy[0]);
+        if (run_ahead_frames) {
+            run_ahead(&gameboy[0]);
+        }
     }
 
     if (emulated_devices == 2) {
@@ -1472,6 +1521,10 @@ bool retro_load_game(const struct retro_game_info *info)
         log_cb(RETRO_LOG_INFO, "Rumble environment not supported\n");
     }
 
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_PERF_INTERFACE, &perf_cb)) {
+        perf_cb.get_time_usec = NULL;
+    }
+
     check_variables();
 
     retro_set_memory_maps();
@@ -1485,6 +1538,9 @@ void retro_unload_game(void)
         log_cb(RETRO_LOG_INFO, "Unloading GB: %d\n", emulated_devices);
         GB_free(&gameboy[i]);
     }
+    free(run_ahead_snapshot);
+    run_ahead_snapshot = NULL;
+    run_ahead_snapshot_size = 0;
 }
 
 unsigned retro_get_region(void)